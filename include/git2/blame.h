@@ -195,6 +195,51 @@ GIT_EXTERN(int) git_blame_file(
 		git_blame_options *options);
 
 
+/**
+ * Callback for `git_blame_file_incremental`, invoked with each hunk of
+ * the file once its origin is known.
+ *
+ * The hunk is only valid for the duration of the callback.  Return a
+ * non-zero value to stop blaming; that value is then returned from
+ * `git_blame_file_incremental`.
+ *
+ * @param hunk the hunk whose origin has been found
+ * @param payload the payload given to `git_blame_file_incremental`
+ * @return 0 to continue, or a non-zero value to stop
+ */
+typedef int GIT_CALLBACK(git_blame_hunk_cb)(
+	const git_blame_hunk *hunk,
+	void *payload);
+
+/**
+ * Get the blame for a single file incrementally.
+ *
+ * Rather than returning the complete blame once every line has been
+ * attributed, the callback is invoked with each hunk as soon as the
+ * commit that introduced it is known, like `git blame --incremental`.
+ * The hunks are not given in line order, and adjacent hunks that come
+ * from the same commit may be reported separately.
+ *
+ * Only the lines between `min_line` and `max_line` of the options are
+ * blamed; history is not examined for the lines outside of that range.
+ *
+ * @param repo repository whose history is to be walked
+ * @param path path to file to consider
+ * @param options options for the blame operation.  If NULL, this is treated as
+ *                though GIT_BLAME_OPTIONS_INIT were passed.
+ * @param cb callback to invoke for each hunk
+ * @param payload payload to pass to the callback
+ * @return 0 on success, the non-zero return value of the callback, or an
+ *         error code.
+ */
+GIT_EXTERN(int) git_blame_file_incremental(
+		git_repository *repo,
+		const char *path,
+		git_blame_options *options,
+		git_blame_hunk_cb cb,
+		void *payload);
+
+
 /**
  * Get blame data for a file that has been modified in memory. The `reference`
  * parameter is a pre-calculated blame for the in-odb history of the file. This
@@ -323,6 +323,17 @@ typedef struct git_checkout_options {
 
 	/** Payload passed to perfdata_cb */
 	void *perfdata_payload;
+
+	/**
+	 * Number of threads used to write files to the working directory.
+	 * The default (0 or 1) writes them one at a time.
+	 *
+	 * Directories are still created, and conflicting files removed, on
+	 * the calling thread; only the writing of the file contents is
+	 * spread across threads.  Any custom filters must be safe to run on
+	 * multiple threads at once when this is set.
+	 */
+	unsigned int workers;
 } git_checkout_options;
 
 #define GIT_CHECKOUT_OPTIONS_VERSION 1
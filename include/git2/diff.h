@@ -1071,6 +1071,132 @@ GIT_EXTERN(int) git_diff_foreach(
 	git_diff_line_cb line_cb,
 	void *payload);
 
+/**
+ * Diff two tree objects, issuing callbacks for each delta as it is found.
+ *
+ * This produces the same deltas as `git_diff_tree_to_tree` followed by
+ * `git_diff_foreach`, but without building the list of deltas first: the
+ * callbacks for a file are made as soon as the trees have been walked up
+ * to that path, and the delta is released once they return.  Memory use
+ * is bounded by the depth of the trees rather than by the number of
+ * changes, and the first callback is not delayed until the whole diff
+ * is known.
+ *
+ * Rename and copy detection need to see every delta at once, so they are
+ * not available here; use `git_diff_tree_to_tree` and
+ * `git_diff_find_similar` when they are wanted.  Deltas are reported in
+ * the order that the paths are walked, and the `progress` argument to
+ * `file_cb` is always 0.
+ *
+ * Returning a non-zero value from any of the callbacks will terminate
+ * the diff and return the value to the user.
+ *
+ * @param repo The repository containing the trees.
+ * @param old_tree A git_tree object to diff from, or NULL for empty tree.
+ * @param new_tree A git_tree object to diff to, or NULL for empty tree.
+ * @param opts Structure with options to influence diff or NULL for defaults.
+ * @param file_cb Callback function to make per file in the diff.
+ * @param binary_cb Optional callback to make for binary files.
+ * @param hunk_cb Optional callback to make per hunk of text diff.
+ * @param line_cb Optional callback to make per line of diff text.
+ * @param payload Reference pointer that will be passed to your callbacks.
+ * @return 0 on success, non-zero callback return value, or error code
+ */
+GIT_EXTERN(int) git_diff_tree_to_tree_foreach(
+	git_repository *repo,
+	git_tree *old_tree,
+	git_tree *new_tree,
+	const git_diff_options *opts,
+	git_diff_file_cb file_cb,
+	git_diff_binary_cb binary_cb,
+	git_diff_hunk_cb hunk_cb,
+	git_diff_line_cb line_cb,
+	void *payload);
+
+/**
+ * Diff a tree and the repository index, issuing callbacks for each delta
+ * as it is found.
+ *
+ * This is the streaming form of `git_diff_tree_to_index`; see
+ * `git_diff_tree_to_tree_foreach` for how it differs from building a diff.
+ *
+ * @param repo The repository containing the tree and index.
+ * @param old_tree A git_tree object to diff from, or NULL for empty tree.
+ * @param index The index to diff with; repo index used if NULL.
+ * @param opts Structure with options to influence diff or NULL for defaults.
+ * @param file_cb Callback function to make per file in the diff.
+ * @param binary_cb Optional callback to make for binary files.
+ * @param hunk_cb Optional callback to make per hunk of text diff.
+ * @param line_cb Optional callback to make per line of diff text.
+ * @param payload Reference pointer that will be passed to your callbacks.
+ * @return 0 on success, non-zero callback return value, or error code
+ */
+GIT_EXTERN(int) git_diff_tree_to_index_foreach(
+	git_repository *repo,
+	git_tree *old_tree,
+	git_index *index,
+	const git_diff_options *opts,
+	git_diff_file_cb file_cb,
+	git_diff_binary_cb binary_cb,
+	git_diff_hunk_cb hunk_cb,
+	git_diff_line_cb line_cb,
+	void *payload);
+
+/**
+ * Diff the repository index and the working directory, issuing callbacks
+ * for each delta as it is found.
+ *
+ * This is the streaming form of `git_diff_index_to_workdir`; see
+ * `git_diff_tree_to_tree_foreach` for how it differs from building a diff.
+ * The index must not be modified from the callbacks.
+ *
+ * @param repo The repository.
+ * @param index The index to diff from; repo index used if NULL.
+ * @param opts Structure with options to influence diff or NULL for defaults.
+ * @param file_cb Callback function to make per file in the diff.
+ * @param binary_cb Optional callback to make for binary files.
+ * @param hunk_cb Optional callback to make per hunk of text diff.
+ * @param line_cb Optional callback to make per line of diff text.
+ * @param payload Reference pointer that will be passed to your callbacks.
+ * @return 0 on success, non-zero callback return value, or error code
+ */
+GIT_EXTERN(int) git_diff_index_to_workdir_foreach(
+	git_repository *repo,
+	git_index *index,
+	const git_diff_options *opts,
+	git_diff_file_cb file_cb,
+	git_diff_binary_cb binary_cb,
+	git_diff_hunk_cb hunk_cb,
+	git_diff_line_cb line_cb,
+	void *payload);
+
+/**
+ * Diff a tree and the working directory, issuing callbacks for each delta
+ * as it is found.
+ *
+ * This is the streaming form of `git_diff_tree_to_workdir`; see
+ * `git_diff_tree_to_tree_foreach` for how it differs from building a diff.
+ *
+ * @param repo The repository containing the tree.
+ * @param old_tree A git_tree object to diff from, or NULL for empty tree.
+ * @param opts Structure with options to influence diff or NULL for defaults.
+ * @param file_cb Callback function to make per file in the diff.
+ * @param binary_cb Optional callback to make for binary files.
+ * @param hunk_cb Optional callback to make per hunk of text diff.
+ * @param line_cb Optional callback to make per line of diff text.
+ * @param payload Reference pointer that will be passed to your callbacks.
+ * @return 0 on success, non-zero callback return value, or error code
+ */
+GIT_EXTERN(int) git_diff_tree_to_workdir_foreach(
+	git_repository *repo,
+	git_tree *old_tree,
+	const git_diff_options *opts,
+	git_diff_file_cb file_cb,
+	git_diff_binary_cb binary_cb,
+	git_diff_hunk_cb hunk_cb,
+	git_diff_line_cb line_cb,
+	void *payload);
+
 /**
  * Look up the single character abbreviation for a delta status code.
  *
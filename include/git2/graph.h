@@ -36,6 +36,32 @@ GIT_BEGIN_DECL
  */
 GIT_EXTERN(int) git_graph_ahead_behind(size_t *ahead, size_t *behind, git_repository *repo, const git_oid *local, const git_oid *upstream);
 
+/**
+ * Count the number of unique commits between many local commits and a
+ * single upstream commit
+ *
+ * This gives the same results as calling `git_graph_ahead_behind` for
+ * each of the `locals` against `upstream`, but walks the history only
+ * once, so it is much faster for a large number of branches.
+ *
+ * @param ahead array of `locals_len` counts; `ahead[i]` is set to the
+ *  number of commits in `locals[i]` that are not in `upstream`
+ * @param behind array of `locals_len` counts; `behind[i]` is set to the
+ *  number of commits in `upstream` that are not in `locals[i]`
+ * @param repo the repository where the commits exist
+ * @param locals the commits for the locals
+ * @param locals_len the number of commits in `locals`
+ * @param upstream the commit for upstream
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_graph_ahead_behind_many(
+	size_t *ahead,
+	size_t *behind,
+	git_repository *repo,
+	const git_oid *locals,
+	size_t locals_len,
+	const git_oid *upstream);
+
 
 /**
  * Determine if a commit is the descendant of another commit.
@@ -53,6 +79,79 @@ GIT_EXTERN(int) git_graph_descendant_of(
 	const git_oid *commit,
 	const git_oid *ancestor);
 
+/**
+ * Determine which of many commits are reachable from any of the given tips.
+ *
+ * A commit is reachable from a tip when it is the tip itself or one of
+ * its ancestors.  The history of all of the tips is walked at most once,
+ * which is much faster than checking each commit and tip separately.
+ * The answer does not depend on commit dates; when generation numbers
+ * are stored (see `git_graph_generations_update`), they are used to
+ * stop the walk early.
+ *
+ * @param reachable array of `commits_len` entries; `reachable[i]` is set
+ *  to 1 when `commits[i]` is reachable from any of the tips, 0 otherwise
+ * @param repo the repository where the commits exist
+ * @param commits the commits to look for
+ * @param commits_len the number of commits in `commits`
+ * @param tips the commits whose history is searched
+ * @param tips_len the number of commits in `tips`
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_graph_reachable_from_any(
+	int *reachable,
+	git_repository *repo,
+	const git_oid *commits,
+	size_t commits_len,
+	const git_oid *tips,
+	size_t tips_len);
+
+/**
+ * Update the changed-path Bloom filters of a repository.
+ *
+ * For every commit in the history of the `tips`, a Bloom filter of the
+ * paths that it changes relative to its first parent is stored in
+ * `objects/info/commit-bloom`.  Path-limited revision walks and blame use
+ * these filters to skip the commits that cannot have changed a path
+ * without loading their trees.
+ *
+ * Existing filters are kept, so updating after new commits have been
+ * made only computes the filters of the new commits.
+ *
+ * @param repo the repository to update the filters of
+ * @param tips the commits whose history should have filters
+ * @param tips_len the number of commits in `tips`
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_graph_bloom_update(
+	git_repository *repo,
+	const git_oid *tips,
+	size_t tips_len);
+
+/**
+ * Update the stored commit generation numbers of a repository.
+ *
+ * The generation number of a commit is 1 for a root commit, and
+ * otherwise one more than the largest generation of its parents.  For
+ * every commit in the history of the `tips`, it is stored in
+ * `objects/info/commit-generations`.  Merge base computations, graph
+ * queries and topological revision walks use the stored generations to
+ * stop walking history early; without them, they walk by commit date.
+ *
+ * Existing generations are kept, so updating after new commits have
+ * been made only computes the generations of the new commits.  Shallow
+ * repositories cannot have generation numbers.
+ *
+ * @param repo the repository to update the generation numbers of
+ * @param tips the commits whose history should have generation numbers
+ * @param tips_len the number of commits in `tips`
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_graph_generations_update(
+	git_repository *repo,
+	const git_oid *tips,
+	size_t tips_len);
+
 /** @} */
 GIT_END_DECL
 #endif
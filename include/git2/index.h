@@ -408,6 +408,11 @@ GIT_EXTERN(const git_index_entry *) git_index_get_byindex(
  * `git_index_entry` struct is a publicly defined struct, you should
  * be able to make your own permanent copy of the data if necessary.
  *
+ * If `path` lies inside of a sparse directory, that directory is
+ * expanded into its contents first.  Like any other change to the
+ * index, this moves entries to new positions (as used by
+ * `git_index_get_byindex`) and frees the sparse directory entry.
+ *
  * @param index an existing index object
  * @param path path to search
  * @param stage stage to search
@@ -719,6 +724,45 @@ GIT_EXTERN(int) git_index_find_prefix(size_t *at_pos, git_index *index, const ch
 
 /**@}*/
 
+/** @name Sparse Index Functions
+ *
+ * A sparse index stores a directory that is entirely outside of the
+ * sparse-checkout cone as a single "sparse directory" entry: its path
+ * ends in a '/', its mode is `GIT_FILEMODE_TREE`, it is flagged with
+ * `GIT_INDEX_ENTRY_SKIP_WORKTREE` and its id is the tree it represents.
+ *
+ * Sparse directories are expanded lazily, when an operation looks up,
+ * adds or removes a path inside of them, or iterates the whole index
+ * for a diff, status or checkout.
+ */
+/**@{*/
+
+/**
+ * Collapse a directory of the index into a single sparse directory entry.
+ *
+ * Every entry beneath `dir` must be at stage 0 and flagged with
+ * `GIT_INDEX_ENTRY_SKIP_WORKTREE`.  If the tree for the directory is
+ * not known to the index's tree cache, the index's trees are written
+ * to the object database first.
+ *
+ * @param index an existing index object
+ * @param dir the directory to collapse
+ * @return 0, GIT_ENOTFOUND if the directory is not in the index, or an
+ *         error code
+ */
+GIT_EXTERN(int) git_index_sparse_collapse(git_index *index, const char *dir);
+
+/**
+ * Expand all sparse directory entries in the index into the entries of
+ * the trees that they represent.
+ *
+ * @param index an existing index object
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_index_sparse_expand(git_index *index);
+
+/**@}*/
+
 /** @name Conflict Index Entry Functions
  *
  * These functions work on conflict index entries specifically (ie, stages 1-3)
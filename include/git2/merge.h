@@ -554,6 +554,42 @@ GIT_EXTERN(int) git_merge_trees(
 	const git_tree *their_tree,
 	const git_merge_options *opts);
 
+/**
+ * Merge two trees, writing the result as a tree without building an
+ * index for it.
+ *
+ * This gives the same result as `git_merge_trees` followed by
+ * `git_index_write_tree_to`, but it only reads the subtrees that were
+ * changed on both sides: a subtree or file that only one side changed is
+ * taken from that side as it is, so the cost of the merge follows the
+ * size of the changes rather than the size of the trees.  When the result
+ * depends on changes elsewhere in the trees (directory/file conflicts, or
+ * files that both sides added or deleted while rename detection is
+ * enabled), the full merge is run instead.
+ *
+ * If the merge has conflicts, no tree is written and `GIT_EMERGECONFLICT`
+ * is returned.  The conflicts are then given in `conflicts`, if it is not
+ * NULL, as an index that holds only the conflicting entries.
+ *
+ * @param out pointer to store the id of the merged tree in
+ * @param conflicts pointer to store the conflicts in (or null)
+ * @param repo repository that contains the given trees
+ * @param ancestor_tree the common ancestor between the trees (or null if none)
+ * @param our_tree the tree that reflects the destination tree
+ * @param their_tree the tree to merge in to `our_tree`
+ * @param opts the merge tree options (or null for defaults)
+ * @return 0 on success, GIT_EMERGECONFLICT if the merge has conflicts,
+ *         or an error code
+ */
+GIT_EXTERN(int) git_merge_trees_to_tree(
+	git_oid *out,
+	git_index **conflicts,
+	git_repository *repo,
+	const git_tree *ancestor_tree,
+	const git_tree *our_tree,
+	const git_tree *their_tree,
+	const git_merge_options *opts);
+
 /**
  * Merge two commits, producing a `git_index` that reflects the result of
  * the merge.  The index may be written as-is to the working directory
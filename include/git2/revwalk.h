@@ -253,6 +253,24 @@ GIT_EXTERN(int) git_revwalk_push_range(git_revwalk *walk, const char *range);
  */
 GIT_EXTERN(int) git_revwalk_simplify_first_parent(git_revwalk *walk);
 
+/**
+ * Limit the walk to the commits that change the given paths
+ *
+ * As with `git log -- <path>...`, a commit is only shown when it differs
+ * from its parents at any of the paths, and a merge that is identical to
+ * one of its parents at all of the paths is only followed through that
+ * parent.  The paths name files or directories literally; they are not
+ * glob patterns.
+ *
+ * Like the other walk options, this is undone when the walker is reset.
+ *
+ * @param walk the walker being used for the traversal
+ * @param pathspec the paths to limit the walk to
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_revwalk_pathspec(
+	git_revwalk *walk, const git_strarray *pathspec);
+
 
 /**
  * Free a revision walker previously allocated.
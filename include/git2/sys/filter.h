@@ -301,6 +301,13 @@ GIT_EXTERN(int) git_filter_init(git_filter *filter, unsigned int version);
  * deregistering of filters must be done outside of any possible usage of
  * the filters (i.e. during application setup or shutdown).
  *
+ * libgit2 only applies a custom filter from more than one thread at once
+ * when asked to, such as by a checkout with `workers` set (see
+ * `git_checkout_options`); the filter's callbacks must then be thread
+ * safe.  Otherwise, operations that spread their work across threads
+ * (such as hashing the working directory files in a diff) only do so
+ * for files that need no filters but the builtin ones.
+ *
  * @param name A name by which the filter can be referenced.  Attempting
  * 			to register with an in-use name will return GIT_EEXISTS.
  * @param filter The filter definition.  This pointer will be stored as is
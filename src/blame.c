@@ -310,6 +310,24 @@ static git_blame_hunk* hunk_from_entry(git_blame__entry *e, git_blame *blame)
 	return h;
 }
 
+int git_blame__emit(git_blame *blame, git_blame__entry *ent)
+{
+	git_blame_hunk *hunk;
+	int error;
+
+	if (!blame->incremental_cb)
+		return 0;
+
+	if ((hunk = hunk_from_entry(ent, blame)) == NULL)
+		return -1;
+
+	error = blame->incremental_cb(hunk, blame->incremental_payload);
+	free_hunk(hunk);
+
+	return git_error_set_after_callback_function(
+		error, "git_blame_file_incremental");
+}
+
 static int load_blob(git_blame *blame)
 {
 	int error;
@@ -328,11 +346,13 @@ cleanup:
 
 static int blame_internal(git_blame *blame)
 {
+	size_t total;
 	int error;
 	git_blame__entry *ent = NULL;
 	git_blame__origin *o;
 
 	if ((error = load_blob(blame)) < 0 ||
+	    (error = git_commit_bloom_refresh(blame->repository)) < 0 ||
 	    (error = git_blame__get_origin(&o, blame, blame->final, blame->path)) < 0)
 		goto cleanup;
 
@@ -345,14 +365,34 @@ static int blame_internal(git_blame *blame)
 	blame->final_buf = git_blob_rawcontent(blame->final_blob);
 	blame->final_buf_size = (size_t)git_blob_rawsize(blame->final_blob);
 
+	if ((error = index_blob_lines(blame)) < 0)
+		goto cleanup;
+
+	total = (size_t)blame->num_lines;
+
+	/*
+	 * Only the requested range is seeded into the scoreboard, so no
+	 * history is examined for the lines outside of it.
+	 */
+	if (blame->options.min_line > max(total, 1) ||
+	    blame->options.max_line > total ||
+	    (blame->options.max_line &&
+	     blame->options.max_line < blame->options.min_line)) {
+		git_error_set(GIT_ERROR_INVALID,
+			"invalid line range %"PRIuZ"-%"PRIuZ" for '%s' with %"PRIuZ" lines",
+			blame->options.min_line, blame->options.max_line,
+			blame->path, total);
+		error = -1;
+		goto cleanup;
+	}
+
 	ent = git__calloc(1, sizeof(git_blame__entry));
 	GIT_ERROR_CHECK_ALLOC(ent);
 
-	ent->num_lines = index_blob_lines(blame);
 	ent->lno = blame->options.min_line - 1;
-	ent->num_lines = ent->num_lines - blame->options.min_line + 1;
+	ent->num_lines = total - ent->lno;
 	if (blame->options.max_line > 0)
-		ent->num_lines = blame->options.max_line - blame->options.min_line + 1;
+		ent->num_lines = blame->options.max_line - ent->lno;
 	ent->s_lno = ent->lno;
 	ent->suspect = o;
 
@@ -363,9 +403,12 @@ static int blame_internal(git_blame *blame)
 cleanup:
 	for (ent = blame->ent; ent; ) {
 		git_blame__entry *e = ent->next;
-		git_blame_hunk *h = hunk_from_entry(ent, blame);
 
-		git_vector_insert(&blame->hunks, h);
+		/* incremental blames have already reported their hunks */
+		if (!blame->incremental_cb) {
+			git_blame_hunk *h = hunk_from_entry(ent, blame);
+			git_vector_insert(&blame->hunks, h);
+		}
 
 		git_blame__free_entry(ent);
 		ent = e;
@@ -409,6 +452,35 @@ on_error:
 	return error;
 }
 
+int git_blame_file_incremental(
+		git_repository *repo,
+		const char *path,
+		git_blame_options *options,
+		git_blame_hunk_cb cb,
+		void *payload)
+{
+	git_blame_options normOptions = GIT_BLAME_OPTIONS_INIT;
+	git_blame *blame = NULL;
+	int error;
+
+	assert(repo && path && cb);
+
+	if ((error = normalize_options(&normOptions, options, repo)) < 0)
+		goto done;
+
+	blame = git_blame__alloc(repo, normOptions, path);
+	GIT_ERROR_CHECK_ALLOC(blame);
+
+	blame->incremental_cb = cb;
+	blame->incremental_payload = payload;
+
+	error = blame_internal(blame);
+
+done:
+	git_blame_free(blame);
+	return error;
+}
+
 /*******************************************************************************
  * Buffer blaming
  *******************************************************************************/
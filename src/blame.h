@@ -79,6 +79,10 @@ struct git_blame {
 	size_t current_diff_line;
 	git_blame_hunk *current_hunk;
 
+	/* Callback for hunks whose origin is final, for incremental blame */
+	git_blame_hunk_cb incremental_cb;
+	void *incremental_payload;
+
 	/* Scoreboard fields */
 	git_commit *final;
 	git_blame__entry *ent;
@@ -92,4 +96,10 @@ git_blame *git_blame__alloc(
 	git_blame_options opts,
 	const char *path);
 
+/*
+ * Report an entry whose origin has been found to the incremental blame
+ * callback, if there is one.
+ */
+int git_blame__emit(git_blame *blame, git_blame__entry *ent);
+
 #endif
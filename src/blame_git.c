@@ -8,9 +8,18 @@
 #include "blame_git.h"
 
 #include "commit.h"
+#include "commit_bloom.h"
 #include "blob.h"
 #include "xdiff/xinclude.h"
 #include "diff_xdiff.h"
+#include "array.h"
+#include "thread-utils.h"
+
+/*
+ * Merges are diffed against all of their parents at once, on separate
+ * threads, when the file is at least this large.
+ */
+#define BLAME_PARALLEL_DIFF_SIZE (16 * 1024)
 
 /*
  * Origin is refcounted and usually we keep the blob contents to be
@@ -78,14 +87,6 @@ int git_blame__get_origin(
 	return make_origin(out, commit, path);
 }
 
-typedef struct blame_chunk_cb_data {
-	git_blame *blame;
-	git_blame__origin *target;
-	git_blame__origin *parent;
-	long tlno;
-	long plno;
-}blame_chunk_cb_data;
-
 static bool same_suspect(git_blame__origin *a, git_blame__origin *b)
 {
 	if (a == b)
@@ -326,17 +327,37 @@ static int blame_chunk(
 	return 0;
 }
 
-static int my_emit(
+typedef struct {
+	long start_a, count_a;
+	long start_b, count_b;
+} blame_diff_hunk;
+
+/*
+ * The differences between a suspect and one of its parents.  These are
+ * computed without touching the scoreboard, so that the diffs against
+ * several parents can be produced concurrently, and then applied to the
+ * scoreboard in parent order.
+ */
+typedef struct {
+	git_blame__origin *parent;
+	git_array_t(blame_diff_hunk) hunks;
+	bool computed;
+} blame_parent_diff;
+
+static int record_hunk(
 	long start_a, long count_a,
 	long start_b, long count_b,
 	void *cb_data)
 {
-	blame_chunk_cb_data *d = (blame_chunk_cb_data *)cb_data;
+	blame_parent_diff *diff = (blame_parent_diff *)cb_data;
+	blame_diff_hunk *hunk = git_array_alloc(diff->hunks);
 
-	if (blame_chunk(d->blame, d->tlno, d->plno, start_b, d->target, d->parent) < 0)
-		return -1;
-	d->plno = start_a + count_a;
-	d->tlno = start_b + count_b;
+	GIT_ERROR_CHECK_ALLOC(hunk);
+
+	hunk->start_a = start_a;
+	hunk->count_a = count_a;
+	hunk->start_b = start_b;
+	hunk->count_b = count_b;
 
 	return 0;
 }
@@ -365,7 +386,7 @@ static void trim_common_tail(mmfile_t *a, mmfile_t *b, long ctx)
 	b->size -= trimmed - recovered;
 }
 
-static int diff_hunks(mmfile_t file_a, mmfile_t file_b, void *cb_data, git_blame_options *options)
+static int diff_hunks(mmfile_t file_a, mmfile_t file_b, blame_parent_diff *cb_data, git_blame_options *options)
 {
 	xdemitconf_t xecfg = {0};
 	xdemitcb_t ecb = {0};
@@ -374,7 +395,7 @@ static int diff_hunks(mmfile_t file_a, mmfile_t file_b, void *cb_data, git_blame
 	if (options->flags & GIT_BLAME_IGNORE_WHITESPACE)
 		xpp.flags |= XDF_IGNORE_WHITESPACE;
 
-	xecfg.hunk_func = my_emit;
+	xecfg.hunk_func = record_hunk;
 	ecb.priv = cb_data;
 
 	trim_common_tail(&file_a, &file_b, 0);
@@ -397,26 +418,87 @@ static void fill_origin_blob(git_blame__origin *o, mmfile_t *file)
 	}
 }
 
+static int diff_parent(
+	blame_parent_diff *diff,
+	git_blame__origin *target,
+	git_blame_options *options)
+{
+	mmfile_t file_p, file_o;
+
+	fill_origin_blob(diff->parent, &file_p);
+	fill_origin_blob(target, &file_o);
+
+	diff->computed = true;
+
+	return diff_hunks(file_p, file_o, diff, options);
+}
+
+typedef struct {
+	blame_parent_diff *diffs;
+	git_blame__origin *target;
+	git_blame_options *options;
+} parallel_diff_data;
+
+static int diff_parent_cb(size_t idx, void *payload)
+{
+	parallel_diff_data *data = payload;
+
+	return diff_parent(&data->diffs[idx], data->target, data->options);
+}
+
+/*
+ * Compute the diffs against all of the parents of a merge up front,
+ * spreading them across threads when the file is large enough for that
+ * to pay off.  Otherwise they are computed lazily, one parent at a time,
+ * since the first parents often take all of the blame.
+ */
+static int diff_parents(
+	git_blame *blame,
+	git_blame__origin *target,
+	blame_parent_diff *diffs,
+	size_t diffs_len)
+{
+	parallel_diff_data data = { diffs, target, &blame->options };
+	size_t nthreads;
+
+	if (diffs_len < 2 || !target->blob ||
+	    git_blob_rawsize(target->blob) < BLAME_PARALLEL_DIFF_SIZE)
+		return 0;
+
+	nthreads = min(diffs_len, (size_t)git_online_cpus());
+
+	if (nthreads < 2)
+		return 0;
+
+	return git_parallel_foreach(diffs_len, nthreads, diff_parent_cb, &data);
+}
+
 static int pass_blame_to_parent(
 		git_blame *blame,
 		git_blame__origin *target,
-		git_blame__origin *parent)
+		blame_parent_diff *diff)
 {
-	size_t last_in_target;
-	mmfile_t file_p, file_o;
-	blame_chunk_cb_data d = { blame, target, parent, 0, 0 };
+	size_t last_in_target, i;
+	blame_diff_hunk *hunk;
+	long tlno = 0, plno = 0;
 
 	if (!find_last_in_target(&last_in_target, blame, target))
 		return 1; /* nothing remains for this target */
 
-	fill_origin_blob(parent, &file_p);
-	fill_origin_blob(target, &file_o);
-
-	if (diff_hunks(file_p, file_o, &d, &blame->options) < 0)
+	if (!diff->computed &&
+	    diff_parent(diff, target, &blame->options) < 0)
 		return -1;
 
+	git_array_foreach(diff->hunks, i, hunk) {
+		if (blame_chunk(blame, tlno, plno, hunk->start_b, target, diff->parent) < 0)
+			return -1;
+
+		plno = hunk->start_a + hunk->count_a;
+		tlno = hunk->start_b + hunk->count_b;
+	}
+
 	/* The reset (i.e. anything after tlno) are the same as the parent */
-	if (blame_chunk(blame, d.tlno, d.plno, last_in_target, target, parent) < 0)
+	if (blame_chunk(blame, tlno, plno, last_in_target, target, diff->parent) < 0)
 		return -1;
 
 	return 0;
@@ -439,6 +521,15 @@ static git_blame__origin* find_origin(
 	git_diff_options diffopts = GIT_DIFF_OPTIONS_INIT;
 	git_tree *otree=NULL, *ptree=NULL;
 
+	/* The changed-path filters may tell us that nothing changed */
+	if (git_commit_parentcount(origin->commit) > 0 &&
+	    git_oid_equal(git_commit_id(parent), git_commit_parent_id(origin->commit, 0)) &&
+	    git_commit_bloom_maybe_changed(blame->repository,
+			git_commit_id(origin->commit), origin->path) == 0) {
+		git_blame__get_origin(&porigin, blame, parent, origin->path);
+		return porigin;
+	}
+
 	/* Get the trees from this commit and its parent */
 	if (0 != git_commit_tree(&otree, origin->commit) ||
 	    0 != git_commit_tree(&ptree, parent))
@@ -522,6 +613,8 @@ static int pass_blame(git_blame *blame, git_blame__origin *origin, uint32_t opt)
 	int i, num_parents;
 	git_blame__origin *sg_buf[16];
 	git_blame__origin *porigin, **sg_origin = sg_buf;
+	blame_parent_diff *diffs = NULL;
+	size_t diffs_len = 0;
 	int ret, error = 0;
 
 	num_parents = git_commit_parentcount(commit);
@@ -582,16 +675,27 @@ static int pass_blame(git_blame *blame, git_blame__origin *origin, uint32_t opt)
 	}
 
 	/* Standard blame */
-	for (i=0; i<num_parents; i++) {
-		git_blame__origin *porigin = sg_origin[i];
-		if (!porigin)
-			continue;
+	if ((diffs = git__calloc(num_parents, sizeof(blame_parent_diff))) == NULL) {
+		error = -1;
+		goto finish;
+	}
+
+	for (i=0; i<num_parents; i++)
+		if (sg_origin[i])
+			diffs[diffs_len++].parent = sg_origin[i];
+
+	if ((error = diff_parents(blame, origin, diffs, diffs_len)) < 0)
+		goto finish;
+
+	for (i=0; i<(int)diffs_len; i++) {
+		git_blame__origin *porigin = diffs[i].parent;
+
 		if (!origin->previous) {
 			origin_incref(porigin);
 			origin->previous = porigin;
 		}
 
-		if ((ret = pass_blame_to_parent(blame, origin, porigin)) != 0) {
+		if ((ret = pass_blame_to_parent(blame, origin, &diffs[i])) != 0) {
 			if (ret < 0)
 				error = -1;
 
@@ -604,6 +708,9 @@ static int pass_blame(git_blame *blame, git_blame__origin *origin, uint32_t opt)
 	/* TODO: optionally find copies in parents' files */
 
 finish:
+	for (i=0; i<(int)diffs_len; i++)
+		git_array_clear(diffs[i].hunks);
+	git__free(diffs);
 	for (i=0; i<num_parents; i++)
 		if (sg_origin[i])
 			origin_decref(sg_origin[i]);
@@ -661,14 +768,20 @@ int git_blame__like_git(git_blame *blame, uint32_t opt)
 
 		/* Take responsibility for the remaining entries */
 		for (ent = blame->ent; ent; ent = ent->next) {
-			if (same_suspect(ent->suspect, suspect)) {
+			if (!ent->guilty && same_suspect(ent->suspect, suspect)) {
 				ent->guilty = true;
 				ent->is_boundary = !git_oid_cmp(
 						git_commit_id(suspect->commit),
 						&blame->options.oldest_commit);
+
+				if ((error = git_blame__emit(blame, ent)) != 0)
+					break;
 			}
 		}
 		origin_decref(suspect);
+
+		if (error)
+			break;
 	}
 
 	if (!error)
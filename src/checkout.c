@@ -32,6 +32,7 @@
 #include "attr.h"
 #include "pool.h"
 #include "strmap.h"
+#include "array.h"
 
 /* See docs/checkout-internals.md for more information */
 
@@ -1498,8 +1499,10 @@ static void checkout_stream_free(git_writestream *s)
 	GIT_UNUSED(s);
 }
 
-static int blob_content_to_file(
+static int blob_content_write(
 	checkout_data *data,
+	git_filter_options *filter_opts,
+	size_t *stat_calls,
 	struct stat *st,
 	git_blob *blob,
 	const char *path,
@@ -1509,7 +1512,6 @@ static int blob_content_to_file(
 	int flags = data->opts.file_open_flags;
 	mode_t file_mode = data->opts.file_mode ?
 		data->opts.file_mode : entry_filemode;
-	git_filter_options filter_opts = GIT_FILTER_OPTIONS_INIT;
 	struct checkout_stream writer;
 	mode_t mode;
 	git_filter_list *fl = NULL;
@@ -1519,9 +1521,6 @@ static int blob_content_to_file(
 	if (hint_path == NULL)
 		hint_path = path;
 
-	if ((error = mkpath2file(data, path, data->opts.dir_mode)) < 0)
-		return error;
-
 	if (flags <= 0)
 		flags = O_CREAT | O_TRUNC | O_WRONLY;
 	if (!(mode = file_mode))
@@ -1532,13 +1531,10 @@ static int blob_content_to_file(
 		return fd;
 	}
 
-	filter_opts.attr_session = &data->attr_session;
-	filter_opts.temp_buf = &data->tmp;
-
 	if (!data->opts.disable_filters &&
 		(error = git_filter_list__load_ext(
 			&fl, data->repo, blob, hint_path,
-			GIT_FILTER_TO_WORKTREE, &filter_opts))) {
+			GIT_FILTER_TO_WORKTREE, filter_opts))) {
 		p_close(fd);
 		return error;
 	}
@@ -1562,7 +1558,7 @@ static int blob_content_to_file(
 		return error;
 
 	if (st) {
-		data->perfdata.stat_calls++;
+		(*stat_calls)++;
 
 		if ((error = p_stat(path, st)) < 0) {
 			git_error_set(GIT_ERROR_OS, "failed to stat '%s'", path);
@@ -1575,6 +1571,27 @@ static int blob_content_to_file(
 	return 0;
 }
 
+static int blob_content_to_file(
+	checkout_data *data,
+	struct stat *st,
+	git_blob *blob,
+	const char *path,
+	const char *hint_path,
+	mode_t entry_filemode)
+{
+	git_filter_options filter_opts = GIT_FILTER_OPTIONS_INIT;
+	int error;
+
+	if ((error = mkpath2file(data, path, data->opts.dir_mode)) < 0)
+		return error;
+
+	filter_opts.attr_session = &data->attr_session;
+	filter_opts.temp_buf = &data->tmp;
+
+	return blob_content_write(data, &filter_opts,
+		&data->perfdata.stat_calls, st, blob, path, hint_path, entry_filemode);
+}
+
 static int blob_content_to_link(
 	checkout_data *data,
 	struct stat *st,
@@ -1857,20 +1874,275 @@ static int checkout_remove_the_old(
 	return 0;
 }
 
-static int checkout_create_the_new(
+/* Below this many files, a parallel checkout is not worth starting threads */
+#define CHECKOUT_PARALLEL_THRESHOLD 100
+
+typedef enum {
+	CHECKOUT_PARALLEL_WRITE = 0,
+	CHECKOUT_PARALLEL_SKIP,    /* nothing to write, or write was suppressed */
+	CHECKOUT_PARALLEL_WRITTEN, /* already written by the main thread */
+} checkout_parallel_state;
+
+typedef struct {
+	const git_diff_file *file;
+	const char *path;
+	struct stat st;
+	size_t stat_calls;
+	checkout_parallel_state state;
+} checkout_parallel_item;
+
+typedef struct {
+	checkout_data *data;
+	git_array_t(checkout_parallel_item) items;
+} checkout_parallel;
+
+GIT_INLINE(bool) checkout_is_parallel_blob(
+	unsigned int action, const git_diff_delta *delta)
+{
+	return (action & CHECKOUT_ACTION__UPDATE_BLOB) &&
+		!S_ISLNK(delta->new_file.mode);
+}
+
+/*
+ * Files are only written in parallel when there are enough of them, and
+ * when no two of them would end up at the same path on a case-insensitive
+ * filesystem; otherwise the last one written must win, as it does when
+ * checking out serially.
+ */
+static int checkout_use_parallel(
+	bool *out, unsigned int *actions, checkout_data *data)
+{
+	git_diff_delta *delta;
+	git_strmap *paths = NULL;
+	git_pool pool;
+	char *path;
+	size_t i, count = 0;
+	int error = 0;
+
+	*out = false;
+
+	if (data->opts.workers < 2)
+		return 0;
+
+	git_vector_foreach(&data->diff->deltas, i, delta) {
+		if (checkout_is_parallel_blob(actions[i], delta))
+			count++;
+	}
+
+	if (count < CHECKOUT_PARALLEL_THRESHOLD)
+		return 0;
+
+	if (!git_iterator_ignore_case(data->target)) {
+		*out = true;
+		return 0;
+	}
+
+	if ((error = git_pool_init(&pool, 1)) < 0)
+		return error;
+
+	if ((error = git_strmap_new(&paths)) < 0)
+		goto done;
+
+	*out = true;
+
+	git_vector_foreach(&data->diff->deltas, i, delta) {
+		if (!checkout_is_parallel_blob(actions[i], delta))
+			continue;
+
+		if ((path = git_pool_strdup(&pool, delta->new_file.path)) == NULL) {
+			error = -1;
+			goto done;
+		}
+
+		git__strtolower(path);
+
+		if (git_strmap_exists(paths, path)) {
+			*out = false;
+			break;
+		}
+
+		if ((error = git_strmap_set(paths, path, path)) < 0)
+			goto done;
+	}
+
+done:
+	git_strmap_free(paths);
+	git_pool_clear(&pool);
+	return error;
+}
+
+static int checkout_parallel_write(size_t idx, void *payload)
+{
+	checkout_parallel *parallel = payload;
+	checkout_data *data = parallel->data;
+	checkout_parallel_item *item = git_array_get(parallel->items, idx);
+	git_filter_options filter_opts = GIT_FILTER_OPTIONS_INIT;
+	git_blob *blob;
+	int error;
+
+	if (item->state != CHECKOUT_PARALLEL_WRITE)
+		return 0;
+
+	if ((error = git_blob_lookup(&blob, data->repo, &item->file->id)) < 0)
+		return error;
+
+	/* the attribute session and scratch buffer are not shared across
+	 * threads; each file loads its own filters
+	 */
+	error = blob_content_write(data, &filter_opts, &item->stat_calls,
+		&item->st, blob, item->path, NULL, item->file->mode);
+
+	git_blob_free(blob);
+
+	if ((data->strategy & GIT_CHECKOUT_ALLOW_CONFLICTS) != 0 &&
+		(error == GIT_ENOTFOUND || error == GIT_EEXISTS))
+	{
+		git_error_clear();
+		item->state = CHECKOUT_PARALLEL_SKIP;
+		error = 0;
+	}
+
+	return error;
+}
+
+GIT_INLINE(bool) checkout_is_attr_file(const char *path)
+{
+	size_t len = strlen(path), attr_len = strlen(GIT_ATTR_FILE);
+
+	return len >= attr_len &&
+		strcmp(path + len - attr_len, GIT_ATTR_FILE) == 0 &&
+		(len == attr_len || path[len - attr_len - 1] == '/');
+}
+
+static int checkout_parallel_prepare(
+	checkout_parallel *parallel,
 	unsigned int *actions,
 	checkout_data *data)
 {
-	int error = 0;
+	checkout_parallel_item *item;
 	git_diff_delta *delta;
+	git_buf *fullpath;
+	git_odb *odb;
 	size_t i;
+	int error;
+
+	/* make sure that the object database is loaded before the workers race to it */
+	if ((error = git_repository_odb__weakptr(&odb, data->repo)) < 0)
+		return error;
 
 	git_vector_foreach(&data->diff->deltas, i, delta) {
-		if (actions[i] & CHECKOUT_ACTION__UPDATE_BLOB && !S_ISLNK(delta->new_file.mode)) {
+		if (!checkout_is_parallel_blob(actions[i], delta))
+			continue;
+
+		item = git_array_alloc(parallel->items);
+		GIT_ERROR_CHECK_ALLOC(item);
+		memset(item, 0, sizeof(*item));
+
+		item->file = &delta->new_file;
+
+		if (checkout_target_fullpath(&fullpath, data, delta->new_file.path) < 0)
+			return -1;
+
+		if ((data->strategy & GIT_CHECKOUT_UPDATE_ONLY) != 0) {
+			int rval = checkout_safe_for_update_only(
+				data, fullpath->ptr, delta->new_file.mode);
+
+			if (rval < 0)
+				return rval;
+
+			if (rval == 0) {
+				item->state = CHECKOUT_PARALLEL_SKIP;
+				continue;
+			}
+		}
+
+		/* attributes files change how the other files are filtered, so
+		 * they are written before any of the others
+		 */
+		if (checkout_is_attr_file(delta->new_file.path)) {
 			if ((error = checkout_blob(data, &delta->new_file)) < 0)
 				return error;
-			data->completed_steps++;
-			report_progress(data, delta->new_file.path);
+
+			item->state = CHECKOUT_PARALLEL_WRITTEN;
+			continue;
+		}
+
+		/* directories are created (and blockers removed) up front, in order */
+		if ((error = mkpath2file(data, fullpath->ptr, data->opts.dir_mode)) < 0) {
+			if ((data->strategy & GIT_CHECKOUT_ALLOW_CONFLICTS) == 0 ||
+				(error != GIT_ENOTFOUND && error != GIT_EEXISTS))
+				return error;
+
+			git_error_clear();
+			item->state = CHECKOUT_PARALLEL_SKIP;
+			continue;
+		}
+
+		item->path = git_pool_strdup(&data->pool, fullpath->ptr);
+		GIT_ERROR_CHECK_ALLOC(item->path);
+	}
+
+	return 0;
+}
+
+static int checkout_create_the_new_parallel(
+	unsigned int *actions,
+	checkout_data *data)
+{
+	checkout_parallel parallel = { data, GIT_ARRAY_INIT };
+	checkout_parallel_item *item;
+	size_t i;
+	int error;
+
+	if ((error = checkout_parallel_prepare(&parallel, actions, data)) < 0 ||
+	    (error = git_parallel_foreach(git_array_size(parallel.items),
+			data->opts.workers, checkout_parallel_write, &parallel)) < 0)
+		goto done;
+
+	git_array_foreach(parallel.items, i, item) {
+		data->perfdata.stat_calls += item->stat_calls;
+
+		if (item->state == CHECKOUT_PARALLEL_WRITE) {
+			if ((data->strategy & GIT_CHECKOUT_DONT_UPDATE_INDEX) == 0 &&
+				(error = checkout_update_index(data, item->file, &item->st)) < 0)
+				goto done;
+
+			if (strcmp(item->file->path, ".gitmodules") == 0)
+				data->reload_submodules = true;
+		}
+
+		data->completed_steps++;
+		report_progress(data, item->file->path);
+	}
+
+done:
+	git_array_clear(parallel.items);
+	return error;
+}
+
+static int checkout_create_the_new(
+	unsigned int *actions,
+	checkout_data *data)
+{
+	int error = 0;
+	git_diff_delta *delta;
+	bool parallel;
+	size_t i;
+
+	if ((error = checkout_use_parallel(&parallel, actions, data)) < 0)
+		return error;
+
+	if (parallel) {
+		if ((error = checkout_create_the_new_parallel(actions, data)) < 0)
+			return error;
+	} else {
+		git_vector_foreach(&data->diff->deltas, i, delta) {
+			if (checkout_is_parallel_blob(actions[i], delta)) {
+				if ((error = checkout_blob(data, &delta->new_file)) < 0)
+					return error;
+				data->completed_steps++;
+				report_progress(data, delta->new_file.path);
+			}
 		}
 	}
 
@@ -0,0 +1,698 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "commit_bloom.h"
+
+#include "filebuf.h"
+#include "futils.h"
+#include "hash.h"
+#include "odb.h"
+#include "oidmap.h"
+#include "pool.h"
+#include "repository.h"
+#include "vector.h"
+#include "git2/commit.h"
+#include "git2/graph.h"
+#include "git2/tree.h"
+
+/*
+ * The file starts with a header, followed by a table of the commits
+ * that have filters, sorted by id, and then the filters themselves;
+ * it ends with the SHA-1 of everything before it.  All numbers are in
+ * network byte order.  A filter of length 0 is used for commits that
+ * change too many paths for a filter to be useful.
+ *
+ * The filters use the same parameters and hash functions as git's
+ * changed-path filters: seven hashes from two seeded murmur3 hashes
+ * of the path, and ten bits per changed path.
+ */
+#define BLOOM_SIGNATURE 0x43424c4d /* "CBLM" */
+#define BLOOM_VERSION 1
+#define BLOOM_NUM_HASHES 7
+#define BLOOM_BITS_PER_ENTRY 10
+#define BLOOM_MAX_CHANGES 512
+#define BLOOM_SEED0 0x293ae76f
+#define BLOOM_SEED1 0x7e646e2c
+
+struct bloom_header {
+	uint32_t signature;
+	uint32_t version;
+	uint32_t num_hashes;
+	uint32_t bits_per_entry;
+	uint32_t count;
+};
+
+struct bloom_entry {
+	unsigned char id[GIT_OID_RAWSZ];
+	uint32_t offset;
+	uint32_t length;
+};
+
+struct git_commit_bloom {
+	git_mutex lock;
+	git_futils_filestamp stamp;
+	git_buf data;
+
+	const struct bloom_entry *entries;
+	size_t count;
+	const unsigned char *filters;
+	size_t filters_len;
+};
+
+typedef struct {
+	uint32_t hashes[BLOOM_NUM_HASHES];
+} bloom_key;
+
+GIT_INLINE(uint32_t) rotl32(uint32_t x, int r)
+{
+	return (x << r) | (x >> (32 - r));
+}
+
+static uint32_t murmur3_seeded(uint32_t seed, const char *data, size_t len)
+{
+	const uint32_t c1 = 0xcc9e2d51, c2 = 0x1b873593;
+	const unsigned char *bytes = (const unsigned char *)data, *tail;
+	uint32_t h = seed, k;
+	size_t i, nblocks = len / 4;
+
+	for (i = 0; i < nblocks; i++) {
+		const unsigned char *b = bytes + i * 4;
+
+		k = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+		k *= c1;
+		k = rotl32(k, 15);
+		k *= c2;
+
+		h ^= k;
+		h = rotl32(h, 13);
+		h = h * 5 + 0xe6546b64;
+	}
+
+	tail = bytes + nblocks * 4;
+	k = 0;
+
+	switch (len & 3) {
+	case 3:
+		k ^= tail[2] << 16;
+		/* fall through */
+	case 2:
+		k ^= tail[1] << 8;
+		/* fall through */
+	case 1:
+		k ^= tail[0];
+		k *= c1;
+		k = rotl32(k, 15);
+		k *= c2;
+		h ^= k;
+	}
+
+	h ^= (uint32_t)len;
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+
+	return h;
+}
+
+static void bloom_key_init(bloom_key *key, const char *path, size_t len)
+{
+	uint32_t h0 = murmur3_seeded(BLOOM_SEED0, path, len);
+	uint32_t h1 = murmur3_seeded(BLOOM_SEED1, path, len);
+	int i;
+
+	for (i = 0; i < BLOOM_NUM_HASHES; i++)
+		key->hashes[i] = h0 + i * h1;
+}
+
+static void bloom_filter_add(
+	unsigned char *filter, size_t len, const bloom_key *key)
+{
+	size_t pos;
+	int i;
+
+	for (i = 0; i < BLOOM_NUM_HASHES; i++) {
+		pos = key->hashes[i] % (len * 8);
+		filter[pos / 8] |= (1 << (pos % 8));
+	}
+}
+
+static bool bloom_filter_contains(
+	const unsigned char *filter, size_t len, const bloom_key *key)
+{
+	size_t pos;
+	int i;
+
+	for (i = 0; i < BLOOM_NUM_HASHES; i++) {
+		pos = key->hashes[i] % (len * 8);
+
+		if (!(filter[pos / 8] & (1 << (pos % 8))))
+			return false;
+	}
+
+	return true;
+}
+
+static void commit_bloom_clear(git_commit_bloom *bloom)
+{
+	git_buf_dispose(&bloom->data);
+	bloom->entries = NULL;
+	bloom->count = 0;
+	bloom->filters = NULL;
+	bloom->filters_len = 0;
+}
+
+void git_commit_bloom_free(git_commit_bloom *bloom)
+{
+	if (!bloom)
+		return;
+
+	commit_bloom_clear(bloom);
+	git_mutex_free(&bloom->lock);
+	git__free(bloom);
+}
+
+static int commit_bloom_get(git_commit_bloom **out, git_repository *repo)
+{
+	git_commit_bloom *bloom;
+
+	if ((*out = repo->bloom) != NULL)
+		return 0;
+
+	bloom = git__calloc(1, sizeof(git_commit_bloom));
+	GIT_ERROR_CHECK_ALLOC(bloom);
+
+	if (git_mutex_init(&bloom->lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to initialize commit bloom filters");
+		git__free(bloom);
+		return -1;
+	}
+
+	*out = git__compare_and_swap(&repo->bloom, NULL, bloom);
+
+	if (*out != NULL)
+		git_commit_bloom_free(bloom);
+	else
+		*out = bloom;
+
+	return 0;
+}
+
+static int commit_bloom_parse(git_commit_bloom *bloom)
+{
+	const struct bloom_header *header;
+	const struct bloom_entry *entry;
+	git_oid checksum;
+	size_t table_len, i;
+
+	if (bloom->data.size < sizeof(struct bloom_header) + GIT_OID_RAWSZ)
+		goto corrupt;
+
+	header = (const struct bloom_header *)bloom->data.ptr;
+
+	if (ntohl(header->signature) != BLOOM_SIGNATURE ||
+	    ntohl(header->version) != BLOOM_VERSION ||
+	    ntohl(header->num_hashes) != BLOOM_NUM_HASHES ||
+	    ntohl(header->bits_per_entry) != BLOOM_BITS_PER_ENTRY)
+		goto corrupt;
+
+	bloom->count = ntohl(header->count);
+
+	if (GIT_MULTIPLY_SIZET_OVERFLOW(&table_len,
+			bloom->count, sizeof(struct bloom_entry)) ||
+	    table_len > bloom->data.size - sizeof(struct bloom_header) - GIT_OID_RAWSZ)
+		goto corrupt;
+
+	if (git_hash_buf(&checksum, bloom->data.ptr,
+			bloom->data.size - GIT_OID_RAWSZ) < 0)
+		return -1;
+
+	if (memcmp(checksum.id, bloom->data.ptr + bloom->data.size - GIT_OID_RAWSZ,
+			GIT_OID_RAWSZ) != 0)
+		goto corrupt;
+
+	bloom->entries = (const struct bloom_entry *)(header + 1);
+	bloom->filters = (const unsigned char *)(bloom->entries + bloom->count);
+	bloom->filters_len = bloom->data.size - sizeof(struct bloom_header) -
+		table_len - GIT_OID_RAWSZ;
+
+	for (i = 0; i < bloom->count; i++) {
+		entry = &bloom->entries[i];
+
+		if (ntohl(entry->offset) > bloom->filters_len ||
+		    ntohl(entry->length) > bloom->filters_len - ntohl(entry->offset))
+			goto corrupt;
+	}
+
+	return 0;
+
+corrupt:
+	git_error_set(GIT_ERROR_ODB, "invalid commit bloom filter file");
+	return -1;
+}
+
+int git_commit_bloom_refresh(git_repository *repo)
+{
+	git_commit_bloom *bloom;
+	git_buf path = GIT_BUF_INIT;
+	int changed, error;
+
+	if ((error = commit_bloom_get(&bloom, repo)) < 0 ||
+	    (error = git_repository_item_path(&path, repo, GIT_REPOSITORY_ITEM_OBJECTS)) < 0 ||
+	    (error = git_buf_joinpath(&path, path.ptr, GIT_COMMIT_BLOOM_FILE)) < 0)
+		goto done;
+
+	if (git_mutex_lock(&bloom->lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to lock commit bloom filters");
+		error = -1;
+		goto done;
+	}
+
+	if ((changed = git_futils_filestamp_check(&bloom->stamp, path.ptr)) == 0)
+		goto unlock;
+
+	commit_bloom_clear(bloom);
+
+	if (changed == GIT_ENOTFOUND)
+		goto unlock;
+
+	if ((error = git_futils_readbuffer(&bloom->data, path.ptr)) < 0 ||
+	    (error = commit_bloom_parse(bloom)) < 0) {
+		commit_bloom_clear(bloom);
+		git_futils_filestamp_set(&bloom->stamp, NULL);
+	}
+
+unlock:
+	git_mutex_unlock(&bloom->lock);
+done:
+	git_buf_dispose(&path);
+	return error;
+}
+
+static const struct bloom_entry *commit_bloom_find(
+	const git_commit_bloom *bloom, const git_oid *id)
+{
+	size_t lo = 0, hi = bloom->count, mid;
+	int cmp;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = memcmp(id->id, bloom->entries[mid].id, GIT_OID_RAWSZ);
+
+		if (!cmp)
+			return &bloom->entries[mid];
+		else if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return NULL;
+}
+
+int git_commit_bloom_maybe_changed(
+	git_repository *repo, const git_oid *commit_id, const char *path)
+{
+	git_commit_bloom *bloom = repo->bloom;
+	const struct bloom_entry *entry;
+	bloom_key key;
+	uint32_t length;
+	int error = GIT_ENOTFOUND;
+
+	if (!bloom)
+		return GIT_ENOTFOUND;
+
+	bloom_key_init(&key, path, strlen(path));
+
+	if (git_mutex_lock(&bloom->lock) < 0)
+		return GIT_ENOTFOUND;
+
+	if ((entry = commit_bloom_find(bloom, commit_id)) != NULL) {
+		length = ntohl(entry->length);
+
+		error = !length || bloom_filter_contains(
+			bloom->filters + ntohl(entry->offset), length, &key);
+	}
+
+	git_mutex_unlock(&bloom->lock);
+	return error;
+}
+
+/* Building and writing the filters */
+
+typedef struct {
+	git_repository *repo;
+	git_buf path;
+	git_vector paths;
+	git_pool pool;
+	bool too_many;
+} bloom_changes;
+
+typedef struct {
+	git_oid id;
+	const unsigned char *filter;
+	uint32_t length;
+} bloom_record;
+
+static int bloom_changes_add(bloom_changes *changes)
+{
+	char *path;
+
+	if (changes->paths.length >= BLOOM_MAX_CHANGES) {
+		changes->too_many = true;
+		return 0;
+	}
+
+	if ((path = git_pool_strndup(&changes->pool,
+			changes->path.ptr, changes->path.size)) == NULL ||
+	    git_vector_insert(&changes->paths, path) < 0)
+		return -1;
+
+	return 0;
+}
+
+static int bloom_changes_descend(
+	bloom_changes *changes,
+	const git_tree_entry *old_entry,
+	const git_tree_entry *new_entry);
+
+/*
+ * Collect the paths that differ between two trees (either of which may
+ * be missing), descending only into the subtrees whose ids differ.
+ */
+static int bloom_changes_diff(
+	bloom_changes *changes, const git_oid *old_id, const git_oid *new_id)
+{
+	git_tree *old_tree = NULL, *new_tree = NULL;
+	const git_tree_entry *old_entry, *new_entry;
+	size_t i;
+	int error = 0;
+
+	if ((old_id && (error = git_tree_lookup(&old_tree, changes->repo, old_id)) < 0) ||
+	    (new_id && (error = git_tree_lookup(&new_tree, changes->repo, new_id)) < 0))
+		goto done;
+
+	for (i = 0; new_tree && i < git_tree_entrycount(new_tree); i++) {
+		new_entry = git_tree_entry_byindex(new_tree, i);
+		old_entry = old_tree ?
+			git_tree_entry_byname(old_tree, git_tree_entry_name(new_entry)) : NULL;
+
+		if (old_entry &&
+		    git_tree_entry_filemode_raw(old_entry) == git_tree_entry_filemode_raw(new_entry) &&
+		    git_oid_equal(git_tree_entry_id(old_entry), git_tree_entry_id(new_entry)))
+			continue;
+
+		if ((error = bloom_changes_descend(changes, old_entry, new_entry)) < 0)
+			goto done;
+	}
+
+	for (i = 0; old_tree && i < git_tree_entrycount(old_tree); i++) {
+		old_entry = git_tree_entry_byindex(old_tree, i);
+
+		if (new_tree &&
+		    git_tree_entry_byname(new_tree, git_tree_entry_name(old_entry)) != NULL)
+			continue;
+
+		if ((error = bloom_changes_descend(changes, old_entry, NULL)) < 0)
+			goto done;
+	}
+
+done:
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+	return error;
+}
+
+static int bloom_changes_descend(
+	bloom_changes *changes,
+	const git_tree_entry *old_entry,
+	const git_tree_entry *new_entry)
+{
+	const git_tree_entry *entry = new_entry ? new_entry : old_entry;
+	const git_oid *old_tree = NULL, *new_tree = NULL;
+	size_t path_len = changes->path.size;
+	int error;
+
+	if (changes->too_many)
+		return 0;
+
+	if (path_len)
+		git_buf_putc(&changes->path, '/');
+
+	git_buf_puts(&changes->path, git_tree_entry_name(entry));
+
+	if (git_buf_oom(&changes->path) ||
+	    (error = bloom_changes_add(changes)) < 0)
+		return -1;
+
+	if (old_entry && git_tree_entry_type(old_entry) == GIT_OBJECT_TREE)
+		old_tree = git_tree_entry_id(old_entry);
+	if (new_entry && git_tree_entry_type(new_entry) == GIT_OBJECT_TREE)
+		new_tree = git_tree_entry_id(new_entry);
+
+	if ((old_tree || new_tree) &&
+	    (error = bloom_changes_diff(changes, old_tree, new_tree)) < 0)
+		return error;
+
+	git_buf_truncate(&changes->path, path_len);
+	return 0;
+}
+
+static int bloom_filter_compute(
+	bloom_record *record, bloom_changes *changes, git_commit *commit)
+{
+	const git_oid *parent_tree = NULL;
+	git_commit *parent = NULL;
+	unsigned char *filter;
+	bloom_key key;
+	const char *path;
+	size_t i, length;
+	int error;
+
+	git_buf_clear(&changes->path);
+	git_vector_clear(&changes->paths);
+	changes->too_many = false;
+
+	if (git_commit_parentcount(commit) > 0) {
+		if ((error = git_commit_parent(&parent, commit, 0)) < 0)
+			return error;
+
+		parent_tree = git_commit_tree_id(parent);
+	}
+
+	error = bloom_changes_diff(changes, parent_tree, git_commit_tree_id(commit));
+	git_commit_free(parent);
+
+	if (error < 0)
+		return error;
+
+	git_oid_cpy(&record->id, git_commit_id(commit));
+
+	if (changes->too_many) {
+		record->length = 0;
+		return 0;
+	}
+
+	length = (changes->paths.length * BLOOM_BITS_PER_ENTRY + 7) / 8;
+	length = max(length, 1);
+
+	filter = git_pool_mallocz(&changes->pool, length);
+	GIT_ERROR_CHECK_ALLOC(filter);
+
+	git_vector_foreach(&changes->paths, i, path) {
+		bloom_key_init(&key, path, strlen(path));
+		bloom_filter_add(filter, length, &key);
+	}
+
+	record->filter = filter;
+	record->length = (uint32_t)length;
+	return 0;
+}
+
+static int bloom_record_cmp(const void *a, const void *b)
+{
+	const bloom_record *one = a, *two = b;
+	return git_oid_cmp(&one->id, &two->id);
+}
+
+static int commit_bloom_write(git_repository *repo, git_vector *records)
+{
+	git_filebuf file = GIT_FILEBUF_INIT;
+	git_buf path = GIT_BUF_INIT;
+	struct bloom_header header;
+	struct bloom_entry entry;
+	bloom_record *record;
+	git_oid checksum;
+	size_t i, offset = 0;
+	int error;
+
+	git_vector_sort(records);
+
+	if ((error = git_repository_item_path(&path, repo, GIT_REPOSITORY_ITEM_OBJECTS)) < 0 ||
+	    (error = git_buf_joinpath(&path, path.ptr, GIT_COMMIT_BLOOM_FILE)) < 0 ||
+	    (error = git_filebuf_open(&file, path.ptr,
+			GIT_FILEBUF_HASH_CONTENTS | GIT_FILEBUF_CREATE_LEADING_DIRS,
+			GIT_OBJECT_FILE_MODE)) < 0)
+		goto done;
+
+	header.signature = htonl(BLOOM_SIGNATURE);
+	header.version = htonl(BLOOM_VERSION);
+	header.num_hashes = htonl(BLOOM_NUM_HASHES);
+	header.bits_per_entry = htonl(BLOOM_BITS_PER_ENTRY);
+	header.count = htonl((uint32_t)records->length);
+
+	if ((error = git_filebuf_write(&file, &header, sizeof(header))) < 0)
+		goto done;
+
+	git_vector_foreach(records, i, record) {
+		memcpy(entry.id, record->id.id, GIT_OID_RAWSZ);
+		entry.offset = htonl((uint32_t)offset);
+		entry.length = htonl(record->length);
+
+		if ((error = git_filebuf_write(&file, &entry, sizeof(entry))) < 0)
+			goto done;
+
+		offset += record->length;
+	}
+
+	git_vector_foreach(records, i, record) {
+		if (record->length &&
+		    (error = git_filebuf_write(&file, record->filter, record->length)) < 0)
+			goto done;
+	}
+
+	if ((error = git_filebuf_hash(&checksum, &file)) < 0 ||
+	    (error = git_filebuf_write(&file, checksum.id, GIT_OID_RAWSZ)) < 0)
+		goto done;
+
+	error = git_filebuf_commit(&file);
+
+done:
+	git_filebuf_cleanup(&file);
+	git_buf_dispose(&path);
+	return error;
+}
+
+/*
+ * Filters are written for the whole history of the given tips, so a
+ * commit that already has a filter has one for all of its ancestors,
+ * too; the walk does not need to go past it.
+ */
+int git_graph_bloom_update(
+	git_repository *repo, const git_oid *tips, size_t tips_len)
+{
+	git_commit_bloom *bloom, existing;
+	bloom_changes changes = {0};
+	git_array_t(git_oid) stack = GIT_ARRAY_INIT;
+	git_vector records = GIT_VECTOR_INIT;
+	git_oidmap *seen = NULL;
+	git_commit *commit = NULL;
+	bloom_record *record;
+	git_oid *id, *key;
+	size_t i, added = 0;
+	unsigned int p;
+	int error;
+
+	assert(repo && (tips || !tips_len));
+
+	memset(&existing, 0, sizeof(existing));
+
+	if ((error = git_commit_bloom_refresh(repo)) < 0 ||
+	    (error = commit_bloom_get(&bloom, repo)) < 0)
+		return error;
+
+	changes.repo = repo;
+
+	if ((error = git_pool_init(&changes.pool, 1)) < 0 ||
+	    (error = git_vector_init(&changes.paths, 0, NULL)) < 0 ||
+	    (error = git_vector_init(&records, 0, bloom_record_cmp)) < 0 ||
+	    (error = git_oidmap_new(&seen)) < 0)
+		goto done;
+
+	/* work from a copy, in case the filters are reloaded meanwhile */
+	if (git_mutex_lock(&bloom->lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to lock commit bloom filters");
+		error = -1;
+		goto done;
+	}
+
+	error = git_buf_set(&existing.data, bloom->data.ptr, bloom->data.size);
+	git_mutex_unlock(&bloom->lock);
+
+	if (error < 0 || (existing.data.size && (error = commit_bloom_parse(&existing)) < 0))
+		goto done;
+
+	for (i = 0; i < existing.count; i++) {
+		record = git_pool_mallocz(&changes.pool, sizeof(bloom_record));
+		GIT_ERROR_CHECK_ALLOC(record);
+
+		git_oid_fromraw(&record->id, existing.entries[i].id);
+		record->filter = existing.filters + ntohl(existing.entries[i].offset);
+		record->length = ntohl(existing.entries[i].length);
+
+		if ((error = git_vector_insert(&records, record)) < 0)
+			goto done;
+	}
+
+	for (i = 0; i < tips_len; i++) {
+		id = git_array_alloc(stack);
+		GIT_ERROR_CHECK_ALLOC(id);
+		git_oid_cpy(id, &tips[i]);
+	}
+
+	while ((id = git_array_pop(stack)) != NULL) {
+		if (git_oidmap_exists(seen, id) || commit_bloom_find(&existing, id))
+			continue;
+
+		if ((error = git_commit_lookup(&commit, repo, id)) < 0)
+			goto done;
+
+		if ((key = git_pool_malloc(&changes.pool, sizeof(git_oid))) == NULL ||
+		    (record = git_pool_mallocz(&changes.pool, sizeof(bloom_record))) == NULL) {
+			error = -1;
+			goto done;
+		}
+
+		git_oid_cpy(key, git_commit_id(commit));
+
+		if ((error = git_oidmap_set(seen, key, key)) < 0 ||
+		    (error = bloom_filter_compute(record, &changes, commit)) < 0 ||
+		    (error = git_vector_insert(&records, record)) < 0)
+			goto done;
+
+		added++;
+
+		for (p = 0; p < git_commit_parentcount(commit); p++) {
+			if ((id = git_array_alloc(stack)) == NULL) {
+				error = -1;
+				goto done;
+			}
+
+			git_oid_cpy(id, git_commit_parent_id(commit, p));
+		}
+
+		git_commit_free(commit);
+		commit = NULL;
+	}
+
+	if (added &&
+	    ((error = commit_bloom_write(repo, &records)) < 0 ||
+	     (error = git_commit_bloom_refresh(repo)) < 0))
+		goto done;
+
+done:
+	git_commit_free(commit);
+	git_oidmap_free(seen);
+	git_vector_free(&records);
+	git_vector_free(&changes.paths);
+	git_buf_dispose(&changes.path);
+	git_pool_clear(&changes.pool);
+	git_array_clear(stack);
+	commit_bloom_clear(&existing);
+	return error;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_commit_bloom_h__
+#define INCLUDE_commit_bloom_h__
+
+#include "common.h"
+
+#include "git2/oid.h"
+
+/*
+ * Changed-path Bloom filters: for each commit, a Bloom filter of the
+ * paths (and the leading directories of the paths) that differ between
+ * the commit and its first parent, stored in `objects/info/commit-bloom`.
+ */
+#define GIT_COMMIT_BLOOM_FILE "info/commit-bloom"
+
+typedef struct git_commit_bloom git_commit_bloom;
+
+void git_commit_bloom_free(git_commit_bloom *bloom);
+
+/*
+ * Load the filters of a repository, or reload them when the file has
+ * changed on disk since they were last loaded.  A repository without
+ * filters is not an error.
+ */
+int git_commit_bloom_refresh(git_repository *repo);
+
+/*
+ * Check whether a commit may have changed a path relative to its first
+ * parent.  Returns 0 if it definitely did not, 1 if it may have, or
+ * GIT_ENOTFOUND when there is no filter for the commit (without setting
+ * an error message).  The filters are only consulted after they have
+ * been loaded by `git_commit_bloom_refresh`.
+ */
+int git_commit_bloom_maybe_changed(
+	git_repository *repo, const git_oid *commit_id, const char *path);
+
+#endif
@@ -0,0 +1,414 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "commit_generations.h"
+
+#include "commit_list.h"
+#include "filebuf.h"
+#include "futils.h"
+#include "hash.h"
+#include "odb.h"
+#include "repository.h"
+#include "revwalk.h"
+#include "vector.h"
+#include "git2/graph.h"
+
+/*
+ * The file starts with a header, followed by a table of commits and
+ * their generations, sorted by id; it ends with the SHA-1 of everything
+ * before it.  All numbers are in network byte order.
+ */
+#define GENERATIONS_SIGNATURE 0x4347454e /* "CGEN" */
+#define GENERATIONS_VERSION 1
+
+struct generations_header {
+	uint32_t signature;
+	uint32_t version;
+	uint32_t count;
+};
+
+struct generations_entry {
+	unsigned char id[GIT_OID_RAWSZ];
+	uint32_t generation;
+};
+
+struct git_commit_generations {
+	git_mutex lock;
+	git_futils_filestamp stamp;
+	git_buf data;
+
+	const struct generations_entry *entries;
+	size_t count;
+};
+
+static void commit_generations_clear(git_commit_generations *generations)
+{
+	git_buf_dispose(&generations->data);
+	generations->entries = NULL;
+	generations->count = 0;
+}
+
+void git_commit_generations_free(git_commit_generations *generations)
+{
+	if (!generations)
+		return;
+
+	commit_generations_clear(generations);
+	git_mutex_free(&generations->lock);
+	git__free(generations);
+}
+
+static int commit_generations_get(
+	git_commit_generations **out, git_repository *repo)
+{
+	git_commit_generations *generations;
+
+	if ((*out = repo->generations) != NULL)
+		return 0;
+
+	generations = git__calloc(1, sizeof(git_commit_generations));
+	GIT_ERROR_CHECK_ALLOC(generations);
+
+	if (git_mutex_init(&generations->lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to initialize generation numbers");
+		git__free(generations);
+		return -1;
+	}
+
+	*out = git__compare_and_swap(&repo->generations, NULL, generations);
+
+	if (*out != NULL)
+		git_commit_generations_free(generations);
+	else
+		*out = generations;
+
+	return 0;
+}
+
+static int commit_generations_parse(git_commit_generations *generations)
+{
+	const struct generations_header *header;
+	git_oid checksum;
+	size_t table_len;
+
+	if (generations->data.size < sizeof(struct generations_header) + GIT_OID_RAWSZ)
+		goto corrupt;
+
+	header = (const struct generations_header *)generations->data.ptr;
+
+	if (ntohl(header->signature) != GENERATIONS_SIGNATURE ||
+	    ntohl(header->version) != GENERATIONS_VERSION)
+		goto corrupt;
+
+	generations->count = ntohl(header->count);
+
+	if (GIT_MULTIPLY_SIZET_OVERFLOW(&table_len,
+			generations->count, sizeof(struct generations_entry)) ||
+	    table_len != generations->data.size -
+			sizeof(struct generations_header) - GIT_OID_RAWSZ)
+		goto corrupt;
+
+	if (git_hash_buf(&checksum, generations->data.ptr,
+			generations->data.size - GIT_OID_RAWSZ) < 0)
+		return -1;
+
+	if (memcmp(checksum.id, generations->data.ptr +
+			generations->data.size - GIT_OID_RAWSZ, GIT_OID_RAWSZ) != 0)
+		goto corrupt;
+
+	generations->entries = (const struct generations_entry *)(header + 1);
+	return 0;
+
+corrupt:
+	git_error_set(GIT_ERROR_ODB, "invalid commit generations file");
+	return -1;
+}
+
+int git_commit_generations_refresh(git_repository *repo)
+{
+	git_commit_generations *generations;
+	git_buf path = GIT_BUF_INIT;
+	int changed, error;
+
+	if ((error = commit_generations_get(&generations, repo)) < 0 ||
+	    (error = git_repository_item_path(&path, repo, GIT_REPOSITORY_ITEM_OBJECTS)) < 0 ||
+	    (error = git_buf_joinpath(&path, path.ptr, GIT_COMMIT_GENERATIONS_FILE)) < 0)
+		goto done;
+
+	if (git_mutex_lock(&generations->lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to lock generation numbers");
+		error = -1;
+		goto done;
+	}
+
+	if ((changed = git_futils_filestamp_check(&generations->stamp, path.ptr)) == 0)
+		goto unlock;
+
+	commit_generations_clear(generations);
+
+	if (changed == GIT_ENOTFOUND)
+		goto unlock;
+
+	if ((error = git_futils_readbuffer(&generations->data, path.ptr)) < 0 ||
+	    (error = commit_generations_parse(generations)) < 0) {
+		commit_generations_clear(generations);
+		git_futils_filestamp_set(&generations->stamp, NULL);
+	}
+
+unlock:
+	git_mutex_unlock(&generations->lock);
+done:
+	git_buf_dispose(&path);
+	return error;
+}
+
+static uint32_t commit_generations_find(
+	const git_commit_generations *generations, const git_oid *id)
+{
+	size_t lo = 0, hi = generations->count, mid;
+	int cmp;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = memcmp(id->id, generations->entries[mid].id, GIT_OID_RAWSZ);
+
+		if (!cmp)
+			return ntohl(generations->entries[mid].generation);
+		else if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return 0;
+}
+
+uint32_t git_commit_generations_lookup(
+	git_repository *repo, const git_oid *commit_id)
+{
+	git_commit_generations *generations = repo->generations;
+	uint32_t generation;
+
+	if (!generations)
+		return 0;
+
+	if (git_mutex_lock(&generations->lock) < 0)
+		return 0;
+
+	generation = commit_generations_find(generations, commit_id);
+
+	git_mutex_unlock(&generations->lock);
+	return generation;
+}
+
+/* Computing and writing the generation numbers */
+
+typedef struct {
+	git_oid id;
+	uint32_t generation;
+} generations_record;
+
+static int generations_record_cmp(const void *a, const void *b)
+{
+	const generations_record *one = a, *two = b;
+	return git_oid_cmp(&one->id, &two->id);
+}
+
+static int commit_generations_write(git_repository *repo, git_vector *records)
+{
+	git_filebuf file = GIT_FILEBUF_INIT;
+	git_buf path = GIT_BUF_INIT;
+	struct generations_header header;
+	struct generations_entry entry;
+	generations_record *record;
+	git_oid checksum;
+	size_t i;
+	int error;
+
+	git_vector_sort(records);
+
+	if ((error = git_repository_item_path(&path, repo, GIT_REPOSITORY_ITEM_OBJECTS)) < 0 ||
+	    (error = git_buf_joinpath(&path, path.ptr, GIT_COMMIT_GENERATIONS_FILE)) < 0 ||
+	    (error = git_filebuf_open(&file, path.ptr,
+			GIT_FILEBUF_HASH_CONTENTS | GIT_FILEBUF_CREATE_LEADING_DIRS,
+			GIT_OBJECT_FILE_MODE)) < 0)
+		goto done;
+
+	header.signature = htonl(GENERATIONS_SIGNATURE);
+	header.version = htonl(GENERATIONS_VERSION);
+	header.count = htonl((uint32_t)records->length);
+
+	if ((error = git_filebuf_write(&file, &header, sizeof(header))) < 0)
+		goto done;
+
+	git_vector_foreach(records, i, record) {
+		memcpy(entry.id, record->id.id, GIT_OID_RAWSZ);
+		entry.generation = htonl(record->generation);
+
+		if ((error = git_filebuf_write(&file, &entry, sizeof(entry))) < 0)
+			goto done;
+	}
+
+	if ((error = git_filebuf_hash(&checksum, &file)) < 0 ||
+	    (error = git_filebuf_write(&file, checksum.id, GIT_OID_RAWSZ)) < 0)
+		goto done;
+
+	error = git_filebuf_commit(&file);
+
+done:
+	git_filebuf_cleanup(&file);
+	git_buf_dispose(&path);
+	return error;
+}
+
+static int generations_record_add(
+	git_vector *records, git_pool *pool,
+	const git_oid *id, uint32_t generation)
+{
+	generations_record *record;
+
+	record = git_pool_malloc(pool, sizeof(generations_record));
+	GIT_ERROR_CHECK_ALLOC(record);
+
+	git_oid_cpy(&record->id, id);
+	record->generation = generation;
+
+	return git_vector_insert(records, record);
+}
+
+/*
+ * Generation numbers are computed for the whole history of the given
+ * tips, so the walk stops at the commits whose generation is already
+ * stored: all of their ancestors have one, too.
+ */
+int git_graph_generations_update(
+	git_repository *repo, const git_oid *tips, size_t tips_len)
+{
+	git_commit_generations *generations, existing;
+	git_revwalk *walk = NULL;
+	git_commit_list_node *node, *parent;
+	git_vector stack = GIT_VECTOR_INIT, records = GIT_VECTOR_INIT;
+	git_pool pool = GIT_POOL_INIT;
+	uint32_t max;
+	size_t i, added = 0;
+	bool pending;
+	int error;
+
+	assert(repo && (tips || !tips_len));
+
+	memset(&existing, 0, sizeof(existing));
+
+	/* the generations of a shallow history would be too low */
+	if (git_repository_is_shallow(repo) == 1) {
+		git_error_set(GIT_ERROR_INVALID,
+			"cannot compute generation numbers in a shallow repository");
+		return -1;
+	}
+
+	if ((error = git_commit_generations_refresh(repo)) < 0 ||
+	    (error = commit_generations_get(&generations, repo)) < 0)
+		return error;
+
+	if ((error = git_pool_init(&pool, 1)) < 0 ||
+	    (error = git_vector_init(&records, 0, generations_record_cmp)) < 0 ||
+	    (error = git_revwalk_new(&walk, repo)) < 0)
+		goto done;
+
+	/* work from a copy, in case the generations are reloaded meanwhile */
+	if (git_mutex_lock(&generations->lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to lock generation numbers");
+		error = -1;
+		goto done;
+	}
+
+	error = git_buf_set(&existing.data, generations->data.ptr, generations->data.size);
+	git_mutex_unlock(&generations->lock);
+
+	if (error < 0 || (existing.data.size &&
+			(error = commit_generations_parse(&existing)) < 0))
+		goto done;
+
+	for (i = 0; i < existing.count; i++) {
+		git_oid id;
+
+		git_oid_fromraw(&id, existing.entries[i].id);
+
+		if ((error = generations_record_add(&records, &pool, &id,
+				ntohl(existing.entries[i].generation))) < 0)
+			goto done;
+	}
+
+	for (i = 0; i < tips_len; i++) {
+		if ((node = git_revwalk__commit_lookup(walk, &tips[i])) == NULL) {
+			error = -1;
+			goto done;
+		}
+
+		if ((error = git_vector_insert(&stack, node)) < 0)
+			goto done;
+	}
+
+	/* depth-first, without recursing: a commit's generation is known
+	 * once the generations of all of its parents are
+	 */
+	while ((node = git_vector_last(&stack)) != NULL) {
+		if (!node->generation)
+			node->generation = commit_generations_find(&existing, &node->oid);
+
+		if (node->generation) {
+			git_vector_pop(&stack);
+			continue;
+		}
+
+		if ((error = git_commit_list_parse(walk, node)) < 0)
+			goto done;
+
+		max = 0;
+		pending = false;
+
+		for (i = 0; i < node->out_degree; i++) {
+			parent = node->parents[i];
+
+			if (!parent->generation)
+				parent->generation = commit_generations_find(&existing, &parent->oid);
+
+			if (!parent->generation) {
+				if ((error = git_vector_insert(&stack, parent)) < 0)
+					goto done;
+
+				pending = true;
+			} else if (parent->generation > max) {
+				max = parent->generation;
+			}
+		}
+
+		if (pending)
+			continue;
+
+		node->generation = (max < UINT32_MAX - 1) ? max + 1 : max;
+
+		if ((error = generations_record_add(&records, &pool,
+				&node->oid, node->generation)) < 0)
+			goto done;
+
+		added++;
+		git_vector_pop(&stack);
+	}
+
+	if (added &&
+	    ((error = commit_generations_write(repo, &records)) < 0 ||
+	     (error = git_commit_generations_refresh(repo)) < 0))
+		goto done;
+
+done:
+	git_revwalk_free(walk);
+	git_vector_free(&stack);
+	git_vector_free(&records);
+	git_pool_clear(&pool);
+	commit_generations_clear(&existing);
+	return error;
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_commit_generations_h__
+#define INCLUDE_commit_generations_h__
+
+#include "common.h"
+
+#include "git2/oid.h"
+
+/*
+ * Commit generation numbers: 1 for a root commit, and otherwise one
+ * more than the largest generation of its parents, stored for the
+ * commits of a repository in `objects/info/commit-generations` by
+ * `git_graph_generations_update`.
+ */
+#define GIT_COMMIT_GENERATIONS_FILE "info/commit-generations"
+
+typedef struct git_commit_generations git_commit_generations;
+
+void git_commit_generations_free(git_commit_generations *generations);
+
+/*
+ * Load the generation numbers of a repository, or reload them when the
+ * file has changed on disk since they were last loaded.  A repository
+ * without generation numbers is not an error.
+ */
+int git_commit_generations_refresh(git_repository *repo);
+
+/*
+ * Look up the stored generation number of a commit; returns 0 when it
+ * is not known.  The generation numbers are only consulted after they
+ * have been loaded by `git_commit_generations_refresh`.
+ */
+uint32_t git_commit_generations_lookup(
+	git_repository *repo, const git_oid *commit_id);
+
+#endif
@@ -11,6 +11,7 @@
 #include "pool.h"
 #include "odb.h"
 #include "commit.h"
+#include "commit_generations.h"
 
 int git_commit_list_time_cmp(const void *a, const void *b)
 {
@@ -25,6 +26,103 @@ int git_commit_list_time_cmp(const void *a, const void *b)
 	return 0;
 }
 
+int git_commit_list_generation_cmp(const void *a, const void *b)
+{
+	uint32_t gen_a = ((git_commit_list_node *) a)->generation;
+	uint32_t gen_b = ((git_commit_list_node *) b)->generation;
+
+	if (gen_a < gen_b)
+		return 1;
+	if (gen_a > gen_b)
+		return -1;
+
+	return git_commit_list_time_cmp(a, b);
+}
+
+#define COMMIT_QUEUE_ARITY 4
+
+void git_commit_queue_init(git_commit_queue *queue, bool use_generations)
+{
+	git_array_init(queue->heap);
+	queue->use_generations = use_generations;
+}
+
+void git_commit_queue_free(git_commit_queue *queue)
+{
+	git_array_clear(queue->heap);
+}
+
+GIT_INLINE(bool) commit_queue_before(
+	const git_commit_queue_entry *a, const git_commit_queue_entry *b)
+{
+	if (a->generation != b->generation)
+		return a->generation > b->generation;
+
+	return a->time > b->time;
+}
+
+int git_commit_queue_insert(git_commit_queue *queue, git_commit_list_node *commit)
+{
+	git_commit_queue_entry entry, *heap;
+	size_t pos, parent;
+
+	if (git_array_alloc(queue->heap) == NULL)
+		return -1;
+
+	entry.generation = queue->use_generations ? commit->generation : 0;
+	entry.time = commit->time;
+	entry.commit = commit;
+
+	heap = queue->heap.ptr;
+	pos = queue->heap.size - 1;
+
+	while (pos > 0) {
+		parent = (pos - 1) / COMMIT_QUEUE_ARITY;
+
+		if (!commit_queue_before(&entry, &heap[parent]))
+			break;
+
+		heap[pos] = heap[parent];
+		pos = parent;
+	}
+
+	heap[pos] = entry;
+	return 0;
+}
+
+git_commit_list_node *git_commit_queue_pop(git_commit_queue *queue)
+{
+	git_commit_queue_entry *heap = queue->heap.ptr, last;
+	git_commit_list_node *top;
+	size_t size, pos = 0, child, best, end;
+
+	if (!queue->heap.size)
+		return NULL;
+
+	top = heap[0].commit;
+	size = --queue->heap.size;
+	last = heap[size];
+
+	while ((child = pos * COMMIT_QUEUE_ARITY + 1) < size) {
+		end = min(child + COMMIT_QUEUE_ARITY, size);
+
+		for (best = child++; child < end; child++)
+			if (commit_queue_before(&heap[child], &heap[best]))
+				best = child;
+
+		if (!commit_queue_before(&heap[best], &last))
+			break;
+
+		heap[pos] = heap[best];
+		pos = best;
+	}
+
+	if (size)
+		heap[pos] = last;
+
+	return top;
+}
+
 git_commit_list *git_commit_list_insert(git_commit_list_node *item, git_commit_list **list_p)
 {
 	git_commit_list *new_list = git__malloc(sizeof(git_commit_list));
@@ -59,15 +157,10 @@ git_commit_list_node *git_commit_list_alloc_node(git_revwalk *walk)
 static git_commit_list_node **alloc_parents(
 	git_revwalk *walk, git_commit_list_node *commit, size_t n_parents)
 {
-	size_t bytes;
-
 	if (n_parents <= PARENTS_PER_COMMIT)
 		return (git_commit_list_node **)((char *)commit + sizeof(git_commit_list_node));
 
-	if (git__multiply_sizet_overflow(&bytes, n_parents, sizeof(git_commit_list_node *)))
-		return NULL;
-
-	return (git_commit_list_node **)git_pool_malloc(&walk->commit_pool, bytes);
+	return (git_commit_list_node **)git_pool_malloc(&walk->parents_pool, n_parents);
 }
 
 
@@ -161,3 +254,24 @@ int git_commit_list_parse(git_revwalk *walk, git_commit_list_node *commit)
 	return error;
 }
 
+
+int git_commit_list_generation(
+	uint32_t *out, git_revwalk *walk, git_commit_list_node *commit)
+{
+	int error;
+
+	if ((*out = commit->generation) != 0)
+		return 0;
+
+	/* load the stored generations once per walk */
+	if (!walk->generations_loaded) {
+		if ((error = git_commit_generations_refresh(walk->repo)) < 0)
+			return error;
+
+		walk->generations_loaded = 1;
+	}
+
+	commit->generation = git_commit_generations_lookup(walk->repo, &commit->oid);
+	*out = commit->generation;
+	return 0;
+}
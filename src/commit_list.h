@@ -10,6 +10,7 @@
 #include "common.h"
 
 #include "git2/oid.h"
+#include "array.h"
 
 #define PARENT1  (1 << 0)
 #define PARENT2  (1 << 1)
@@ -17,20 +18,30 @@
 #define STALE    (1 << 3)
 #define ALL_FLAGS (PARENT1 | PARENT2 | STALE | RESULT)
 
-#define PARENTS_PER_COMMIT	2
+/*
+ * Every node has room for one parent right after it, which is all that
+ * most commits need; the parents of merges are allocated separately.
+ */
+#define PARENTS_PER_COMMIT	1
 #define COMMIT_ALLOC \
 	(sizeof(git_commit_list_node) + PARENTS_PER_COMMIT * sizeof(git_commit_list_node *))
 
 #define FLAG_BITS 4
 
+/*
+ * A walk can hold millions of these, so the fields are ordered to
+ * avoid any padding.
+ */
 typedef struct git_commit_list_node {
 	git_oid oid;
+	uint32_t generation; /* 0 until known; see git_commit_list_generation */
 	int64_t time;
 	unsigned int seen:1,
 			 uninteresting:1,
 			 topo_delay:1,
 			 parsed:1,
 			 added:1,
+			 treesame:1,
 			 flags : FLAG_BITS;
 
 	uint16_t in_degree;
@@ -44,12 +55,58 @@ typedef struct git_commit_list {
 	struct git_commit_list *next;
 } git_commit_list;
 
+/*
+ * A priority queue of commits that pops the commit with the highest
+ * generation first, and the most recent one among equal generations;
+ * when generations are not used, it pops the most recent commit first.
+ *
+ * It is meant for the hot paths of walks: the keys are copied into the
+ * queue so that they can be compared inline, and it is a 4-ary heap,
+ * which is shallower than a binary one.  Since the keys are copied, a
+ * commit's time (and generation, if used) must be known when it is
+ * inserted.
+ */
+typedef struct {
+	uint32_t generation;
+	int64_t time;
+	git_commit_list_node *commit;
+} git_commit_queue_entry;
+
+typedef struct {
+	git_array_t(git_commit_queue_entry) heap;
+	bool use_generations;
+} git_commit_queue;
+
+void git_commit_queue_init(git_commit_queue *queue, bool use_generations);
+void git_commit_queue_free(git_commit_queue *queue);
+int git_commit_queue_insert(git_commit_queue *queue, git_commit_list_node *commit);
+git_commit_list_node *git_commit_queue_pop(git_commit_queue *queue);
+
+#define git_commit_queue_size(q) git_array_size((q)->heap)
+#define git_commit_queue_get(q, i) (git_array_get((q)->heap, (i))->commit)
+#define git_commit_queue_clear(q) ((q)->heap.size = 0)
+
 git_commit_list_node *git_commit_list_alloc_node(git_revwalk *walk);
 int git_commit_list_time_cmp(const void *a, const void *b);
+int git_commit_list_generation_cmp(const void *a, const void *b);
 void git_commit_list_free(git_commit_list **list_p);
 git_commit_list *git_commit_list_insert(git_commit_list_node *item, git_commit_list **list_p);
 git_commit_list *git_commit_list_insert_by_date(git_commit_list_node *item, git_commit_list **list_p);
 int git_commit_list_parse(git_revwalk *walk, git_commit_list_node *commit);
 git_commit_list_node *git_commit_list_pop(git_commit_list **stack);
 
+/*
+ * Look up the generation number of a commit: 1 for a root commit, and
+ * otherwise one more than the largest generation of its parents.  A
+ * commit can only reach commits of a lower generation.
+ *
+ * Generations are never computed here, since that would walk the whole
+ * history of the commit; they are only read from the ones stored by
+ * `git_graph_generations_update`.  `out` is set to 0 when the commit's
+ * generation is not stored, and callers should then fall back to
+ * walking by commit date.
+ */
+int git_commit_list_generation(
+	uint32_t *out, git_revwalk *walk, git_commit_list_node *commit);
+
 #endif
@@ -17,6 +17,7 @@
 #include "index.h"
 #include "odb.h"
 #include "submodule.h"
+#include "array.h"
 
 #define DIFF_FLAG_IS_SET(DIFF,FLAG) \
 	(((DIFF)->base.opts.flags & (FLAG)) != 0)
@@ -33,6 +34,10 @@ typedef struct {
 
 	uint32_t diffcaps;
 	bool index_updated;
+
+	/* set when deltas are handed to callbacks as they are found */
+	const git_diff__stream *stream;
+	git_pool stream_pool;
 } git_diff_generated;
 
 static git_diff_delta *diff_delta__alloc(
@@ -40,11 +45,12 @@ static git_diff_delta *diff_delta__alloc(
 	git_delta_t status,
 	const char *path)
 {
+	git_pool *pool = diff->stream ? &diff->stream_pool : &diff->base.pool;
 	git_diff_delta *delta = git__calloc(1, sizeof(git_diff_delta));
 	if (!delta)
 		return NULL;
 
-	delta->old_file.path = git_pool_strdup(&diff->base.pool, path);
+	delta->old_file.path = git_pool_strdup(pool, path);
 	if (delta->old_file.path == NULL) {
 		git__free(delta);
 		return NULL;
@@ -394,6 +400,7 @@ static void diff_generated_free(git_diff *d)
 	git_vector_free_deep(&diff->base.deltas);
 
 	git_pathspec__vfree(&diff->pathspec);
+	git_pool_clear(&diff->stream_pool);
 	git_pool_clear(&diff->base.pool);
 
 	git__memzero(diff, sizeof(*diff));
@@ -424,6 +431,7 @@ static git_diff_generated *diff_generated_alloc(
 	memcpy(&diff->base.opts, &dflt, sizeof(git_diff_options));
 
 	if (git_pool_init(&diff->base.pool, 1) < 0 ||
+	    git_pool_init(&diff->stream_pool, 1) < 0 ||
 	    git_vector_init(&diff->base.deltas, 0, git_diff_delta__cmp) < 0) {
 		git_diff_free(&diff->base);
 		return NULL;
@@ -554,6 +562,46 @@ static int diff_generated_apply_options(
 	return (!diff->base.opts.old_prefix || !diff->base.opts.new_prefix) ? -1 : 0;
 }
 
+static int diff_hash_file(
+	git_oid *out,
+	const char *full_path,
+	uint32_t file_size,
+	git_filter_list *fl)
+{
+	int fd, error;
+
+	if ((fd = git_futils_open_ro(full_path)) < 0)
+		return fd;
+
+	error = git_odb__hashfd_filtered(
+		out, fd, (size_t)file_size, GIT_OBJECT_BLOB, fl);
+	p_close(fd);
+
+	return error;
+}
+
+static int diff_update_index_entry(
+	git_diff_generated *diff,
+	const git_index_entry *entry,
+	uint16_t mode,
+	const git_oid *id)
+{
+	git_index *idx;
+	git_index_entry updated_entry;
+	int error;
+
+	memcpy(&updated_entry, entry, sizeof(git_index_entry));
+	updated_entry.mode = mode;
+	git_oid_cpy(&updated_entry.id, id);
+
+	if (!(error = git_repository_index__weakptr(&idx, diff->base.repo))) {
+		error = git_index_add(idx, &updated_entry);
+		diff->index_updated = true;
+	}
+
+	return error;
+}
+
 int git_diff__oid_for_file(
 	git_oid *out,
 	git_diff *diff,
@@ -639,47 +687,50 @@ int git_diff__oid_for_entry(
 		diff->base.repo, NULL, entry.path,
 		GIT_FILTER_TO_ODB, GIT_FILTER_ALLOW_UNSAFE)))
 	{
-		int fd = git_futils_open_ro(full_path.ptr);
-		if (fd < 0)
-			error = fd;
-		else {
-			error = git_odb__hashfd_filtered(
-				out, fd, (size_t)entry.file_size, GIT_OBJECT_BLOB, fl);
-			p_close(fd);
-			diff->base.perf.oid_calculations++;
-		}
+		error = diff_hash_file(out, full_path.ptr, entry.file_size, fl);
+		diff->base.perf.oid_calculations++;
 
 		git_filter_list_free(fl);
 	}
 
 	/* update index for entry if requested */
-	if (!error && update_match && git_oid_equal(out, update_match)) {
-		git_index *idx;
-		git_index_entry updated_entry;
-
-		memcpy(&updated_entry, &entry, sizeof(git_index_entry));
-		updated_entry.mode = mode;
-		git_oid_cpy(&updated_entry.id, out);
-
-		if (!(error = git_repository_index__weakptr(&idx,
-			diff->base.repo))) {
-			error = git_index_add(idx, &updated_entry);
-			diff->index_updated = true;
-		}
- 	}
+	if (!error && update_match && git_oid_equal(out, update_match))
+		error = diff_update_index_entry(diff, &entry, mode, out);
 
 	git_buf_dispose(&full_path);
 	return error;
 }
 
+/*
+ * A workdir file whose stat data did not match the index; its contents
+ * need to be hashed to know whether it was actually modified.  These are
+ * collected while iterating and hashed together once iteration is done.
+ */
+typedef struct {
+	git_diff_delta *delta;
+	git_diff_file *file;
+	git_index_entry entry;
+	uint16_t mode;
+	git_filter_list *fl;
+	git_buf full_path;
+	git_oid old_id;
+	git_oid id;
+	unsigned int check_unmodified:1,
+		update_index:1;
+} diff_pending_hash;
+
 typedef struct {
 	git_repository *repo;
 	git_iterator *old_iter;
 	git_iterator *new_iter;
 	const git_index_entry *oitem;
 	const git_index_entry *nitem;
+	git_array_t(diff_pending_hash) pending;
 } diff_in_progress;
 
+#define DIFF_HASH_MAX_THREADS 20
+#define DIFF_HASH_THREAD_COST 16
+
 #define MODE_BITS_MASK 0000777
 
 static int maybe_modified_submodule(
@@ -731,6 +782,182 @@ static int maybe_modified_submodule(
 	return error;
 }
 
+static bool maybe_modified_can_defer(
+	git_diff_generated *diff,
+	const git_index_entry *oitem,
+	const git_index_entry *nitem,
+	unsigned int nmode)
+{
+	/* the notify callback expects to see the final delta status, a
+	 * streaming diff hands deltas out as soon as they are found, and
+	 * typechange trees and case changes may rewrite the last delta
+	 */
+	if (diff->base.opts.notify_cb || diff->stream ||
+		DIFF_FLAG_IS_SET(diff, GIT_DIFF_INCLUDE_TYPECHANGE_TREES))
+		return false;
+
+	if (DIFF_FLAG_IS_SET(diff, GIT_DIFF_IGNORE_CASE) &&
+		DIFF_FLAG_IS_SET(diff, GIT_DIFF_INCLUDE_CASECHANGE) &&
+		strcmp(oitem->path, nitem->path) != 0)
+		return false;
+
+	return S_ISREG(nmode) && git__is_sizet(nitem->file_size);
+}
+
+/*
+ * Record a MODIFIED delta for a file whose contents need to be hashed,
+ * and queue the hash; `diff_hash_pending` resolves the real status.
+ * Files with custom filters are not queued (`*deferred` is left false),
+ * since the hashes are computed on several threads at once, and custom
+ * filters are not required to be thread safe.
+ */
+static int maybe_modified_defer(
+	bool *deferred,
+	git_diff_generated *diff,
+	diff_in_progress *info,
+	const git_index_entry *oitem,
+	unsigned int omode,
+	const git_index_entry *nitem,
+	unsigned int nmode,
+	const char *matched_pathspec)
+{
+	diff_pending_hash *pending;
+	git_diff_delta *delta;
+	git_filter_list *fl = NULL;
+	int error;
+
+	*deferred = false;
+
+	if ((error = git_filter_list_load(&fl, diff->base.repo, NULL,
+			nitem->path, GIT_FILTER_TO_ODB, GIT_FILTER_ALLOW_UNSAFE)) < 0)
+		return error;
+
+	if (!git_filter_list__builtin_only(fl)) {
+		git_filter_list_free(fl);
+		return 0;
+	}
+
+	if ((error = diff_delta__from_two(diff, GIT_DELTA_MODIFIED,
+			oitem, omode, nitem, nmode, NULL, matched_pathspec)) < 0) {
+		git_filter_list_free(fl);
+		return error;
+	}
+
+	delta = git_vector_last(&diff->base.deltas);
+
+	pending = git_array_alloc(info->pending);
+
+	if (!pending) {
+		git_filter_list_free(fl);
+		return -1;
+	}
+
+	memset(pending, 0, sizeof(*pending));
+
+	*deferred = true;
+	pending->fl = fl;
+	pending->delta = delta;
+	pending->file = DIFF_FLAG_IS_SET(diff, GIT_DIFF_REVERSE) ?
+		&delta->old_file : &delta->new_file;
+	pending->mode = (uint16_t)nmode;
+	git_oid_cpy(&pending->old_id, &oitem->id);
+	pending->check_unmodified = (omode == nmode);
+	pending->update_index = pending->check_unmodified &&
+		DIFF_FLAG_IS_SET(diff, GIT_DIFF_UPDATE_INDEX);
+
+	memcpy(&pending->entry, nitem, sizeof(git_index_entry));
+	pending->entry.path = git_pool_strdup(&diff->base.pool, nitem->path);
+	GIT_ERROR_CHECK_ALLOC(pending->entry.path);
+
+	return git_buf_joinpath(&pending->full_path,
+		git_repository_workdir(diff->base.repo), nitem->path);
+}
+
+static int diff_hash_pending_cb(size_t idx, void *payload)
+{
+	diff_in_progress *info = payload;
+	diff_pending_hash *pending = git_array_get(info->pending, idx);
+
+	return diff_hash_file(&pending->id,
+		pending->full_path.ptr, pending->entry.file_size, pending->fl);
+}
+
+static int diff_delta_is_unmodified(
+	const git_vector *v, size_t idx, void *payload)
+{
+	git_diff_delta *delta = git_vector_get(v, idx);
+
+	GIT_UNUSED(payload);
+
+	if (delta->status != GIT_DELTA_UNMODIFIED)
+		return 0;
+
+	git__free(delta);
+	return 1;
+}
+
+/*
+ * Hash the contents of all the files that were queued while iterating,
+ * spreading the work across threads, then settle the status of their
+ * deltas and write any refreshed stat data back to the index.
+ */
+static int diff_hash_pending(
+	git_diff_generated *diff,
+	diff_in_progress *info)
+{
+	diff_pending_hash *pending;
+	size_t i, count = git_array_size(info->pending), nthreads;
+	bool unmodified = false;
+	int error;
+
+	if (!count)
+		return 0;
+
+	nthreads = min(count / DIFF_HASH_THREAD_COST + 1, DIFF_HASH_MAX_THREADS);
+	nthreads = min(nthreads, (size_t)git_online_cpus());
+
+	if ((error = git_parallel_foreach(
+			count, nthreads, diff_hash_pending_cb, info)) < 0)
+		return error;
+
+	diff->base.perf.oid_calculations += count;
+
+	git_array_foreach(info->pending, i, pending) {
+		git_oid_cpy(&pending->file->id, &pending->id);
+
+		if (!pending->check_unmodified ||
+			!git_oid_equal(&pending->old_id, &pending->id))
+			continue;
+
+		pending->delta->status = GIT_DELTA_UNMODIFIED;
+		unmodified = true;
+
+		if (pending->update_index &&
+			(error = diff_update_index_entry(diff,
+				&pending->entry, pending->mode, &pending->id)) < 0)
+			return error;
+	}
+
+	if (unmodified && DIFF_FLAG_ISNT_SET(diff, GIT_DIFF_INCLUDE_UNMODIFIED))
+		git_vector_remove_matching(
+			&diff->base.deltas, diff_delta_is_unmodified, NULL);
+
+	return 0;
+}
+
+static void diff_pending_free(diff_in_progress *info)
+{
+	diff_pending_hash *pending;
+	size_t i;
+
+	git_array_foreach(info->pending, i, pending) {
+		git_filter_list_free(pending->fl);
+		git_buf_dispose(&pending->full_path);
+	}
+
+	git_array_clear(info->pending);
+}
+
 static int maybe_modified(
 	git_diff_generated *diff,
 	diff_in_progress *info)
@@ -847,6 +1074,15 @@ static int maybe_modified(
 			DIFF_FLAG_IS_SET(diff, GIT_DIFF_UPDATE_INDEX) && omode == nmode ?
 			&oitem->id : NULL;
 
+		if (maybe_modified_can_defer(diff, oitem, nitem, nmode)) {
+			bool deferred;
+
+			if ((error = maybe_modified_defer(&deferred, diff, info,
+					oitem, omode, nitem, nmode, matched_pathspec)) < 0 ||
+				deferred)
+				return error;
+		}
+
 		if ((error = git_diff__oid_for_entry(
 				&noid, &diff->base, nitem, nmode, update_check)) < 0)
 			return error;
@@ -1182,12 +1418,37 @@ static int handle_matched_item(
 	return error;
 }
 
-int git_diff__from_iterators(
+/*
+ * Hand the deltas found for the current item to the stream callbacks,
+ * then drop them so that the diff never holds more than a few at once.
+ */
+static int diff_stream_flush(git_diff_generated *diff)
+{
+	const git_diff__stream *stream = diff->stream;
+	git_diff_delta *delta;
+	size_t i;
+	int error;
+
+	error = git_diff_foreach(&diff->base, stream->file_cb,
+		stream->binary_cb, stream->hunk_cb, stream->line_cb,
+		stream->payload);
+
+	git_vector_foreach(&diff->base.deltas, i, delta)
+		git__free(delta);
+
+	git_vector_clear(&diff->base.deltas);
+	git_pool_clear(&diff->stream_pool);
+
+	return error;
+}
+
+static int diff_from_iterators(
 	git_diff **out,
 	git_repository *repo,
 	git_iterator *old_iter,
 	git_iterator *new_iter,
-	const git_diff_options *opts)
+	const git_diff_options *opts,
+	const git_diff__stream *stream)
 {
 	git_diff_generated *diff;
 	diff_in_progress info;
@@ -1198,9 +1459,12 @@ int git_diff__from_iterators(
 	diff = diff_generated_alloc(repo, old_iter, new_iter);
 	GIT_ERROR_CHECK_ALLOC(diff);
 
+	diff->stream = stream;
+
 	info.repo = repo;
 	info.old_iter = old_iter;
 	info.new_iter = new_iter;
+	git_array_init(info.pending);
 
 	/* make iterators have matching icase behavior */
 	if (DIFF_FLAG_IS_SET(diff, GIT_DIFF_IGNORE_CASE)) {
@@ -1247,12 +1511,20 @@ int git_diff__from_iterators(
 		 */
 		else
 			error = handle_matched_item(diff, &info);
+
+		if (!error && stream && git_vector_length(&diff->base.deltas) > 0)
+			error = diff_stream_flush(diff);
 	}
 
+	if (!error)
+		error = diff_hash_pending(diff, &info);
+
 	diff->base.perf.stat_calls +=
 		old_iter->stat_calls + new_iter->stat_calls;
 
 cleanup:
+	diff_pending_free(&info);
+
 	if (!error)
 		*out = &diff->base;
 	else
@@ -1261,6 +1533,29 @@ cleanup:
 	return error;
 }
 
+int git_diff__from_iterators(
+	git_diff **out,
+	git_repository *repo,
+	git_iterator *old_iter,
+	git_iterator *new_iter,
+	const git_diff_options *opts)
+{
+	return diff_from_iterators(out, repo, old_iter, new_iter, opts, NULL);
+}
+
+int git_diff__stream_from_iterators(
+	git_diff **out,
+	git_repository *repo,
+	git_iterator *old_iter,
+	git_iterator *new_iter,
+	const git_diff_options *opts,
+	const git_diff__stream *stream)
+{
+	assert(stream);
+
+	return diff_from_iterators(out, repo, old_iter, new_iter, opts, stream);
+}
+
 static int diff_prepare_iterator_opts(char **prefix, git_iterator_options *a, int aflags,
 		git_iterator_options *b, int bflags,
 		const git_diff_options *opts)
@@ -1287,12 +1582,28 @@ static int diff_prepare_iterator_opts(char **prefix, git_iterator_options *a, in
 	return 0;
 }
 
-int git_diff_tree_to_tree(
+static void diff_stream_init(
+	git_diff__stream *stream,
+	git_diff_file_cb file_cb,
+	git_diff_binary_cb binary_cb,
+	git_diff_hunk_cb hunk_cb,
+	git_diff_line_cb line_cb,
+	void *payload)
+{
+	stream->file_cb = file_cb;
+	stream->binary_cb = binary_cb;
+	stream->hunk_cb = hunk_cb;
+	stream->line_cb = line_cb;
+	stream->payload = payload;
+}
+
+static int diff_tree_to_tree(
 	git_diff **out,
 	git_repository *repo,
 	git_tree *old_tree,
 	git_tree *new_tree,
-	const git_diff_options *opts)
+	const git_diff_options *opts,
+	const git_diff__stream *stream)
 {
 	git_iterator_flag_t iflag = GIT_ITERATOR_DONT_IGNORE_CASE;
 	git_iterator_options a_opts = GIT_ITERATOR_OPTIONS_INIT,
@@ -1316,7 +1627,7 @@ int git_diff_tree_to_tree(
 	if ((error = diff_prepare_iterator_opts(&prefix, &a_opts, iflag, &b_opts, iflag, opts)) < 0 ||
 	    (error = git_iterator_for_tree(&a, old_tree, &a_opts)) < 0 ||
 	    (error = git_iterator_for_tree(&b, new_tree, &b_opts)) < 0 ||
-	    (error = git_diff__from_iterators(&diff, repo, a, b, opts)) < 0)
+	    (error = diff_from_iterators(&diff, repo, a, b, opts, stream)) != 0)
 		goto out;
 
 	*out = diff;
@@ -1330,6 +1641,39 @@ out:
 	return error;
 }
 
+int git_diff_tree_to_tree(
+	git_diff **out,
+	git_repository *repo,
+	git_tree *old_tree,
+	git_tree *new_tree,
+	const git_diff_options *opts)
+{
+	return diff_tree_to_tree(out, repo, old_tree, new_tree, opts, NULL);
+}
+
+int git_diff_tree_to_tree_foreach(
+	git_repository *repo,
+	git_tree *old_tree,
+	git_tree *new_tree,
+	const git_diff_options *opts,
+	git_diff_file_cb file_cb,
+	git_diff_binary_cb binary_cb,
+	git_diff_hunk_cb hunk_cb,
+	git_diff_line_cb line_cb,
+	void *payload)
+{
+	git_diff__stream stream;
+	git_diff *diff;
+	int error;
+
+	diff_stream_init(&stream, file_cb, binary_cb, hunk_cb, line_cb, payload);
+
+	error = diff_tree_to_tree(&diff, repo, old_tree, new_tree, opts, &stream);
+
+	git_diff_free(diff);
+	return error;
+}
+
 static int diff_load_index(git_index **index, git_repository *repo)
 {
 	int error = git_repository_index__weakptr(index, repo);
@@ -1341,12 +1685,13 @@ static int diff_load_index(git_index **index, git_repository *repo)
 	return error;
 }
 
-int git_diff_tree_to_index(
+static int diff_tree_to_index(
 	git_diff **out,
 	git_repository *repo,
 	git_tree *old_tree,
 	git_index *index,
-	const git_diff_options *opts)
+	const git_diff_options *opts,
+	const git_diff__stream *stream)
 {
 	git_iterator_flag_t iflag = GIT_ITERATOR_DONT_IGNORE_CASE |
 		GIT_ITERATOR_INCLUDE_CONFLICTS;
@@ -1370,7 +1715,7 @@ int git_diff_tree_to_index(
 	if ((error = diff_prepare_iterator_opts(&prefix, &a_opts, iflag, &b_opts, iflag, opts)) < 0 ||
 	    (error = git_iterator_for_tree(&a, old_tree, &a_opts)) < 0 ||
 	    (error = git_iterator_for_index(&b, repo, index, &b_opts)) < 0 ||
-	    (error = git_diff__from_iterators(&diff, repo, a, b, opts)) < 0)
+	    (error = diff_from_iterators(&diff, repo, a, b, opts, stream)) != 0)
 		goto out;
 
 	/* if index is in case-insensitive order, re-sort deltas to match */
@@ -1388,11 +1733,45 @@ out:
 	return error;
 }
 
-int git_diff_index_to_workdir(
+int git_diff_tree_to_index(
 	git_diff **out,
 	git_repository *repo,
+	git_tree *old_tree,
 	git_index *index,
 	const git_diff_options *opts)
+{
+	return diff_tree_to_index(out, repo, old_tree, index, opts, NULL);
+}
+
+int git_diff_tree_to_index_foreach(
+	git_repository *repo,
+	git_tree *old_tree,
+	git_index *index,
+	const git_diff_options *opts,
+	git_diff_file_cb file_cb,
+	git_diff_binary_cb binary_cb,
+	git_diff_hunk_cb hunk_cb,
+	git_diff_line_cb line_cb,
+	void *payload)
+{
+	git_diff__stream stream;
+	git_diff *diff;
+	int error;
+
+	diff_stream_init(&stream, file_cb, binary_cb, hunk_cb, line_cb, payload);
+
+	error = diff_tree_to_index(&diff, repo, old_tree, index, opts, &stream);
+
+	git_diff_free(diff);
+	return error;
+}
+
+static int diff_index_to_workdir(
+	git_diff **out,
+	git_repository *repo,
+	git_index *index,
+	const git_diff_options *opts,
+	const git_diff__stream *stream)
 {
 	git_iterator_options a_opts = GIT_ITERATOR_OPTIONS_INIT,
 		b_opts = GIT_ITERATOR_OPTIONS_INIT;
@@ -1412,7 +1791,7 @@ int git_diff_index_to_workdir(
 						&b_opts, GIT_ITERATOR_DONT_AUTOEXPAND, opts)) < 0 ||
 	    (error = git_iterator_for_index(&a, repo, index, &a_opts)) < 0 ||
 	    (error = git_iterator_for_workdir(&b, repo, index, NULL, &b_opts)) < 0 ||
-	    (error = git_diff__from_iterators(&diff, repo, a, b, opts)) < 0)
+	    (error = diff_from_iterators(&diff, repo, a, b, opts, stream)) != 0)
 		goto out;
 
 	if ((diff->opts.flags & GIT_DIFF_UPDATE_INDEX) && ((git_diff_generated *)diff)->index_updated)
@@ -1430,11 +1809,43 @@ out:
 	return error;
 }
 
-int git_diff_tree_to_workdir(
+int git_diff_index_to_workdir(
 	git_diff **out,
 	git_repository *repo,
-	git_tree *old_tree,
+	git_index *index,
 	const git_diff_options *opts)
+{
+	return diff_index_to_workdir(out, repo, index, opts, NULL);
+}
+
+int git_diff_index_to_workdir_foreach(
+	git_repository *repo,
+	git_index *index,
+	const git_diff_options *opts,
+	git_diff_file_cb file_cb,
+	git_diff_binary_cb binary_cb,
+	git_diff_hunk_cb hunk_cb,
+	git_diff_line_cb line_cb,
+	void *payload)
+{
+	git_diff__stream stream;
+	git_diff *diff;
+	int error;
+
+	diff_stream_init(&stream, file_cb, binary_cb, hunk_cb, line_cb, payload);
+
+	error = diff_index_to_workdir(&diff, repo, index, opts, &stream);
+
+	git_diff_free(diff);
+	return error;
+}
+
+static int diff_tree_to_workdir(
+	git_diff **out,
+	git_repository *repo,
+	git_tree *old_tree,
+	const git_diff_options *opts,
+	const git_diff__stream *stream)
 {
 	git_iterator_options a_opts = GIT_ITERATOR_OPTIONS_INIT,
 		b_opts = GIT_ITERATOR_OPTIONS_INIT;
@@ -1453,7 +1864,7 @@ int git_diff_tree_to_workdir(
 	    (error = git_repository_index__weakptr(&index, repo)) < 0 ||
 	    (error = git_iterator_for_tree(&a, old_tree, &a_opts)) < 0 ||
 	    (error = git_iterator_for_workdir(&b, repo, index, old_tree, &b_opts)) < 0 ||
-	    (error = git_diff__from_iterators(&diff, repo, a, b, opts)) < 0)
+	    (error = diff_from_iterators(&diff, repo, a, b, opts, stream)) != 0)
 		goto out;
 
 	*out = diff;
@@ -1467,6 +1878,37 @@ out:
 	return error;
 }
 
+int git_diff_tree_to_workdir(
+	git_diff **out,
+	git_repository *repo,
+	git_tree *old_tree,
+	const git_diff_options *opts)
+{
+	return diff_tree_to_workdir(out, repo, old_tree, opts, NULL);
+}
+
+int git_diff_tree_to_workdir_foreach(
+	git_repository *repo,
+	git_tree *old_tree,
+	const git_diff_options *opts,
+	git_diff_file_cb file_cb,
+	git_diff_binary_cb binary_cb,
+	git_diff_hunk_cb hunk_cb,
+	git_diff_line_cb line_cb,
+	void *payload)
+{
+	git_diff__stream stream;
+	git_diff *diff;
+	int error;
+
+	diff_stream_init(&stream, file_cb, binary_cb, hunk_cb, line_cb, payload);
+
+	error = diff_tree_to_workdir(&diff, repo, old_tree, opts, &stream);
+
+	git_diff_free(diff);
+	return error;
+}
+
 int git_diff_tree_to_workdir_with_index(
 	git_diff **out,
 	git_repository *repo,
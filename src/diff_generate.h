@@ -55,6 +55,31 @@ extern int git_diff__from_iterators(
 	git_iterator *new_iter,
 	const git_diff_options *opts);
 
+/*
+ * Callbacks for a diff that hands each delta over as soon as it is found
+ * instead of collecting them all in the `git_diff`.
+ */
+typedef struct {
+	git_diff_file_cb file_cb;
+	git_diff_binary_cb binary_cb;
+	git_diff_hunk_cb hunk_cb;
+	git_diff_line_cb line_cb;
+	void *payload;
+} git_diff__stream;
+
+/*
+ * Like `git_diff__from_iterators`, but each delta is given to the stream
+ * callbacks and then freed, so the resulting diff is always empty.  It
+ * only keeps the options and state that callers may need afterwards.
+ */
+extern int git_diff__stream_from_iterators(
+	git_diff **diff_ptr,
+	git_repository *repo,
+	git_iterator *old_iter,
+	git_iterator *new_iter,
+	const git_diff_options *opts,
+	const git_diff__stream *stream);
+
 extern int git_diff__commit(
 	git_diff **diff, git_repository *repo, const git_commit *commit, const git_diff_options *opts);
 
@@ -173,6 +173,76 @@ static int diff_file_stats_summary_to_buf(
 	return 0;
 }
 
+/*
+ * The line counts of a generated diff are computed without building a
+ * patch for each delta: the lines are counted as xdiff reports them.
+ * Unless one side of the diff is the working directory (whose files are
+ * filtered as they are loaded), several deltas are diffed at once.
+ */
+#define STATS_THREAD_COST 16
+
+typedef struct {
+	git_diff *diff;
+	diff_file_stats *filestats;
+	git_mutex lock;
+} diff_stats_counting;
+
+static int diff_stats_count_cb(size_t idx, void *payload)
+{
+	diff_stats_counting *counting = payload;
+
+	return git_patch_generated_line_stats(
+		&counting->filestats[idx].insertions,
+		&counting->filestats[idx].deletions,
+		counting->diff, idx, &counting->lock);
+}
+
+static int diff_stats_count_generated(git_diff_stats *stats, git_diff *diff)
+{
+	diff_stats_counting counting;
+	size_t deltas = git_diff_num_deltas(diff), nthreads = 1;
+	int error;
+
+	counting.diff = diff;
+	counting.filestats = stats->filestats;
+
+	if (git_mutex_init(&counting.lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to initialize diff stats lock");
+		return -1;
+	}
+
+	if (diff->old_src != GIT_ITERATOR_WORKDIR &&
+	    diff->new_src != GIT_ITERATOR_WORKDIR)
+		nthreads = min(deltas / STATS_THREAD_COST + 1,
+			(size_t)git_online_cpus());
+
+	error = git_parallel_foreach(deltas, nthreads,
+		diff_stats_count_cb, &counting);
+
+	git_mutex_free(&counting.lock);
+	return error;
+}
+
+static int diff_stats_count_parsed(git_diff_stats *stats, git_diff *diff)
+{
+	git_patch *patch;
+	size_t i, deltas = git_diff_num_deltas(diff);
+	int error = 0;
+
+	for (i = 0; i < deltas && !error; ++i) {
+		if ((error = git_patch_from_diff(&patch, diff, i)) < 0)
+			break;
+
+		error = git_patch_line_stats(NULL,
+			&stats->filestats[i].insertions,
+			&stats->filestats[i].deletions, patch);
+
+		git_patch_free(patch);
+	}
+
+	return error;
+}
+
 int git_diff_get_stats(
 	git_diff_stats **out,
 	git_diff *diff)
@@ -198,32 +268,23 @@ int git_diff_get_stats(
 	stats->diff = diff;
 	GIT_REFCOUNT_INC(diff);
 
-	for (i = 0; i < deltas && !error; ++i) {
-		git_patch *patch = NULL;
-		size_t add = 0, remove = 0, namelen;
-		const git_diff_delta *delta;
+	if (diff->type == GIT_DIFF_TYPE_GENERATED)
+		error = diff_stats_count_generated(stats, diff);
+	else
+		error = diff_stats_count_parsed(stats, diff);
 
-		if ((error = git_patch_from_diff(&patch, diff, i)) < 0)
-			break;
+	for (i = 0; i < deltas && !error; ++i) {
+		const git_diff_delta *delta = git_diff_get_delta(diff, i);
+		size_t add = stats->filestats[i].insertions,
+			remove = stats->filestats[i].deletions, namelen;
 
 		/* keep a count of renames because it will affect formatting */
-		delta = patch->delta;
-
-		/* TODO ugh */
 		namelen = strlen(delta->new_file.path);
 		if (strcmp(delta->old_file.path, delta->new_file.path) != 0) {
 			namelen += strlen(delta->old_file.path);
 			stats->renames++;
 		}
 
-		/* and, of course, count the line stats */
-		error = git_patch_line_stats(NULL, &add, &remove, patch);
-
-		git_patch_free(patch);
-
-		stats->filestats[i].insertions = add;
-		stats->filestats[i].deletions = remove;
-
 		total_insertions += add;
 		total_deletions += remove;
 
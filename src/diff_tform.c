@@ -9,13 +9,16 @@
 
 #include "git2/config.h"
 #include "git2/blob.h"
-#include "git2/sys/hashsig.h"
 
 #include "diff.h"
 #include "diff_generate.h"
 #include "path.h"
 #include "futils.h"
 #include "config.h"
+#include "hashsig.h"
+#include "hashsig_cache.h"
+#include "array.h"
+#include "thread-utils.h"
 
 git_diff_delta *git_diff__delta_dup(
 	const git_diff_delta *d, git_pool *pool)
@@ -489,6 +492,21 @@ static int similarity_sig(
 			&cache[info->idx], info->file,
 			info->data.ptr, opts->metric->payload);
 	} else {
+		git_hashsig_option_t hashsig_opts =
+			(git_hashsig_option_t)(intptr_t)opts->metric->payload;
+		bool cacheable =
+			opts->metric->buffer_signature == git_diff_find_similar__hashsig_for_buf &&
+			!git_oid_is_zero(&file->id);
+		git_object_size_t cached_size;
+
+		/* the builtin signatures of blobs may be cached on disk */
+		if (cacheable && git_hashsig_cache_get(
+				(git_hashsig **)&cache[info->idx], &cached_size,
+				info->repo, &file->id, hashsig_opts) == 0) {
+			file->size = cached_size;
+			return 0;
+		}
+
 		/* if we didn't initially know the size, we might have an odb_obj
 		 * around from earlier, so convert that, otherwise load the blob now
 		 */
@@ -514,6 +532,10 @@ static int similarity_sig(
 			error = opts->metric->buffer_signature(
 				&cache[info->idx], info->file,
 				git_blob_rawcontent(info->blob), sz, opts->metric->payload);
+
+			if (!error && cacheable)
+				git_hashsig_cache_put(info->repo,
+					&file->id, file->size, cache[info->idx]);
 		}
 	}
 
@@ -795,20 +817,434 @@ typedef struct {
 	uint16_t similarity;
 } diff_find_match;
 
+/*
+ * When there are more rename sources than the rename limit, a target is
+ * not compared against every source, so renames from the sources past
+ * the limit are never found.  Instead, every file is given a handful of
+ * keys -- its object id, its basename, and the first values of the
+ * min- and max-heaps of its similarity signature -- and only sources and
+ * targets that share a key are compared.  Those heap values are not the
+ * exact extremes of the file's hashes (a full heap drops its top rather
+ * than replacing it), so similar files are likely, but not certain, to
+ * share a key; that is why this is only used when comparing all pairs
+ * would be cut off by the rename limit anyway.
+ */
+#define DIFF_RENAME_SKETCH_KEYS 8
+#define DIFF_RENAME_BUCKET_MAX 32
+
+enum {
+	DIFF_RENAME_KEY_ID = 0,
+	DIFF_RENAME_KEY_BASENAME,
+	DIFF_RENAME_KEY_SKETCH,
+};
+
+typedef struct {
+	uint32_t key;
+	uint8_t kind;
+	uint8_t is_target;
+	size_t idx;
+} diff_rename_key;
+
+typedef git_array_t(diff_rename_key) diff_rename_keys;
+
+typedef struct {
+	size_t tgt;
+	size_t src;
+} diff_rename_pair;
+
+typedef struct {
+	/* for each delta, its sources are srcs[start[t]] .. srcs[start[t+1]] */
+	size_t *start;
+	size_t *srcs;
+} diff_rename_candidates;
+
+static int rename_key_cmp(const void *a, const void *b, void *payload)
+{
+	const diff_rename_key *ka = a, *kb = b;
+
+	GIT_UNUSED(payload);
+
+	if (ka->kind != kb->kind)
+		return ka->kind < kb->kind ? -1 : 1;
+	if (ka->key != kb->key)
+		return ka->key < kb->key ? -1 : 1;
+	if (ka->is_target != kb->is_target)
+		return ka->is_target < kb->is_target ? -1 : 1;
+	return ka->idx < kb->idx ? -1 : (ka->idx > kb->idx);
+}
+
+static int rename_pair_cmp(const void *a, const void *b, void *payload)
+{
+	const diff_rename_pair *pa = a, *pb = b;
+
+	GIT_UNUSED(payload);
+
+	if (pa->tgt != pb->tgt)
+		return pa->tgt < pb->tgt ? -1 : 1;
+	return pa->src < pb->src ? -1 : (pa->src > pb->src);
+}
+
+static int similarity_load(
+	git_diff *diff,
+	const git_diff_find_options *opts,
+	void **cache,
+	size_t file_idx)
+{
+	similarity_info info;
+	int error;
+
+	if (cache[file_idx] ||
+	    !GIT_MODE_ISBLOB(similarity_get_file(diff, file_idx)->mode))
+		return 0;
+
+	memset(&info, 0, sizeof(info));
+
+	if ((error = similarity_init(&info, diff, file_idx)) == 0)
+		error = similarity_sig(&info, opts, cache);
+
+	similarity_unload(&info);
+	return error;
+}
+
+static int rename_keys_add(
+	diff_rename_keys *keys,
+	git_diff *diff,
+	void **cache,
+	size_t delta_idx,
+	bool is_target)
+{
+	size_t file_idx = 2 * delta_idx + (is_target ? 1 : 0);
+	git_diff_file *file = similarity_get_file(diff, file_idx);
+	uint32_t sketch[2 * DIFF_RENAME_SKETCH_KEYS];
+	const char *basename;
+	diff_rename_key *key;
+	size_t i, sketch_len = 0;
+
+	if (cache[file_idx])
+		sketch_len = git_hashsig__extremes(
+			sketch, DIFF_RENAME_SKETCH_KEYS, cache[file_idx]);
+
+	for (i = 0; i < sketch_len + 2; i++) {
+		key = git_array_alloc(*keys);
+		GIT_ERROR_CHECK_ALLOC(key);
+
+		key->idx = delta_idx;
+		key->is_target = is_target;
+
+		if (i < sketch_len) {
+			key->kind = DIFF_RENAME_KEY_SKETCH;
+			key->key = sketch[i];
+		} else if (i == sketch_len) {
+			basename = strrchr(file->path, '/');
+			basename = basename ? basename + 1 : file->path;
+
+			key->kind = DIFF_RENAME_KEY_BASENAME;
+			key->key = git__hash(basename, (int)strlen(basename), 0);
+		} else {
+			key->kind = DIFF_RENAME_KEY_ID;
+			memcpy(&key->key, file->id.id, sizeof(key->key));
+		}
+	}
+
+	return 0;
+}
+
+static void rename_candidates_free(diff_rename_candidates *candidates)
+{
+	git__free(candidates->start);
+	git__free(candidates->srcs);
+}
+
+/*
+ * Compute the sources that each target should be compared against, once
+ * the signatures of all of the files have been loaded.  A source and
+ * target that share a key are candidates; for keys that are shared by
+ * very many files, each target is only paired with a bounded window of
+ * the sources (starting at a different one for each target), so that
+ * the number of candidates stays linear in the number of files.
+ */
+static int rename_candidates_init(
+	diff_rename_candidates *candidates,
+	git_diff *diff,
+	void **cache)
+{
+	diff_rename_keys keys = GIT_ARRAY_INIT;
+	git_array_t(diff_rename_pair) pairs = GIT_ARRAY_INIT;
+	diff_rename_pair *pair;
+	git_diff_delta *delta;
+	size_t i, j, k, n, nsrcs, window, first, unique = 0;
+	int error = 0;
+
+	memset(candidates, 0, sizeof(*candidates));
+
+	git_vector_foreach(&diff->deltas, i, delta) {
+		if ((delta->flags & GIT_DIFF_FLAG__IS_RENAME_SOURCE) != 0 &&
+		    (error = rename_keys_add(&keys, diff, cache, i, false)) < 0)
+			goto done;
+
+		if ((delta->flags & GIT_DIFF_FLAG__IS_RENAME_TARGET) != 0 &&
+		    (error = rename_keys_add(&keys, diff, cache, i, true)) < 0)
+			goto done;
+	}
+
+	git__qsort_r(keys.ptr, keys.size, sizeof(diff_rename_key),
+		rename_key_cmp, NULL);
+
+	for (i = 0; i < keys.size; i = j) {
+		/* the files sharing a key are sorted with the sources first */
+		for (j = i + 1; j < keys.size &&
+		     keys.ptr[j].kind == keys.ptr[i].kind &&
+		     keys.ptr[j].key == keys.ptr[i].key; j++)
+			;
+
+		for (nsrcs = 0; i + nsrcs < j && !keys.ptr[i + nsrcs].is_target; nsrcs++)
+			;
+
+		if (!nsrcs)
+			continue;
+
+		window = min(nsrcs, DIFF_RENAME_BUCKET_MAX);
+
+		for (k = i + nsrcs; k < j; k++) {
+			first = (k - i - nsrcs) % nsrcs;
+
+			for (n = 0; n < window; n++) {
+				if ((pair = git_array_alloc(pairs)) == NULL) {
+					error = -1;
+					goto done;
+				}
+
+				pair->tgt = keys.ptr[k].idx;
+				pair->src = keys.ptr[i + (first + n) % nsrcs].idx;
+			}
+		}
+	}
+
+	git__qsort_r(pairs.ptr, pairs.size, sizeof(diff_rename_pair),
+		rename_pair_cmp, NULL);
+
+	candidates->start = git__calloc(diff->deltas.length + 1, sizeof(size_t));
+	candidates->srcs = git__calloc(pairs.size ? pairs.size : 1, sizeof(size_t));
+
+	if (!candidates->start || !candidates->srcs) {
+		error = -1;
+		goto done;
+	}
+
+	for (i = 0; i < pairs.size; i++) {
+		if (i > 0 && !rename_pair_cmp(&pairs.ptr[i - 1], &pairs.ptr[i], NULL))
+			continue;
+
+		candidates->srcs[unique++] = pairs.ptr[i].src;
+		candidates->start[pairs.ptr[i].tgt + 1]++;
+	}
+
+	for (i = 0; i < diff->deltas.length; i++)
+		candidates->start[i + 1] += candidates->start[i];
+
+done:
+	git_array_clear(keys);
+	git_array_clear(pairs);
+	return error;
+}
+
+/*
+ * Like `similarity_measure`, but only using signatures that have already
+ * been loaded by `similarity_load`; this does not modify the diff or the
+ * signature cache, so it can be called from several threads at once.
+ */
+static int similarity_score(
+	int *score,
+	git_diff *diff,
+	const git_diff_find_options *opts,
+	void **cache,
+	size_t a_idx,
+	size_t b_idx)
+{
+	git_diff_file *a_file = similarity_get_file(diff, a_idx);
+	git_diff_file *b_file = similarity_get_file(diff, b_idx);
+
+	*score = -1;
+
+	if (!GIT_MODE_ISBLOB(a_file->mode) || !GIT_MODE_ISBLOB(b_file->mode))
+		return 0;
+
+	if (git_oid__cmp(&a_file->id, &b_file->id) == 0) {
+		*score = 100;
+		return 0;
+	}
+
+	if (a_file->size > 127 &&
+		b_file->size > 127 &&
+		(a_file->size > (b_file->size << 3) ||
+		 b_file->size > (a_file->size << 3)))
+		return 0;
+
+	if (!cache[a_idx] || !cache[b_idx])
+		return 0;
+
+	return opts->metric->similarity(
+		score, cache[a_idx], cache[b_idx], opts->metric->payload);
+}
+
+#define DIFF_RENAME_THREAD_COST 8
+
+typedef struct {
+	size_t src;
+	uint16_t similarity;
+} diff_rename_score;
+
+typedef git_array_t(diff_rename_score) diff_rename_scores;
+typedef git_array_t(size_t) diff_rename_indices;
+
+static int rename_index_add(diff_rename_indices *indices, size_t idx)
+{
+	size_t *entry = git_array_alloc(*indices);
+	GIT_ERROR_CHECK_ALLOC(entry);
+
+	*entry = idx;
+	return 0;
+}
+
+/*
+ * The similarity of each target to the sources it is compared against is
+ * computed once, up front, and the best matches are then picked from
+ * these scores serially.  With the builtin metric, the signatures are all
+ * loaded first and the targets are scored on several threads; since the
+ * scores do not depend on the order in which they are computed, the
+ * matches are the same as when scoring serially.
+ */
+typedef struct {
+	git_diff *diff;
+	const git_diff_find_options *opts;
+	void **cache;
+	diff_rename_indices files;
+	diff_rename_indices targets;
+	size_t num_srcs;
+	diff_rename_candidates *candidates;
+	diff_rename_scores *scores;
+	bool preloaded;
+} diff_rename_scoring;
+
+static int rename_scoring_load_cb(size_t idx, void *payload)
+{
+	diff_rename_scoring *scoring = payload;
+	size_t *file_idx = git_array_get(scoring->files, idx);
+
+	return similarity_load(scoring->diff, scoring->opts, scoring->cache, *file_idx);
+}
+
+static int rename_scoring_target_cb(size_t idx, void *payload)
+{
+	diff_rename_scoring *scoring = payload;
+	size_t t = *git_array_get(scoring->targets, idx);
+	size_t c, s, first_src, last_src, tried_srcs = 0;
+	diff_rename_score *score;
+	git_diff_delta *src;
+	int error = 0, result;
+
+	if (scoring->candidates) {
+		first_src = scoring->candidates->start[t];
+		last_src = scoring->candidates->start[t + 1];
+	} else {
+		first_src = 0;
+		last_src = scoring->diff->deltas.length;
+	}
+
+	for (c = first_src; c < last_src; c++) {
+		s = scoring->candidates ? scoring->candidates->srcs[c] : c;
+		src = GIT_VECTOR_GET(&scoring->diff->deltas, s);
+
+		/* skip things that are not rename sources */
+		if ((src->flags & GIT_DIFF_FLAG__IS_RENAME_SOURCE) == 0)
+			continue;
+
+		/* calculate similarity for this pair */
+		if (s == t)
+			result = -1; /* don't measure self-similarity here */
+		else if (scoring->preloaded)
+			error = similarity_score(&result, scoring->diff,
+				scoring->opts, scoring->cache, 2 * s, 2 * t + 1);
+		else
+			error = similarity_measure(&result, scoring->diff,
+				scoring->opts, scoring->cache, 2 * s, 2 * t + 1);
+
+		if (error < 0)
+			return error;
+
+		if (result < 0)
+			continue;
+
+		score = git_array_alloc(scoring->scores[t]);
+		GIT_ERROR_CHECK_ALLOC(score);
+
+		score->src = s;
+		score->similarity = (uint16_t)result;
+
+		if (++tried_srcs >= scoring->num_srcs)
+			break;
+
+		/* cap on maximum targets we'll examine (per "tgt" file) */
+		if (tried_srcs > scoring->opts->rename_limit)
+			break;
+	}
+
+	return 0;
+}
+
+static int rename_scoring_run(diff_rename_scoring *scoring)
+{
+	size_t nthreads = 1;
+	int error;
+
+	if (scoring->preloaded) {
+		nthreads = min(scoring->files.size / DIFF_RENAME_THREAD_COST + 1,
+			(size_t)git_online_cpus());
+
+		if ((error = git_parallel_foreach(scoring->files.size, nthreads,
+				rename_scoring_load_cb, scoring)) < 0)
+			return error;
+	}
+
+	/*
+	 * With more sources than the rename limit, only compare the pairs
+	 * that share a key (see `rename_candidates_init`) instead of the
+	 * first sources up to the limit.
+	 */
+	if (scoring->preloaded &&
+	    scoring->num_srcs > scoring->opts->rename_limit) {
+		if ((error = rename_candidates_init(scoring->candidates,
+				scoring->diff, scoring->cache)) < 0)
+			return error;
+	} else {
+		scoring->candidates = NULL;
+	}
+
+	if (scoring->preloaded)
+		nthreads = min(scoring->targets.size / DIFF_RENAME_THREAD_COST + 1,
+			(size_t)git_online_cpus());
+
+	return git_parallel_foreach(scoring->targets.size, nthreads,
+		rename_scoring_target_cb, scoring);
+}
+
 int git_diff_find_similar(
 	git_diff *diff,
 	const git_diff_find_options *given_opts)
 {
 	size_t s, t;
-	int error = 0, result;
+	int error = 0;
 	uint16_t similarity;
 	git_diff_delta *src, *tgt;
 	git_diff_find_options opts = GIT_DIFF_FIND_OPTIONS_INIT;
 	size_t num_deltas, num_srcs = 0, num_tgts = 0;
-	size_t tried_srcs = 0, tried_tgts = 0;
+	size_t tried_tgts = 0;
 	size_t num_rewrites = 0, num_updates = 0, num_bumped = 0;
-	size_t sigcache_size;
+	size_t sigcache_size, c;
 	void **sigcache = NULL; /* cache of similarity metric file signatures */
+	diff_rename_candidates candidates = {0};
+	diff_rename_scoring scoring = {0};
+	diff_rename_score *score;
 	diff_find_match *tgt2src = NULL;
 	diff_find_match *src2tgt = NULL;
 	diff_find_match *tgt2src_copy = NULL;
@@ -864,6 +1300,38 @@ int git_diff_find_similar(
 		GIT_ERROR_CHECK_ALLOC(tgt2src_copy);
 	}
 
+	/*
+	 * Score the rename candidates; only the builtin metric is known to
+	 * be safe to use from several threads.
+	 */
+	scoring.diff = diff;
+	scoring.opts = &opts;
+	scoring.cache = sigcache;
+	scoring.num_srcs = num_srcs;
+	scoring.candidates = &candidates;
+	scoring.preloaded =
+		opts.metric->buffer_signature == git_diff_find_similar__hashsig_for_buf &&
+		!FLAG_SET(&opts, GIT_DIFF_FIND_EXACT_MATCH_ONLY);
+
+	if ((scoring.scores = git__calloc(num_deltas, sizeof(diff_rename_scores))) == NULL) {
+		error = -1;
+		goto cleanup;
+	}
+
+	git_vector_foreach(&diff->deltas, t, tgt) {
+		if ((tgt->flags & GIT_DIFF_FLAG__IS_RENAME_SOURCE) != 0 &&
+		    (error = rename_index_add(&scoring.files, 2 * t)) < 0)
+			goto cleanup;
+
+		if ((tgt->flags & GIT_DIFF_FLAG__IS_RENAME_TARGET) != 0 &&
+		    ((error = rename_index_add(&scoring.files, 2 * t + 1)) < 0 ||
+		     (error = rename_index_add(&scoring.targets, t)) < 0))
+			goto cleanup;
+	}
+
+	if ((error = rename_scoring_run(&scoring)) < 0)
+		goto cleanup;
+
 	/*
 	 * Find best-fit matches for rename / copy candidates
 	 */
@@ -876,23 +1344,9 @@ find_best_matches:
 		if ((tgt->flags & GIT_DIFF_FLAG__IS_RENAME_TARGET) == 0)
 			continue;
 
-		tried_srcs = 0;
-
-		git_vector_foreach(&diff->deltas, s, src) {
-			/* skip things that are not rename sources */
-			if ((src->flags & GIT_DIFF_FLAG__IS_RENAME_SOURCE) == 0)
-				continue;
-
-			/* calculate similarity for this pair and find best match */
-			if (s == t)
-				result = -1; /* don't measure self-similarity here */
-			else if ((error = similarity_measure(
-				&result, diff, &opts, sigcache, 2 * s, 2 * t + 1)) < 0)
-				goto cleanup;
-
-			if (result < 0)
-				continue;
-			similarity = (uint16_t)result;
+		git_array_foreach(scoring.scores[t], c, score) {
+			s = score->src;
+			similarity = score->similarity;
 
 			/* is this a better rename? */
 			if (tgt2src[t].similarity < similarity &&
@@ -922,13 +1376,6 @@ find_best_matches:
 				tgt2src_copy[t].idx = s;
 				tgt2src_copy[t].similarity = similarity;
 			}
-
-			if (++tried_srcs >= num_srcs)
-				break;
-
-			/* cap on maximum targets we'll examine (per "tgt" file) */
-			if (tried_srcs > opts.rename_limit)
-				break;
 		}
 
 		if (++tried_tgts >= num_tgts)
@@ -1101,6 +1548,16 @@ cleanup:
 	git__free(tgt2src);
 	git__free(src2tgt);
 	git__free(tgt2src_copy);
+	rename_candidates_free(&candidates);
+
+	if (scoring.scores) {
+		for (t = 0; t < num_deltas; ++t)
+			git_array_clear(scoring.scores[t]);
+		git__free(scoring.scores);
+	}
+
+	git_array_clear(scoring.files);
+	git_array_clear(scoring.targets);
 
 	if (sigcache) {
 		for (t = 0; t < num_deltas * 2; ++t) {
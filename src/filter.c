@@ -631,6 +631,39 @@ int git_filter_list_contains(
 	return 0;
 }
 
+static bool filter_is_builtin(const git_filter *filter)
+{
+	const char *builtins[] = { GIT_FILTER_CRLF, GIT_FILTER_IDENT };
+	git_filter_def *fdef;
+	size_t i, pos;
+
+	for (i = 0; i < ARRAY_SIZE(builtins); i++) {
+		if ((fdef = filter_registry_lookup(&pos, builtins[i])) != NULL &&
+		    fdef->filter == filter)
+			return true;
+	}
+
+	return false;
+}
+
+bool git_filter_list__builtin_only(git_filter_list *fl)
+{
+	bool builtin = true;
+	size_t i;
+
+	if (!fl || !fl->filters.size)
+		return true;
+
+	if (git_rwlock_rdlock(&filter_registry.lock) < 0)
+		return false;
+
+	for (i = 0; builtin && i < fl->filters.size; i++)
+		builtin = filter_is_builtin(fl->filters.ptr[i].filter);
+
+	git_rwlock_rdunlock(&filter_registry.lock);
+	return builtin;
+}
+
 int git_filter_list_push(
 	git_filter_list *fl, git_filter *filter, void *payload)
 {
@@ -35,6 +35,13 @@ extern int git_filter_list__load_ext(
 	git_filter_mode_t mode,
 	git_filter_options *filter_opts);
 
+/*
+ * Whether a filter list only holds the builtin filters, which may be
+ * applied from several threads at once; custom filters are only ever
+ * applied from one thread at a time unless the caller opts in.
+ */
+extern bool git_filter_list__builtin_only(git_filter_list *filters);
+
 /*
  * Available filters
  */
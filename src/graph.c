@@ -9,6 +9,8 @@
 
 #include "revwalk.h"
 #include "merge.h"
+#include "oidmap.h"
+#include "pool.h"
 #include "git2/graph.h"
 
 static int interesting(git_pqueue *list, git_commit_list *roots)
@@ -174,21 +176,425 @@ on_error:
 	return -1;
 }
 
+/*
+ * Ahead/behind counts for many local commits against one upstream are
+ * computed in a single walk: every commit that we visit gets a bitset of
+ * the inputs that can reach it, with bit 0 for the upstream and bit
+ * `i + 1` for `locals[i]`.  Once every queued commit is reachable from all
+ * of the inputs, none of their ancestors can change any of the counts.
+ */
+typedef struct {
+	git_revwalk *walk;
+	git_oidmap *bitsets;
+	git_pool pool;
+	git_vector visited;
+	git_pqueue queue;
+	size_t nbits;
+	size_t words;
+	size_t partial; /* queued commits not reachable from every input */
+	bool use_generations;
+} ahead_behind_many;
+
+#define BITSET_WORD(bit) ((bit) / 64)
+#define BITSET_MASK(bit) ((uint64_t)1 << ((bit) % 64))
+
+static bool bitset_full(ahead_behind_many *abm, const uint64_t *bits)
+{
+	size_t i, rem = abm->nbits % 64;
+
+	for (i = 0; i < abm->nbits / 64; i++)
+		if (bits[i] != UINT64_MAX)
+			return false;
+
+	return !rem || bits[i] == (BITSET_MASK(rem) - 1);
+}
+
+static bool bitset_merge(ahead_behind_many *abm, uint64_t *dst, const uint64_t *src)
+{
+	bool changed = false;
+	size_t i;
+
+	for (i = 0; i < abm->words; i++) {
+		if ((dst[i] | src[i]) != dst[i]) {
+			dst[i] |= src[i];
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+static int bitset_get(
+	uint64_t **out, ahead_behind_many *abm, git_commit_list_node *commit)
+{
+	uint64_t *bits;
+
+	if ((bits = git_oidmap_get(abm->bitsets, &commit->oid)) == NULL) {
+		if ((bits = git_pool_mallocz(&abm->pool, 1)) == NULL ||
+		    git_oidmap_set(abm->bitsets, &commit->oid, bits) < 0 ||
+		    git_vector_insert(&abm->visited, bits) < 0)
+			return -1;
+	}
+
+	*out = bits;
+	return 0;
+}
+
+static int ahead_behind_many_enqueue(
+	ahead_behind_many *abm, git_commit_list_node *commit, const uint64_t *bits)
+{
+	uint32_t generation;
+	int error;
+
+	if ((error = git_commit_list_parse(abm->walk, commit)) < 0)
+		return error;
+
+	if (abm->use_generations &&
+	    (error = git_commit_list_generation(&generation, abm->walk, commit)) < 0)
+		return error;
+
+	if ((error = git_pqueue_insert(&abm->queue, commit)) < 0)
+		return error;
+
+	commit->flags |= RESULT;
+
+	if (!bitset_full(abm, bits))
+		abm->partial++;
+
+	return 0;
+}
+
+static int ahead_behind_many_walk(ahead_behind_many *abm)
+{
+	git_commit_list_node *commit, *parent;
+	uint64_t *bits, *parent_bits;
+	bool was_full, changed;
+	unsigned int i;
+	int error;
+
+	while (abm->partial && (commit = git_pqueue_pop(&abm->queue)) != NULL) {
+		commit->flags &= ~RESULT;
+
+		if ((error = bitset_get(&bits, abm, commit)) < 0)
+			return error;
+
+		if (!bitset_full(abm, bits))
+			abm->partial--;
+
+		for (i = 0; i < commit->out_degree; i++) {
+			parent = commit->parents[i];
+
+			if ((error = bitset_get(&parent_bits, abm, parent)) < 0)
+				return error;
+
+			was_full = bitset_full(abm, parent_bits);
+			changed = bitset_merge(abm, parent_bits, bits);
+
+			/*
+			 * A parent that is already queued will pass on its new
+			 * bits when it is popped; one that was already walked
+			 * (when commit dates are skewed) has to be walked again.
+			 */
+			if (parent->flags & RESULT) {
+				if (!was_full && bitset_full(abm, parent_bits))
+					abm->partial--;
+			} else if (changed) {
+				if ((error = ahead_behind_many_enqueue(abm, parent, parent_bits)) < 0)
+					return error;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void ahead_behind_many_count(
+	size_t *ahead, size_t *behind, ahead_behind_many *abm)
+{
+	uint64_t *bits, word;
+	size_t i, j, bit;
+
+	git_vector_foreach(&abm->visited, i, bits) {
+		bool upstream = (bits[0] & 1);
+
+		if (bitset_full(abm, bits))
+			continue;
+
+		/*
+		 * A commit reachable from the upstream is behind for every
+		 * local commit that does not reach it; otherwise it is ahead
+		 * for every local commit that does.
+		 */
+		for (j = 0; j < abm->words; j++) {
+			word = upstream ? ~bits[j] : bits[j];
+
+			if (j == abm->words - 1 && abm->nbits % 64)
+				word &= BITSET_MASK(abm->nbits % 64) - 1;
+
+			for (bit = j * 64; word; bit++, word >>= 1) {
+				if (!(word & 1) || bit == 0)
+					continue;
+
+				if (upstream)
+					behind[bit - 1]++;
+				else
+					ahead[bit - 1]++;
+			}
+		}
+	}
+}
+
+int git_graph_ahead_behind_many(
+	size_t *ahead,
+	size_t *behind,
+	git_repository *repo,
+	const git_oid *locals,
+	size_t locals_len,
+	const git_oid *upstream)
+{
+	ahead_behind_many abm = {0};
+	git_commit_list_node *commit;
+	uint64_t *bits;
+	uint32_t generation;
+	size_t i;
+	int error;
+
+	assert(repo && upstream);
+	assert((ahead && behind && locals) || !locals_len);
+
+	if (!locals_len)
+		return 0;
+
+	memset(ahead, 0, locals_len * sizeof(size_t));
+	memset(behind, 0, locals_len * sizeof(size_t));
+
+	GIT_ERROR_CHECK_ALLOC_ADD(&abm.nbits, locals_len, 1);
+	abm.words = (abm.nbits + 63) / 64;
+
+	if ((error = git_revwalk_new(&abm.walk, repo)) < 0 ||
+	    (error = git_oidmap_new(&abm.bitsets)) < 0 ||
+	    (error = git_pool_init(&abm.pool, abm.words * sizeof(uint64_t))) < 0 ||
+	    (error = git_vector_init(&abm.visited, 0, NULL)) < 0)
+		goto done;
+
+	/*
+	 * Visit commits in generation order when we can, so that every
+	 * commit is walked only once, after all of its descendants.
+	 */
+	if ((commit = git_revwalk__commit_lookup(abm.walk, upstream)) == NULL) {
+		error = -1;
+		goto done;
+	}
+
+	if ((error = git_commit_list_generation(&generation, abm.walk, commit)) < 0)
+		goto done;
+
+	abm.use_generations = (generation != 0);
+
+	if ((error = git_pqueue_init(&abm.queue, 0, abm.nbits, abm.use_generations ?
+			git_commit_list_generation_cmp : git_commit_list_time_cmp)) < 0)
+		goto done;
+
+	for (i = 0; i < abm.nbits; i++) {
+		const git_oid *id = i ? &locals[i - 1] : upstream;
+
+		if ((commit = git_revwalk__commit_lookup(abm.walk, id)) == NULL) {
+			error = -1;
+			goto done;
+		}
+
+		if ((error = bitset_get(&bits, &abm, commit)) < 0)
+			goto done;
+
+		bits[BITSET_WORD(i)] |= BITSET_MASK(i);
+	}
+
+	/* queue the inputs once all of their own bits are known */
+	for (i = 0; i < abm.nbits; i++) {
+		const git_oid *id = i ? &locals[i - 1] : upstream;
+
+		commit = git_revwalk__commit_lookup(abm.walk, id);
+
+		if (commit->flags & RESULT)
+			continue;
+
+		if ((error = bitset_get(&bits, &abm, commit)) < 0 ||
+		    (error = ahead_behind_many_enqueue(&abm, commit, bits)) < 0)
+			goto done;
+	}
+
+	if ((error = ahead_behind_many_walk(&abm)) < 0)
+		goto done;
+
+	ahead_behind_many_count(ahead, behind, &abm);
+
+done:
+	git_pqueue_free(&abm.queue);
+	git_vector_free(&abm.visited);
+	git_pool_clear(&abm.pool);
+	git_oidmap_free(abm.bitsets);
+	git_revwalk_free(abm.walk);
+	return error;
+}
+
 int git_graph_descendant_of(git_repository *repo, const git_oid *commit, const git_oid *ancestor)
 {
-	git_oid merge_base;
+	git_revwalk *walk;
+	git_commit_list_node *commit_node, *ancestor_node;
 	int error;
 
 	if (git_oid_equal(commit, ancestor))
 		return 0;
 
-	error = git_merge_base(&merge_base, repo, commit, ancestor);
-	/* No merge-base found, it's not a descendant */
-	if (error == GIT_ENOTFOUND)
+	if ((error = git_revwalk_new(&walk, repo)) < 0)
+		return error;
+
+	if ((commit_node = git_revwalk__commit_lookup(walk, commit)) == NULL ||
+	    (ancestor_node = git_revwalk__commit_lookup(walk, ancestor)) == NULL) {
+		error = -1;
+		goto done;
+	}
+
+	error = git_merge__descendant_of(walk, commit_node, ancestor_node);
+
+done:
+	git_revwalk_free(walk);
+	return error;
+}
+
+/*
+ * Paint the history of the tips, stopping once every one of the commits
+ * has been reached.  When generation numbers are stored, history below
+ * the lowest generation of the commits is never walked, since it cannot
+ * reach any of them.  Commit dates cannot be trusted in the same way
+ * (clocks are skewed and history is rewritten with old dates), so
+ * without generation numbers the whole history may be walked.
+ */
+int git_graph_reachable_from_any(
+	int *reachable,
+	git_repository *repo,
+	const git_oid *commits,
+	size_t commits_len,
+	const git_oid *tips,
+	size_t tips_len)
+{
+	git_revwalk *walk = NULL;
+	git_commit_list_node *commit, *parent;
+	git_pqueue queue = GIT_VECTOR_INIT;
+	uint32_t generation, min_generation = UINT32_MAX;
+	size_t i, targets = 0, found = 0;
+	unsigned int p;
+	bool use_generations = true;
+	int error;
+
+	assert(repo);
+	assert((reachable && commits) || !commits_len);
+	assert(tips || !tips_len);
+
+	if (!commits_len)
 		return 0;
 
-	if (error < 0)
+	memset(reachable, 0, commits_len * sizeof(int));
+
+	if ((error = git_revwalk_new(&walk, repo)) < 0)
 		return error;
 
-	return git_oid_equal(&merge_base, ancestor);
+	for (i = 0; i < commits_len; i++) {
+		if ((commit = git_revwalk__commit_lookup(walk, &commits[i])) == NULL) {
+			error = -1;
+			goto done;
+		}
+
+		if (commit->flags & PARENT2)
+			continue;
+
+		if ((error = git_commit_list_parse(walk, commit)) < 0 ||
+		    (error = git_commit_list_generation(&generation, walk, commit)) < 0)
+			goto done;
+
+		if (!generation)
+			use_generations = false;
+		else if (generation < min_generation)
+			min_generation = generation;
+
+		commit->flags |= PARENT2;
+		targets++;
+	}
+
+	for (i = 0; use_generations && i < tips_len; i++) {
+		if ((commit = git_revwalk__commit_lookup(walk, &tips[i])) == NULL) {
+			error = -1;
+			goto done;
+		}
+
+		if ((error = git_commit_list_parse(walk, commit)) < 0 ||
+		    (error = git_commit_list_generation(&generation, walk, commit)) < 0)
+			goto done;
+
+		if (!generation)
+			use_generations = false;
+	}
+
+	if ((error = git_pqueue_init(&queue, 0, tips_len, use_generations ?
+			git_commit_list_generation_cmp : git_commit_list_time_cmp)) < 0)
+		goto done;
+
+	for (i = 0; i < tips_len; i++) {
+		if ((commit = git_revwalk__commit_lookup(walk, &tips[i])) == NULL) {
+			error = -1;
+			goto done;
+		}
+
+		if (commit->flags & PARENT1)
+			continue;
+
+		if ((error = git_commit_list_parse(walk, commit)) < 0)
+			goto done;
+
+		commit->flags |= PARENT1;
+
+		if (commit->flags & PARENT2)
+			found++;
+
+		if ((error = git_pqueue_insert(&queue, commit)) < 0)
+			goto done;
+	}
+
+	while (found < targets && (commit = git_pqueue_pop(&queue)) != NULL) {
+		for (p = 0; p < commit->out_degree; p++) {
+			parent = commit->parents[p];
+
+			if (parent->flags & PARENT1)
+				continue;
+
+			if ((error = git_commit_list_parse(walk, parent)) < 0)
+				goto done;
+
+			if (use_generations) {
+				if ((error = git_commit_list_generation(&generation, walk, parent)) < 0)
+					goto done;
+
+				if (generation < min_generation)
+					continue;
+			}
+
+			parent->flags |= PARENT1;
+
+			if (parent->flags & PARENT2)
+				found++;
+
+			if ((error = git_pqueue_insert(&queue, parent)) < 0)
+				goto done;
+		}
+	}
+
+	for (i = 0; i < commits_len; i++) {
+		commit = git_revwalk__commit_lookup(walk, &commits[i]);
+		reachable[i] = (commit->flags & PARENT1) ? 1 : 0;
+	}
+
+done:
+	git_pqueue_free(&queue);
+	git_revwalk_free(walk);
+	return error;
 }
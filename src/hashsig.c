@@ -5,9 +5,8 @@
  * a Linking Exception. For full terms see the included COPYING file.
  */
 
-#include "common.h"
+#include "hashsig.h"
 
-#include "git2/sys/hashsig.h"
 #include "futils.h"
 #include "util.h"
 
@@ -66,11 +65,21 @@ static int hashsig_cmp_min(const void *a, const void *b, void *payload)
 	return (av > bv) ? -1 : (av < bv) ? 1 : 0;
 }
 
+/* the same as the heap's comparison function, without the indirect call */
+GIT_INLINE(int) hashsig_heap_cmp(
+	const hashsig_heap *h, hashsig_t av, hashsig_t bv)
+{
+	if (h->cmp == hashsig_cmp_min)
+		return (av > bv) ? -1 : (av < bv) ? 1 : 0;
+	else
+		return (av < bv) ? -1 : (av > bv) ? 1 : 0;
+}
+
 static void hashsig_heap_up(hashsig_heap *h, int el)
 {
 	int parent_el = HEAP_PARENT_OF(el);
 
-	while (el > 0 && h->cmp(&h->values[parent_el], &h->values[el], NULL) > 0) {
+	while (el > 0 && hashsig_heap_cmp(h, h->values[parent_el], h->values[el]) > 0) {
 		hashsig_t t = h->values[el];
 		h->values[el] = h->values[parent_el];
 		h->values[parent_el] = t;
@@ -93,10 +102,10 @@ static void hashsig_heap_down(hashsig_heap *h, int el)
 		lv = h->values[lel];
 		rv = h->values[rel];
 
-		if (h->cmp(&v, &lv, NULL) < 0 && h->cmp(&v, &rv, NULL) < 0)
+		if (hashsig_heap_cmp(h, v, lv) < 0 && hashsig_heap_cmp(h, v, rv) < 0)
 			break;
 
-		swapel = (h->cmp(&lv, &rv, NULL) < 0) ? lel : rel;
+		swapel = (hashsig_heap_cmp(h, lv, rv) < 0) ? lel : rel;
 
 		h->values[el] = h->values[swapel];
 		h->values[swapel] = v;
@@ -120,7 +129,7 @@ static void hashsig_heap_insert(hashsig_heap *h, hashsig_t val)
 	}
 
 	/* if heap is full, pop top if new element should replace it */
-	else if (h->cmp(&val, &h->values[0], NULL) > 0) {
+	else if (hashsig_heap_cmp(h, val, h->values[0]) > 0) {
 		h->size--;
 		h->values[0] = h->values[h->size];
 		hashsig_heap_down(h, 0);
@@ -128,9 +137,22 @@ static void hashsig_heap_insert(hashsig_heap *h, hashsig_t val)
 
 }
 
+/*
+ * How each character is treated while hashing: most characters are part
+ * of the hashed run, newlines and NULs end the run (and the line), and,
+ * depending on the whitespace options, some whitespace is skipped either
+ * everywhere or only at the start of a line.
+ */
+enum {
+	HASHSIG_CH_HASH = 0,
+	HASHSIG_CH_TERM,
+	HASHSIG_CH_SKIP,
+	HASHSIG_CH_LEADING,
+};
+
 typedef struct {
 	int use_ignores;
-	uint8_t ignore_ch[256];
+	uint8_t ch_class[256];
 } hashsig_in_progress;
 
 static void hashsig_in_progress_init(
@@ -142,27 +164,91 @@ static void hashsig_in_progress_init(
 	assert(!(sig->opt & GIT_HASHSIG_IGNORE_WHITESPACE) ||
 		   !(sig->opt & GIT_HASHSIG_SMART_WHITESPACE));
 
+	memset(prog, 0, sizeof(*prog));
+
+	prog->ch_class['\n'] = HASHSIG_CH_TERM;
+	prog->ch_class['\0'] = HASHSIG_CH_TERM;
+
 	if (sig->opt & GIT_HASHSIG_IGNORE_WHITESPACE) {
 		for (i = 0; i < 256; ++i)
-			prog->ignore_ch[i] = git__isspace_nonlf(i);
+			if (git__isspace_nonlf(i))
+				prog->ch_class[i] = HASHSIG_CH_SKIP;
 		prog->use_ignores = 1;
 	} else if (sig->opt & GIT_HASHSIG_SMART_WHITESPACE) {
 		for (i = 0; i < 256; ++i)
-			prog->ignore_ch[i] = git__isspace(i);
+			if (git__isspace_nonlf(i))
+				prog->ch_class[i] = HASHSIG_CH_LEADING;
+		prog->ch_class['\r'] = HASHSIG_CH_SKIP;
 		prog->use_ignores = 1;
-	} else {
-		memset(prog, 0, sizeof(*prog));
 	}
 }
 
+/*
+ * Rather than look at the data a byte at a time, look at it eight bytes
+ * at a time and hash whole words that do not contain any character that
+ * needs special treatment.  These test whether any byte of a word is
+ * zero, equal to a given value, or less than a given value (<= 128).
+ */
+#define HASHSIG_WORD_ONES  0x0101010101010101ULL
+#define HASHSIG_WORD_HIGHS 0x8080808080808080ULL
+
+#define HASHSIG_WORD_HAS_LESS(W,N) \
+	(((W) - HASHSIG_WORD_ONES * (N)) & ~(W) & HASHSIG_WORD_HIGHS)
+#define HASHSIG_WORD_HAS_ZERO(W) HASHSIG_WORD_HAS_LESS(W, 1)
+#define HASHSIG_WORD_HAS_BYTE(W,C) \
+	HASHSIG_WORD_HAS_ZERO((W) ^ (HASHSIG_WORD_ONES * (C)))
+
+/* powers of the hash multiplier, to mix eight characters in one step */
+#define HASHSIG_MIX_POW2 961ULL
+#define HASHSIG_MIX_POW3 29791ULL
+#define HASHSIG_MIX_POW4 923521ULL
+#define HASHSIG_MIX_POW5 28629151ULL
+#define HASHSIG_MIX_POW6 887503681ULL
+#define HASHSIG_MIX_POW7 27512614111ULL
+#define HASHSIG_MIX_POW8 852891037441ULL
+
+GIT_INLINE(bool) hashsig_word_is_plain(
+	const uint8_t *scan, git_hashsig_option_t opt, int use_ignores)
+{
+	uint64_t w;
+
+	memcpy(&w, scan, sizeof(w));
+
+	if (opt & GIT_HASHSIG_IGNORE_WHITESPACE)
+		return !HASHSIG_WORD_HAS_LESS(w, ' ' + 1);
+
+	if (opt & GIT_HASHSIG_SMART_WHITESPACE) {
+		if (use_ignores)
+			return false;
+
+		return !(HASHSIG_WORD_HAS_ZERO(w) |
+			HASHSIG_WORD_HAS_BYTE(w, '\n') |
+			HASHSIG_WORD_HAS_BYTE(w, '\r'));
+	}
+
+	return !(HASHSIG_WORD_HAS_ZERO(w) | HASHSIG_WORD_HAS_BYTE(w, '\n'));
+}
+
+GIT_INLINE(hashsig_state) hashsig_mix_word(
+	hashsig_state state, const uint8_t *scan)
+{
+	/* the same as HASHSIG_HASH_MIX on each of the eight characters */
+	return state * HASHSIG_MIX_POW8 +
+		scan[0] * HASHSIG_MIX_POW7 + scan[1] * HASHSIG_MIX_POW6 +
+		scan[2] * HASHSIG_MIX_POW5 + scan[3] * HASHSIG_MIX_POW4 +
+		scan[4] * HASHSIG_MIX_POW3 + scan[5] * HASHSIG_MIX_POW2 +
+		scan[6] * (hashsig_state)31 + scan[7];
+}
+
 static int hashsig_add_hashes(
 	git_hashsig *sig,
 	const uint8_t *data,
 	size_t size,
 	hashsig_in_progress *prog)
 {
-	const uint8_t *scan = data, *end = data + size;
-	hashsig_state state = HASHSIG_HASH_START;
+	const uint8_t *scan = data, *end = data + size, *next_word = data;
+	const uint8_t *ch_class = prog->ch_class;
+	hashsig_state state;
 	int use_ignores = prog->use_ignores, len;
 	uint8_t ch;
 
@@ -170,34 +256,42 @@ static int hashsig_add_hashes(
 		state = HASHSIG_HASH_START;
 
 		for (len = 0; scan < end && len < HASHSIG_MAX_RUN; ) {
-			ch = *scan;
-
-			if (use_ignores)
-				for (; scan < end && git__isspace_nonlf(ch); ch = *scan)
-					++scan;
-			else if (sig->opt &
-					 (GIT_HASHSIG_IGNORE_WHITESPACE | GIT_HASHSIG_SMART_WHITESPACE))
-				for (; scan < end && ch == '\r'; ch = *scan)
-					++scan;
-
-			/* peek at next character to decide what to do next */
-			if (sig->opt & GIT_HASHSIG_SMART_WHITESPACE)
-				use_ignores = (ch == '\n');
+			if (scan >= next_word && end - scan >= 8 &&
+			    len <= HASHSIG_MAX_RUN - 8) {
+				if (hashsig_word_is_plain(scan, sig->opt, use_ignores)) {
+					state = hashsig_mix_word(state, scan);
+					scan += 8;
+					len += 8;
+					use_ignores = 0;
+					continue;
+				}
+
+				/* look at this word a character at a time */
+				next_word = scan + 8;
+			}
 
-			if (scan >= end)
-				break;
-			++scan;
+			ch = *scan++;
 
-			/* check run terminator */
-			if (ch == '\n' || ch == '\0') {
-				sig->lines++;
+			switch (ch_class[ch]) {
+			case HASHSIG_CH_SKIP:
+				continue;
+			case HASHSIG_CH_LEADING:
+				if (use_ignores)
+					continue;
 				break;
+			case HASHSIG_CH_TERM:
+				/* whitespace is ignored again at the start of a line */
+				use_ignores = (ch == '\n');
+				sig->lines++;
+				goto run_done;
 			}
 
+			use_ignores = 0;
 			++len;
 			HASHSIG_HASH_MIX(state, ch);
 		}
 
+run_done:
 		if (len > 0) {
 			hashsig_heap_insert(&sig->mins, (hashsig_t)state);
 			hashsig_heap_insert(&sig->maxs, (hashsig_t)state);
@@ -323,7 +417,7 @@ static int hashsig_heap_compare(const hashsig_heap *a, const hashsig_heap *b)
 	/* hash heaps are sorted - just look for overlap vs total */
 
 	for (i = 0, j = 0; i < a->size && j < b->size; ) {
-		cmp = a->cmp(&a->values[i], &b->values[j], NULL);
+		cmp = hashsig_heap_cmp(a, a->values[i], b->values[j]);
 
 		if (cmp < 0)
 			++i;
@@ -360,3 +454,129 @@ int git_hashsig_compare(const git_hashsig *a, const git_hashsig *b)
 		return (hashsig_heap_compare(&a->mins, &b->mins) +
 				hashsig_heap_compare(&a->maxs, &b->maxs)) / 2;
 }
+
+size_t git_hashsig__extremes(
+	uint32_t *out, size_t n, const git_hashsig *sig)
+{
+	size_t i, count = 0;
+
+	/* both heaps are sorted with their most extreme values last */
+	for (i = 0; i < n && i < (size_t)sig->mins.size; i++)
+		out[count++] = sig->mins.values[sig->mins.size - i - 1];
+
+	for (i = 0; i < n && i < (size_t)sig->maxs.size; i++)
+		out[count++] = sig->maxs.values[sig->maxs.size - i - 1];
+
+	return count;
+}
+
+/*
+ * A serialized signature is a header, followed by the values of the
+ * "mins" heap and then those of the "maxs" heap, in the sorted order of
+ * a finalized signature.  All numbers are in network byte order.
+ */
+#define HASHSIG_SERIALIZED_VERSION 1
+
+struct hashsig_serialized_header {
+	uint32_t version;
+	uint32_t opt;
+	uint32_t lines_hi;
+	uint32_t lines_lo;
+	uint32_t mins_size;
+	uint32_t maxs_size;
+};
+
+int git_hashsig__serialize(git_buf *out, const git_hashsig *sig)
+{
+	struct hashsig_serialized_header hdr;
+	uint64_t lines = (uint64_t)sig->lines;
+	uint32_t value;
+	int i;
+
+	hdr.version = htonl(HASHSIG_SERIALIZED_VERSION);
+	hdr.opt = htonl((uint32_t)sig->opt);
+	hdr.lines_hi = htonl((uint32_t)(lines >> 32));
+	hdr.lines_lo = htonl((uint32_t)(lines & 0xffffffff));
+	hdr.mins_size = htonl((uint32_t)sig->mins.size);
+	hdr.maxs_size = htonl((uint32_t)sig->maxs.size);
+
+	if (git_buf_put(out, (const char *)&hdr, sizeof(hdr)) < 0)
+		return -1;
+
+	for (i = 0; i < sig->mins.size; i++) {
+		value = htonl(sig->mins.values[i]);
+		git_buf_put(out, (const char *)&value, sizeof(value));
+	}
+
+	for (i = 0; i < sig->maxs.size; i++) {
+		value = htonl(sig->maxs.values[i]);
+		git_buf_put(out, (const char *)&value, sizeof(value));
+	}
+
+	return git_buf_oom(out) ? -1 : 0;
+}
+
+static int hashsig_parse_heap(
+	hashsig_heap *h, uint32_t size, const char **data)
+{
+	uint32_t value;
+	uint32_t i;
+
+	if (size > (uint32_t)h->asize)
+		return -1;
+
+	for (i = 0; i < size; i++) {
+		memcpy(&value, *data, sizeof(value));
+		h->values[i] = ntohl(value);
+		*data += sizeof(value);
+	}
+
+	h->size = (int)size;
+	return 0;
+}
+
+int git_hashsig__parse(git_hashsig **out, const char *data, size_t len)
+{
+	struct hashsig_serialized_header hdr;
+	git_hashsig *sig = NULL;
+	uint32_t mins_size, maxs_size;
+	uint64_t lines;
+
+	if (len < sizeof(hdr))
+		goto corrupt;
+
+	memcpy(&hdr, data, sizeof(hdr));
+	data += sizeof(hdr);
+
+	mins_size = ntohl(hdr.mins_size);
+	maxs_size = ntohl(hdr.maxs_size);
+	lines = ((uint64_t)ntohl(hdr.lines_hi) << 32) | ntohl(hdr.lines_lo);
+
+	if (ntohl(hdr.version) != HASHSIG_SERIALIZED_VERSION ||
+	    mins_size > HASHSIG_HEAP_SIZE || maxs_size > HASHSIG_HEAP_SIZE ||
+	    len != sizeof(hdr) + (mins_size + maxs_size) * sizeof(hashsig_t) ||
+	    !git__is_sizet(lines))
+		goto corrupt;
+
+	sig = hashsig_alloc((git_hashsig_option_t)ntohl(hdr.opt));
+	GIT_ERROR_CHECK_ALLOC(sig);
+
+	sig->lines = (size_t)lines;
+
+	if (hashsig_parse_heap(&sig->mins, mins_size, &data) < 0 ||
+	    hashsig_parse_heap(&sig->maxs, maxs_size, &data) < 0)
+		goto corrupt;
+
+	*out = sig;
+	return 0;
+
+corrupt:
+	git_hashsig_free(sig);
+	git_error_set(GIT_ERROR_INVALID, "invalid serialized similarity signature");
+	return -1;
+}
+
+git_hashsig_option_t git_hashsig__options(const git_hashsig *sig)
+{
+	return sig->opt;
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_hashsig_h__
+#define INCLUDE_hashsig_h__
+
+#include "common.h"
+
+#include "git2/sys/hashsig.h"
+#include "buffer.h"
+
+/*
+ * Copy up to `n` of the smallest and up to `n` of the largest hashes of
+ * a signature into `out`, which must have room for `2 * n` values, and
+ * return the number of hashes copied.  Files that are similar are very
+ * likely to share some of these extremes, which makes them good keys to
+ * bucket signatures by before comparing them.
+ */
+extern size_t git_hashsig__extremes(
+	uint32_t *out, size_t n, const git_hashsig *sig);
+
+/*
+ * Serialize a signature into `out`, so that it can be stored and read
+ * back by `git_hashsig__parse` later.
+ */
+extern int git_hashsig__serialize(git_buf *out, const git_hashsig *sig);
+
+/*
+ * Read a signature serialized by `git_hashsig__serialize`.  Returns -1
+ * if the data is not a valid signature.
+ */
+extern int git_hashsig__parse(
+	git_hashsig **out, const char *data, size_t len);
+
+/* The options that a signature was created with. */
+extern git_hashsig_option_t git_hashsig__options(const git_hashsig *sig);
+
+#endif
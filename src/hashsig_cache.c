@@ -0,0 +1,355 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "hashsig_cache.h"
+
+#include "config.h"
+#include "filebuf.h"
+#include "futils.h"
+#include "path.h"
+#include "repository.h"
+#include "vector.h"
+
+/*
+ * Each signature is stored in `<dir>/<xx>/<rest of the id>-<options>`,
+ * as a header followed by the serialized signature.  Whenever a cached
+ * signature is used, its modification time is updated, so that the
+ * files of the least recently used signatures are the oldest ones.
+ *
+ * The cache is trimmed one fanout directory at a time: the size budget
+ * is split evenly between the 256 directories (object ids are uniformly
+ * distributed) and a directory is trimmed when signatures are written
+ * to it for the first time, and after every few writes after that, so
+ * that trimming never has to look at the whole cache.
+ */
+#define HASHSIG_CACHE_SIGNATURE 0x48534345 /* "HSCE" */
+#define HASHSIG_CACHE_VERSION 1
+#define HASHSIG_CACHE_FANOUT 256
+#define HASHSIG_CACHE_TRIM_INTERVAL 64
+
+struct hashsig_cache_header {
+	uint32_t signature;
+	uint32_t version;
+	uint32_t size_hi;
+	uint32_t size_lo;
+};
+
+struct git_hashsig_cache {
+	bool enabled;
+	git_buf path;
+	size_t max_size;
+
+	git_mutex lock;
+	uint32_t writes[HASHSIG_CACHE_FANOUT];
+};
+
+typedef struct {
+	char *path;
+	git_time_t mtime;
+	size_t size;
+} hashsig_cache_file;
+
+void git_hashsig_cache_free(git_hashsig_cache *cache)
+{
+	if (!cache)
+		return;
+
+	git_buf_dispose(&cache->path);
+	git_mutex_free(&cache->lock);
+	git__free(cache);
+}
+
+static int hashsig_cache_load_config(
+	git_hashsig_cache *cache, git_repository *repo)
+{
+	git_config *cfg;
+	git_buf dir = GIT_BUF_INIT, objects = GIT_BUF_INIT;
+	int max_size, error;
+
+	if ((error = git_repository_config__weakptr(&cfg, repo)) < 0)
+		return error;
+
+	if (!git_config__get_bool_force(cfg, "diff.similaritycache", 0))
+		return 0;
+
+	max_size = git_config__get_int_force(cfg, "diff.similaritycachesize",
+		GIT_HASHSIG_CACHE_DEFAULT_SIZE);
+
+	/* a relative directory is relative to the repository's common dir */
+	if ((error = git_config_get_path(&dir, cfg, "diff.similaritycachedir")) == 0)
+		error = git_path_join_unrooted(&cache->path, dir.ptr, repo->commondir, NULL);
+	else if (error == GIT_ENOTFOUND) {
+		git_error_clear();
+		error = git_buf_joinpath(&cache->path, repo->commondir, GIT_HASHSIG_CACHE_DIR);
+	}
+
+	if (error < 0 || (error = git_path_to_dir(&cache->path)) < 0 ||
+	    (error = git_repository_item_path(&objects, repo, GIT_REPOSITORY_ITEM_OBJECTS)) < 0 ||
+	    (error = git_path_to_dir(&objects)) < 0)
+		goto done;
+
+	/*
+	 * The objects directory uses the same fanout layout, and trimming
+	 * must never get close to the loose objects: leave the cache off.
+	 */
+	if (git__prefixcmp(cache->path.ptr, objects.ptr) == 0)
+		goto done;
+
+	cache->enabled = true;
+	cache->max_size = max_size > 0 ? (size_t)max_size : 0;
+
+done:
+	git_buf_dispose(&dir);
+	git_buf_dispose(&objects);
+	return error;
+}
+
+static int hashsig_cache_get(git_hashsig_cache **out, git_repository *repo)
+{
+	git_hashsig_cache *cache;
+	int error;
+
+	if ((*out = repo->hashsig_cache) != NULL)
+		return 0;
+
+	cache = git__calloc(1, sizeof(git_hashsig_cache));
+	GIT_ERROR_CHECK_ALLOC(cache);
+
+	if (git_mutex_init(&cache->lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to initialize similarity cache");
+		git__free(cache);
+		return -1;
+	}
+
+	if ((error = hashsig_cache_load_config(cache, repo)) < 0) {
+		git_hashsig_cache_free(cache);
+		return error;
+	}
+
+	*out = git__compare_and_swap(&repo->hashsig_cache, NULL, cache);
+
+	if (*out != NULL)
+		git_hashsig_cache_free(cache);
+	else
+		*out = cache;
+
+	return 0;
+}
+
+static int hashsig_cache_path(
+	git_buf *out,
+	git_hashsig_cache *cache,
+	const git_oid *id,
+	git_hashsig_option_t opts)
+{
+	char hex[GIT_OID_HEXSZ + 1];
+
+	git_oid_tostr(hex, sizeof(hex), id);
+
+	return git_buf_printf(out, "%s%.2s/%s-%x",
+		cache->path.ptr, hex, hex + 2, (unsigned int)opts);
+}
+
+int git_hashsig_cache_get(
+	git_hashsig **out,
+	git_object_size_t *size,
+	git_repository *repo,
+	const git_oid *id,
+	git_hashsig_option_t opts)
+{
+	git_hashsig_cache *cache;
+	struct hashsig_cache_header hdr;
+	git_buf path = GIT_BUF_INIT, data = GIT_BUF_INIT;
+	int error = GIT_ENOTFOUND;
+
+	*out = NULL;
+
+	if (hashsig_cache_get(&cache, repo) < 0 || !cache->enabled ||
+	    hashsig_cache_path(&path, cache, id, opts) < 0 ||
+	    git_futils_readbuffer(&data, path.ptr) < 0 ||
+	    data.size < sizeof(hdr))
+		goto done;
+
+	memcpy(&hdr, data.ptr, sizeof(hdr));
+
+	if (ntohl(hdr.signature) != HASHSIG_CACHE_SIGNATURE ||
+	    ntohl(hdr.version) != HASHSIG_CACHE_VERSION ||
+	    git_hashsig__parse(out, data.ptr + sizeof(hdr), data.size - sizeof(hdr)) < 0)
+		goto done;
+
+	if (git_hashsig__options(*out) != opts) {
+		git_hashsig_free(*out);
+		*out = NULL;
+		goto done;
+	}
+
+	*size = ((git_object_size_t)ntohl(hdr.size_hi) << 32) | ntohl(hdr.size_lo);
+
+	/* mark the signature as recently used */
+	p_utimes(path.ptr, NULL);
+	error = 0;
+
+done:
+	/* the cache is only an optimization; failing to use it is fine */
+	if (error)
+		git_error_clear();
+
+	git_buf_dispose(&path);
+	git_buf_dispose(&data);
+	return error;
+}
+
+static int hashsig_cache_file_cmp(const void *a, const void *b)
+{
+	const hashsig_cache_file *fa = a, *fb = b;
+
+	if (fa->mtime != fb->mtime)
+		return fa->mtime < fb->mtime ? -1 : 1;
+
+	return strcmp(fa->path, fb->path);
+}
+
+/*
+ * Check that a file is a cached signature before removing it: its name
+ * must be the rest of an object id and the options, and it must start
+ * with our header.  Anything else in the directory is left alone.
+ */
+static bool hashsig_cache_is_entry(const char *path)
+{
+	struct hashsig_cache_header hdr;
+	const char *name = strrchr(path, '/');
+	ssize_t read_len;
+	size_t i;
+	int fd;
+
+	name = name ? name + 1 : path;
+
+	for (i = 0; i < GIT_OID_HEXSZ - 2; i++) {
+		if (!git__isxdigit(name[i]))
+			return false;
+	}
+
+	if (name[i++] != '-' || !name[i])
+		return false;
+
+	for (; name[i]; i++) {
+		if (!git__isxdigit(name[i]))
+			return false;
+	}
+
+	if ((fd = p_open(path, O_RDONLY)) < 0)
+		return false;
+
+	read_len = p_read(fd, &hdr, sizeof(hdr));
+	p_close(fd);
+
+	return read_len == (ssize_t)sizeof(hdr) &&
+		ntohl(hdr.signature) == HASHSIG_CACHE_SIGNATURE;
+}
+
+/*
+ * Remove the least recently used signatures from a fanout directory
+ * until it is within its share of the size of the cache.
+ */
+static int hashsig_cache_trim(git_hashsig_cache *cache, unsigned int fanout)
+{
+	git_vector names = GIT_VECTOR_INIT, files = GIT_VECTOR_INIT;
+	git_buf path = GIT_BUF_INIT;
+	hashsig_cache_file *file;
+	size_t budget = cache->max_size / HASHSIG_CACHE_FANOUT, total = 0, i;
+	char *name;
+	struct stat st;
+	int error;
+
+	if ((error = git_buf_printf(&path, "%s%02x", cache->path.ptr, fanout)) < 0 ||
+	    (error = git_path_dirload(&names, path.ptr, 0, 0)) < 0 ||
+	    (error = git_vector_init(&files, names.length, hashsig_cache_file_cmp)) < 0)
+		goto done;
+
+	git_vector_foreach(&names, i, name) {
+		/* this also skips the lock files of signatures being written */
+		if (p_stat(name, &st) < 0 || !S_ISREG(st.st_mode) ||
+		    !hashsig_cache_is_entry(name))
+			continue;
+
+		file = git__malloc(sizeof(hashsig_cache_file));
+		GIT_ERROR_CHECK_ALLOC(file);
+
+		file->path = name;
+		file->mtime = st.st_mtime;
+		file->size = (size_t)st.st_size;
+		total += file->size;
+
+		if ((error = git_vector_insert(&files, file)) < 0) {
+			git__free(file);
+			goto done;
+		}
+	}
+
+	git_vector_sort(&files);
+
+	git_vector_foreach(&files, i, file) {
+		if (total <= budget)
+			break;
+
+		if (p_unlink(file->path) == 0)
+			total -= file->size;
+	}
+
+done:
+	git_vector_free_deep(&files);
+	git_vector_free_deep(&names);
+	git_buf_dispose(&path);
+	return error;
+}
+
+void git_hashsig_cache_put(
+	git_repository *repo,
+	const git_oid *id,
+	git_object_size_t size,
+	const git_hashsig *sig)
+{
+	git_hashsig_cache *cache;
+	struct hashsig_cache_header hdr;
+	git_buf path = GIT_BUF_INIT, data = GIT_BUF_INIT;
+	git_filebuf file = GIT_FILEBUF_INIT;
+	unsigned int fanout = id->id[0];
+	bool trim;
+
+	if (hashsig_cache_get(&cache, repo) < 0 || !cache->enabled)
+		goto done;
+
+	hdr.signature = htonl(HASHSIG_CACHE_SIGNATURE);
+	hdr.version = htonl(HASHSIG_CACHE_VERSION);
+	hdr.size_hi = htonl((uint32_t)(size >> 32));
+	hdr.size_lo = htonl((uint32_t)(size & 0xffffffff));
+
+	if (hashsig_cache_path(&path, cache, id, git_hashsig__options(sig)) < 0 ||
+	    git_buf_put(&data, (const char *)&hdr, sizeof(hdr)) < 0 ||
+	    git_hashsig__serialize(&data, sig) < 0 ||
+	    git_filebuf_open(&file, path.ptr, GIT_FILEBUF_CREATE_LEADING_DIRS, 0644) < 0 ||
+	    git_filebuf_write(&file, data.ptr, data.size) < 0 ||
+	    git_filebuf_commit(&file) < 0)
+		goto done;
+
+	if (git_mutex_lock(&cache->lock) < 0)
+		goto done;
+
+	trim = (cache->writes[fanout]++ % HASHSIG_CACHE_TRIM_INTERVAL) == 0;
+	git_mutex_unlock(&cache->lock);
+
+	if (trim)
+		hashsig_cache_trim(cache, fanout);
+
+done:
+	/* the cache is only an optimization; failing to update it is fine */
+	git_error_clear();
+
+	git_filebuf_cleanup(&file);
+	git_buf_dispose(&path);
+	git_buf_dispose(&data);
+}
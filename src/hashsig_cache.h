@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_hashsig_cache_h__
+#define INCLUDE_hashsig_cache_h__
+
+#include "common.h"
+
+#include "hashsig.h"
+#include "git2/oid.h"
+
+/*
+ * An optional on-disk cache of the similarity signatures of blobs, so
+ * that rename detection does not have to load and hash the same blobs
+ * again in every diff and merge.  It is enabled with the boolean
+ * `diff.similarityCache` configuration; the signatures are stored in
+ * `diff.similarityCacheDir` (by default, `similarity-cache` in the
+ * repository's common directory), one file per blob, and the least
+ * recently used ones are removed once the cache grows beyond
+ * `diff.similarityCacheSize` bytes.  Only cached signatures are ever
+ * removed, and the cache stays disabled if its directory is inside the
+ * objects directory.
+ */
+#define GIT_HASHSIG_CACHE_DIR "similarity-cache"
+#define GIT_HASHSIG_CACHE_DEFAULT_SIZE (64 * 1024 * 1024)
+
+typedef struct git_hashsig_cache git_hashsig_cache;
+
+void git_hashsig_cache_free(git_hashsig_cache *cache);
+
+/*
+ * Look up the signature of a blob, created with the given options, and
+ * the size of the blob.  Returns GIT_ENOTFOUND (without setting an
+ * error message) if it is not cached, or if the cache is not enabled.
+ */
+int git_hashsig_cache_get(
+	git_hashsig **out,
+	git_object_size_t *size,
+	git_repository *repo,
+	const git_oid *id,
+	git_hashsig_option_t opts);
+
+/*
+ * Store the signature of a blob, if the cache is enabled.  Failing to
+ * write to the cache is not an error.
+ */
+void git_hashsig_cache_put(
+	git_repository *repo,
+	const git_oid *id,
+	git_object_size_t size,
+	const git_hashsig *sig);
+
+#endif
@@ -46,6 +46,7 @@ static const unsigned int INDEX_HEADER_SIG = 0x44495243;
 static const char INDEX_EXT_TREECACHE_SIG[] = {'T', 'R', 'E', 'E'};
 static const char INDEX_EXT_UNMERGED_SIG[] = {'R', 'E', 'U', 'C'};
 static const char INDEX_EXT_CONFLICT_NAME_SIG[] = {'N', 'A', 'M', 'E'};
+static const char INDEX_EXT_SPARSE_DIRECTORIES_SIG[] = {'s', 'd', 'i', 'r'};
 
 #define INDEX_OWNER(idx) ((git_repository *)(GIT_REFCOUNT_OWNER(idx)))
 
@@ -125,6 +126,8 @@ static int write_index(git_oid *checksum, git_index *index, git_filebuf *file);
 static void index_entry_free(git_index_entry *entry);
 static void index_entry_reuc_free(git_index_reuc_entry *reuc);
 
+static int index_expand_for_path(git_index *index, const char *path);
+
 GIT_INLINE(int) index_map_set(git_idxmap *map, git_index_entry *e, bool ignore_case)
 {
 	if (ignore_case)
@@ -502,15 +505,13 @@ static void index_free_deleted(git_index *index)
 }
 
 /* call with locked index */
-static int index_remove_entry(git_index *index, size_t pos)
+static int index_drop_entry(git_index *index, size_t pos)
 {
 	int error = 0;
 	git_index_entry *entry = git_vector_get(&index->entries, pos);
 
-	if (entry != NULL) {
-		git_tree_cache_invalidate_path(index->tree, entry->path);
+	if (entry != NULL)
 		index_map_delete(index->entries_map, entry, index->ignore_case);
-	}
 
 	error = git_vector_remove(&index->entries, pos);
 
@@ -527,6 +528,17 @@ static int index_remove_entry(git_index *index, size_t pos)
 	return error;
 }
 
+/* call with locked index */
+static int index_remove_entry(git_index *index, size_t pos)
+{
+	git_index_entry *entry = git_vector_get(&index->entries, pos);
+
+	if (entry != NULL)
+		git_tree_cache_invalidate_path(index->tree, entry->path);
+
+	return index_drop_entry(index, pos);
+}
+
 int git_index_clear(git_index *index)
 {
 	int error = 0;
@@ -534,6 +546,7 @@ int git_index_clear(git_index *index)
 	assert(index);
 
 	index->dirty = 1;
+	index->sparse = 0;
 	index->tree = NULL;
 	git_pool_clear(&index->tree_pool);
 
@@ -717,6 +730,10 @@ static bool is_racy_entry(git_index *index, const git_index_entry *entry)
 	if (S_ISGITLINK(entry->mode))
 		return false;
 
+	/* Sparse directories are never in the working directory */
+	if (git_index_entry__is_sparse_dir(entry))
+		return false;
+
 	return git_index_entry_newer_than_index(entry, index);
 }
 
@@ -872,6 +889,18 @@ const git_index_entry *git_index_get_bypath(
 	else
 		value = git_idxmap_get(index->entries_map, &key);
 
+	if (!value && index->sparse) {
+		int expanded;
+
+		if ((expanded = index_expand_for_path(index, path)) < 0)
+			return NULL;
+
+		if (expanded && index->ignore_case)
+			value = git_idxmap_icase_get((git_idxmap_icase *) index->entries_map, &key);
+		else if (expanded)
+			value = git_idxmap_get(index->entries_map, &key);
+	}
+
 	if (!value) {
 	    git_error_set(GIT_ERROR_INDEX, "index does not contain '%s'", path);
 	    return NULL;
@@ -916,6 +945,27 @@ static void index_entry_adjust_namemask(
  * function will *always* prevent `.git` and directory traversal `../` from
  * being added to the index.
  */
+static int index_entry_alloc(
+	git_index_entry **out,
+	const char *path,
+	size_t pathlen)
+{
+	struct entry_internal *entry;
+	size_t alloclen;
+
+	GIT_ERROR_CHECK_ALLOC_ADD(&alloclen, sizeof(struct entry_internal), pathlen);
+	GIT_ERROR_CHECK_ALLOC_ADD(&alloclen, alloclen, 1);
+	entry = git__calloc(1, alloclen);
+	GIT_ERROR_CHECK_ALLOC(entry);
+
+	entry->pathlen = pathlen;
+	memcpy(entry->path, path, pathlen);
+	entry->entry.path = entry->path;
+
+	*out = (git_index_entry *)entry;
+	return 0;
+}
+
 static int index_entry_create(
 	git_index_entry **out,
 	git_repository *repo,
@@ -923,8 +973,7 @@ static int index_entry_create(
 	struct stat *st,
 	bool from_workdir)
 {
-	size_t pathlen = strlen(path), alloclen;
-	struct entry_internal *entry;
+	size_t pathlen = strlen(path);
 	unsigned int path_valid_flags = GIT_PATH_REJECT_INDEX_DEFAULTS;
 	uint16_t mode = 0;
 
@@ -942,16 +991,41 @@ static int index_entry_create(
 		return -1;
 	}
 
-	GIT_ERROR_CHECK_ALLOC_ADD(&alloclen, sizeof(struct entry_internal), pathlen);
-	GIT_ERROR_CHECK_ALLOC_ADD(&alloclen, alloclen, 1);
-	entry = git__calloc(1, alloclen);
-	GIT_ERROR_CHECK_ALLOC(entry);
+	return index_entry_alloc(out, path, pathlen);
+}
 
-	entry->pathlen = pathlen;
-	memcpy(entry->path, path, pathlen);
-	entry->entry.path = entry->path;
+/* Create a sparse directory entry; `path` must end in a slash. */
+static int sparse_dir_entry_create(
+	git_index_entry **out,
+	git_repository *repo,
+	const char *path,
+	size_t pathlen)
+{
+	char *dirname;
+	bool valid;
 
-	*out = (git_index_entry *)entry;
+	if (pathlen < 2 || path[pathlen - 1] != '/') {
+		git_error_set(GIT_ERROR_INDEX, "invalid sparse directory: '%s'", path);
+		return -1;
+	}
+
+	/* the trailing slash is not part of the path that we validate */
+	dirname = git__strndup(path, pathlen - 1);
+	GIT_ERROR_CHECK_ALLOC(dirname);
+
+	valid = git_path_isvalid(repo, dirname, S_IFDIR, GIT_PATH_REJECT_INDEX_DEFAULTS);
+	git__free(dirname);
+
+	if (!valid) {
+		git_error_set(GIT_ERROR_INDEX, "invalid path: '%s'", path);
+		return -1;
+	}
+
+	if (index_entry_alloc(out, path, pathlen) < 0)
+		return -1;
+
+	(*out)->mode = GIT_FILEMODE_TREE;
+	(*out)->flags_extended = GIT_INDEX_ENTRY_SKIP_WORKTREE;
 	return 0;
 }
 
@@ -1105,6 +1179,312 @@ static int index_entry_dup_nocache(
 	return 0;
 }
 
+/*
+ * Sparse directories: an index may store an out-of-cone directory as a
+ * single entry for its tree.  These entries are expanded lazily, only
+ * once an operation needs to look at a path inside of them.
+ */
+
+typedef struct {
+	git_index *index;
+	const char *prefix;
+	git_vector *entries;
+	git_buf path;
+} expand_sparse_data;
+
+static int expand_sparse_cb(
+	const char *root, const git_tree_entry *tentry, void *payload)
+{
+	expand_sparse_data *data = payload;
+	git_index_entry *entry = NULL;
+
+	if (git_tree_entry__is_tree(tentry))
+		return 0;
+
+	git_buf_clear(&data->path);
+
+	if (git_buf_puts(&data->path, data->prefix) < 0 ||
+	    git_buf_puts(&data->path, root) < 0 ||
+	    git_buf_puts(&data->path, tentry->filename) < 0)
+		return -1;
+
+	if (index_entry_create(&entry, INDEX_OWNER(data->index), data->path.ptr, NULL, false) < 0)
+		return -1;
+
+	entry->mode = tentry->attr;
+	entry->flags_extended = GIT_INDEX_ENTRY_SKIP_WORKTREE;
+	git_oid_cpy(&entry->id, git_tree_entry_id(tentry));
+	index_entry_adjust_namemask(entry, data->path.size);
+
+	if (git_vector_insert(data->entries, entry) < 0) {
+		index_entry_free(entry);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Append newly allocated entries for the contents of the sparse
+ * directory `sparse` to `out`; the caller owns them.
+ */
+static int sparse_dir_contents(
+	git_vector *out, git_index *index, const git_index_entry *sparse)
+{
+	expand_sparse_data data = { 0 };
+	git_tree *tree = NULL;
+	int error;
+
+	if (INDEX_OWNER(index) == NULL)
+		return create_index_error(-1,
+			"could not expand sparse directory. "
+			"Index is not backed up by an existing repository.");
+
+	if ((error = git_tree_lookup(&tree, INDEX_OWNER(index), &sparse->id)) < 0)
+		return error;
+
+	data.index = index;
+	data.prefix = sparse->path;
+	data.entries = out;
+
+	error = git_tree_walk(tree, GIT_TREEWALK_PRE, expand_sparse_cb, &data);
+
+	git_buf_dispose(&data.path);
+	git_tree_free(tree);
+	return error;
+}
+
+/*
+ * Replace the sparse directory at `pos` with its contents.  The sparse
+ * directory is only dropped once all of its contents are in, and a
+ * failure takes them out again, so the index is left as it was.
+ *
+ * call with locked index
+ */
+static int index_expand_sparse_dir(git_index *index, size_t pos)
+{
+	git_index_entry *sparse = git_vector_get(&index->entries, pos), *entry;
+	git_vector entries = GIT_VECTOR_INIT;
+	unsigned int dirty = index->dirty;
+	size_t i, added = 0, length = index->entries.length;
+	int error;
+
+	if ((error = sparse_dir_contents(&entries, index, sparse)) < 0 ||
+	    (error = git_vector_size_hint(&index->entries,
+			length + entries.length)) < 0 ||
+	    (error = git_vector_size_hint(&index->deleted,
+			index->deleted.length + 1)) < 0)
+		goto done;
+
+	git_vector_foreach(&entries, i, entry) {
+		if ((error = git_vector_insert(&index->entries, entry)) < 0 ||
+		    (error = index_map_set(index->entries_map, entry, index->ignore_case)) < 0)
+			goto rollback;
+
+		added++;
+	}
+
+	/*
+	 * The expanded entries describe exactly the tree that the sparse
+	 * directory pointed at, so the tree cache remains valid.  The new
+	 * entries were appended, so the sparse directory is still at `pos`,
+	 * and dropping it cannot fail with the room reserved above.
+	 */
+	if ((error = index_drop_entry(index, pos)) < 0)
+		goto rollback;
+
+	index->dirty = dirty;
+	git_vector_clear(&entries);
+	goto done;
+
+rollback:
+	for (i = 0; i <= added && i < entries.length; i++)
+		index_map_delete(index->entries_map,
+			git_vector_get(&entries, i), index->ignore_case);
+
+	git_vector_remove_range(&index->entries, length,
+		index->entries.length - length);
+
+done:
+	git_vector_free_deep(&entries);
+	return error;
+}
+
+/*
+ * Expand the sparse directory (if any) that contains `path`.  Returns 1
+ * if a directory was expanded, 0 if there was none, or an error code.
+ */
+static int index_expand_for_path(git_index *index, const char *path)
+{
+	const char *slash;
+	git_index_entry *entry;
+	size_t pos;
+	int error;
+
+	if (!index->sparse)
+		return 0;
+
+	for (slash = strchr(path, '/'); slash; slash = strchr(slash + 1, '/')) {
+		if (index_find(&pos, index, path, (slash - path) + 1, 0) < 0)
+			continue;
+
+		entry = git_vector_get(&index->entries, pos);
+
+		if (git_index_entry__is_sparse_dir(entry)) {
+			if ((error = index_expand_sparse_dir(index, pos)) < 0)
+				return error;
+
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int git_index__ensure_full(git_index *index)
+{
+	git_index_entry *entry;
+	size_t i = 0;
+	int error;
+
+	if (!index->sparse)
+		return 0;
+
+	git_vector_sort(&index->entries);
+
+	/* expanded entries are appended, so each sparse entry is seen once */
+	while (i < index->entries.length) {
+		entry = git_vector_get(&index->entries, i);
+
+		if (!git_index_entry__is_sparse_dir(entry)) {
+			i++;
+			continue;
+		}
+
+		if ((error = index_expand_sparse_dir(index, i)) < 0)
+			return error;
+	}
+
+	index->sparse = 0;
+	git_vector_sort(&index->entries);
+
+	return 0;
+}
+
+int git_index_sparse_expand(git_index *index)
+{
+	assert(index);
+	return git_index__ensure_full(index);
+}
+
+int git_index_sparse_collapse(git_index *index, const char *dir)
+{
+	git_buf path = GIT_BUF_INIT;
+	const git_tree_cache *cache;
+	git_index_entry *entry, *sparse = NULL;
+	const char *slash;
+	size_t start, end, i;
+	int error;
+
+	assert(index && dir);
+
+	if (INDEX_OWNER(index) == NULL)
+		return create_index_error(-1,
+			"could not collapse sparse directory. "
+			"Index is not backed up by an existing repository.");
+
+	if ((error = git_buf_sets(&path, dir)) < 0 ||
+	    (error = git_path_to_dir(&path)) < 0)
+		goto done;
+
+	/* Nothing to do if this directory is already collapsed */
+	for (slash = strchr(path.ptr, '/'); index->sparse && slash; slash = strchr(slash + 1, '/')) {
+		if (index_find(&start, index, path.ptr, (slash - path.ptr) + 1, 0) == 0 &&
+		    git_index_entry__is_sparse_dir(git_vector_get(&index->entries, start)))
+			goto done;
+	}
+
+	index_find(&start, index, path.ptr, path.size, GIT_INDEX_STAGE_ANY);
+
+	for (end = start; end < index->entries.length; end++) {
+		entry = git_vector_get(&index->entries, end);
+
+		if (git__prefixcmp(entry->path, path.ptr) != 0)
+			break;
+
+		if (GIT_INDEX_ENTRY_STAGE(entry) != 0 ||
+		    !(entry->flags_extended & GIT_INDEX_ENTRY_SKIP_WORKTREE)) {
+			git_error_set(GIT_ERROR_INDEX,
+				"cannot collapse '%s': '%s' is not a skip-worktree entry",
+				dir, entry->path);
+			error = -1;
+			goto done;
+		}
+	}
+
+	if (start == end) {
+		git_error_set(GIT_ERROR_INDEX, "index does not contain a directory '%s'", dir);
+		error = GIT_ENOTFOUND;
+		goto done;
+	}
+
+	/* Look up the directory's tree, writing the trees if we must */
+	git_buf_truncate(&path, path.size - 1);
+
+	if ((cache = git_tree_cache_get(index->tree, path.ptr)) == NULL ||
+	    cache->entry_count < 0) {
+		git_oid root_id;
+
+		if ((error = git_index_write_tree(&root_id, index)) < 0)
+			goto done;
+
+		cache = git_tree_cache_get(index->tree, path.ptr);
+	}
+
+	if (cache == NULL || cache->entry_count < 0) {
+		git_error_set(GIT_ERROR_INDEX, "could not find the tree for '%s'", dir);
+		error = -1;
+		goto done;
+	}
+
+	git_buf_putc(&path, '/');
+
+	if ((error = sparse_dir_entry_create(&sparse, INDEX_OWNER(index), path.ptr, path.size)) < 0)
+		goto done;
+
+	git_oid_cpy(&sparse->id, &cache->oid);
+	index_entry_adjust_namemask(sparse, path.size);
+
+	for (i = start; i < end; i++) {
+		entry = git_vector_get(&index->entries, i);
+		index_map_delete(index->entries_map, entry, index->ignore_case);
+
+		if (git_atomic_get(&index->readers) > 0)
+			error = git_vector_insert(&index->deleted, entry);
+		else
+			index_entry_free(entry);
+
+		if (error < 0)
+			goto done;
+	}
+
+	if ((error = git_vector_remove_range(&index->entries, start, end - start)) < 0)
+		goto done;
+
+	if ((error = git_vector_insert(&index->entries, sparse)) < 0 ||
+	    (error = index_map_set(index->entries_map, sparse, index->ignore_case)) < 0)
+		goto done;
+
+	sparse = NULL;
+	index->sparse = 1;
+	index->dirty = 1;
+
+done:
+	index_entry_free(sparse);
+	git_buf_dispose(&path);
+	return error;
+}
+
 static int has_file_name(git_index *index,
 	 const git_index_entry *entry, size_t pos, int ok_to_replace)
 {
@@ -1351,6 +1731,10 @@ static int index_insert(
 
 	entry = *entry_ptr;
 
+	/* Make sure that we are not adding into a sparse directory */
+	if ((error = index_expand_for_path(index, entry->path)) < 0)
+		goto out;
+
 	/* Make sure that the path length flag is correct */
 	path_length = ((struct entry_internal *)entry)->pathlen;
 	index_entry_adjust_namemask(entry, path_length);
@@ -1694,6 +2078,9 @@ int git_index_remove(git_index *index, const char *path, int stage)
 	remove_key.path = path;
 	GIT_INDEX_ENTRY_STAGE_SET(&remove_key, stage);
 
+	if ((error = index_expand_for_path(index, path)) < 0)
+		return error;
+
 	index_map_delete(index->entries_map, &remove_key, index->ignore_case);
 
 	if (index_find(&position, index, path, 0, stage) < 0) {
@@ -1714,6 +2101,9 @@ int git_index_remove_directory(git_index *index, const char *dir, int stage)
 	size_t pos;
 	git_index_entry *entry;
 
+	if ((error = index_expand_for_path(index, dir)) < 0)
+		return error;
+
 	if (!(error = git_buf_sets(&pfx, dir)) &&
 		!(error = git_path_to_dir(&pfx)))
 		index_find(&pos, index, pfx.ptr, pfx.size, GIT_INDEX_STAGE_ANY);
@@ -1744,6 +2134,9 @@ int git_index_find_prefix(size_t *at_pos, git_index *index, const char *prefix)
 	size_t pos;
 	const git_index_entry *entry;
 
+	if ((error = index_expand_for_path(index, prefix)) < 0)
+		return error;
+
 	index_find(&pos, index, prefix, strlen(prefix), GIT_INDEX_STAGE_ANY);
 	entry = git_vector_get(&index->entries, pos);
 	if (!entry || git__prefixcmp(entry->path, prefix) != 0)
@@ -1758,16 +2151,26 @@ int git_index_find_prefix(size_t *at_pos, git_index *index, const char *prefix)
 int git_index__find_pos(
 	size_t *out, git_index *index, const char *path, size_t path_len, int stage)
 {
+	int error;
+
 	assert(index && path);
+
+	if ((error = index_expand_for_path(index, path)) < 0)
+		return error;
+
 	return index_find(out, index, path, path_len, stage);
 }
 
 int git_index_find(size_t *at_pos, git_index *index, const char *path)
 {
 	size_t pos;
+	int error;
 
 	assert(index && path);
 
+	if ((error = index_expand_for_path(index, path)) < 0)
+		return error;
+
 	if (git_vector_bsearch2(
 			&pos, &index->entries, index->entries_search_path, path) < 0) {
 		git_error_set(GIT_ERROR_INDEX, "index does not contain %s", path);
@@ -2520,7 +2923,16 @@ static int read_entry(
 	if (INDEX_FOOTER_SIZE + entry_size > buffer_size)
 		return -1;
 
-	if (index_entry_dup(out, index, &entry) < 0) {
+	if (git_index_entry__is_sparse_dir(&entry)) {
+		if (sparse_dir_entry_create(out, INDEX_OWNER(index),
+				entry.path, strlen(entry.path)) < 0) {
+			git__free(tmp_path);
+			return -1;
+		}
+
+		index_entry_cpy(*out, &entry);
+		index->sparse = 1;
+	} else if (index_entry_dup(out, index, &entry) < 0) {
 		git__free(tmp_path);
 		return -1;
 	}
@@ -2580,6 +2992,9 @@ static int read_extension(size_t *read_len, git_index *index, const char *buffer
 		}
 		/* else, unsupported extension. We cannot parse this, but we can skip
 		 * it by returning `total_size */
+	} else if (memcmp(dest.signature, INDEX_EXT_SPARSE_DIRECTORIES_SIG, 4) == 0) {
+		/* the sparse directory entries themselves are read with the others */
+		index->sparse = 1;
 	} else {
 		/* we cannot handle non-ignorable extensions;
 		 * in fact they aren't even defined in the standard */
@@ -2994,6 +3409,28 @@ static int write_tree_extension(git_index *index, git_filebuf *file)
 	return error;
 }
 
+static int write_sparse_extension(git_index *index, git_filebuf *file)
+{
+	struct index_extension extension;
+	git_buf buf = GIT_BUF_INIT;
+	git_index_entry *entry;
+	size_t i;
+
+	git_vector_foreach(&index->entries, i, entry) {
+		if (git_index_entry__is_sparse_dir(entry))
+			break;
+	}
+
+	if (i == index->entries.length)
+		return 0;
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_SPARSE_DIRECTORIES_SIG, 4);
+	extension.extension_size = 0;
+
+	return write_extension(file, &extension, &buf);
+}
+
 static void clear_uptodate(git_index *index)
 {
 	git_index_entry *entry;
@@ -3041,6 +3478,10 @@ static int write_index(git_oid *checksum, git_index *index, git_filebuf *file)
 	if (index->reuc.length > 0 && write_reuc_extension(index, file) < 0)
 		return -1;
 
+	/* write the sparse directory extension */
+	if (index->sparse && write_sparse_extension(index, file) < 0)
+		return -1;
+
 	/* get out the hash for all the contents we've appended to the file */
 	git_filebuf_hash(&hash_final, file);
 	git_oid_cpy(checksum, &hash_final);
@@ -3621,6 +4062,67 @@ void git_index_snapshot_release(git_vector *snap, git_index *index)
 	git_index_free(index);
 }
 
+int git_index_snapshot_expand(
+	git_vector *snap,
+	git_vector *expanded,
+	git_vector *skipped,
+	git_index *index,
+	git_index_snapshot_expand_cb wanted,
+	void *payload)
+{
+	git_vector entries = GIT_VECTOR_INIT;
+	git_index_entry *entry;
+	size_t i, j, start;
+	int error = 0;
+
+	git_vector_set_cmp(&entries, snap->_cmp);
+
+	git_vector_foreach(snap, i, entry) {
+		if (!git_index_entry__is_sparse_dir(entry)) {
+			if ((error = git_vector_insert(&entries, entry)) < 0)
+				goto done;
+
+			continue;
+		}
+
+		if (wanted && !wanted(entry, payload)) {
+			if ((error = git_vector_insert(skipped, entry)) < 0)
+				goto done;
+
+			continue;
+		}
+
+		start = expanded->length;
+
+		if ((error = sparse_dir_contents(expanded, index, entry)) < 0)
+			goto done;
+
+		for (j = start; j < expanded->length; j++) {
+			if ((error = git_vector_insert(&entries,
+					expanded->contents[j])) < 0)
+				goto done;
+		}
+	}
+
+	git_vector_sort(&entries);
+	git_vector_swap(snap, &entries);
+
+done:
+	git_vector_free(&entries);
+	return error;
+}
+
+void git_index_snapshot_expanded_free(git_vector *expanded)
+{
+	git_index_entry *entry;
+	size_t i;
+
+	git_vector_foreach(expanded, i, entry)
+		index_entry_free(entry);
+
+	git_vector_free(expanded);
+}
+
 int git_index_snapshot_find(
 	size_t *out, git_vector *entries, git_vector_cmp entry_srch,
 	const char *path, size_t path_len, int stage)
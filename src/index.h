@@ -40,6 +40,7 @@ struct git_index {
 	unsigned int distrust_filemode:1;
 	unsigned int no_symlinks:1;
 	unsigned int dirty:1;	/* whether we have unsaved changes */
+	unsigned int sparse:1;	/* whether we may contain sparse directories */
 
 	git_tree_cache *tree;
 	git_pool tree_pool;
@@ -77,6 +78,16 @@ extern int git_index_entry_icmp(const void *a, const void *b);
 extern int git_index_entry_srch(const void *a, const void *b);
 extern int git_index_entry_isrch(const void *a, const void *b);
 
+/*
+ * A sparse directory entry stands in for an entire out-of-cone directory;
+ * its path ends in a slash and its id is the tree that it represents.
+ */
+GIT_INLINE(bool) git_index_entry__is_sparse_dir(const git_index_entry *entry)
+{
+	return S_ISDIR(entry->mode) && !S_ISGITLINK(entry->mode) &&
+		(entry->flags_extended & GIT_INDEX_ENTRY_SKIP_WORKTREE);
+}
+
 /* Index time handling functions */
 GIT_INLINE(bool) git_index_time_eq(const git_index_time *one, const git_index_time *two)
 {
@@ -125,6 +136,9 @@ GIT_INLINE(bool) git_index_entry_newer_than_index(
 extern int git_index__find_pos(
 	size_t *at_pos, git_index *index, const char *path, size_t path_len, int stage);
 
+/* Expand every sparse directory entry in the index into its contents. */
+extern int git_index__ensure_full(git_index *index);
+
 extern int git_index__fill(git_index *index, const git_vector *source_entries);
 
 extern void git_index__set_ignore_case(git_index *index, bool ignore_case);
@@ -144,6 +158,28 @@ extern int git_index__changed_relative_to(git_index *index, const git_oid *check
 extern int git_index_snapshot_new(git_vector *snap, git_index *index);
 extern void git_index_snapshot_release(git_vector *snap, git_index *index);
 
+typedef bool (*git_index_snapshot_expand_cb)(
+	const git_index_entry *sparse_dir, void *payload);
+
+/*
+ * Replace the sparse directory entries in a snapshot with the entries
+ * that they stand for, leaving the index itself untouched.  The new
+ * entries are appended to `expanded`; release them with
+ * `git_index_snapshot_expanded_free` along with the snapshot.
+ *
+ * When `wanted` is given, only the sparse directories that it accepts
+ * are expanded; the others are taken out of the snapshot and appended
+ * to `skipped`, so that they can be put back and expanded later.
+ */
+extern int git_index_snapshot_expand(
+	git_vector *snap,
+	git_vector *expanded,
+	git_vector *skipped,
+	git_index *index,
+	git_index_snapshot_expand_cb wanted,
+	void *payload);
+extern void git_index_snapshot_expanded_free(git_vector *expanded);
+
 /* Allow searching in a snapshot; entries must already be sorted! */
 extern int git_index_snapshot_find(
 	size_t *at_pos, git_vector *snap, git_vector_cmp entry_srch,
@@ -9,6 +9,7 @@
 
 #include "tree.h"
 #include "index.h"
+#include "strmap.h"
 
 #define GIT_ITERATOR_FIRST_ACCESS   (1 << 15)
 #define GIT_ITERATOR_HONOR_IGNORES  (1 << 16)
@@ -1031,6 +1032,10 @@ typedef struct {
 	git_index *index;
 	git_vector index_snapshot;
 
+	/* stat data preloaded for the index entries, keyed by path */
+	git_strmap *preload;
+	git_pool preload_pool;
+
 	git_array_t(filesystem_iterator_frame) frames;
 	git_ignores ignores;
 
@@ -1258,6 +1263,124 @@ GIT_INLINE(bool) filesystem_iterator_is_dot_git(
 	return (len == 4 || path[len - 5] == '/');
 }
 
+/*
+ * Preloading: on slow (eg, network) filesystems the latency of each
+ * `lstat` dominates, so we stat the files that the index knows about
+ * on several threads up front, like git's `core.preloadIndex`.  Any
+ * path that is not preloaded is simply stat'ed when it is read.
+ */
+
+#define FILESYSTEM_PRELOAD_MAX_THREADS 20
+#define FILESYSTEM_PRELOAD_THREAD_COST 500
+#define FILESYSTEM_PRELOAD_CHUNK_SIZE 64
+
+typedef struct {
+	const char *path;
+	struct stat st;
+	int error;
+} filesystem_iterator_preload_entry;
+
+typedef struct {
+	filesystem_iterator *iter;
+	filesystem_iterator_preload_entry *entries;
+	size_t entries_len;
+} filesystem_iterator_preload_data;
+
+static int filesystem_iterator_preload_chunk(size_t idx, void *payload)
+{
+	filesystem_iterator_preload_data *data = payload;
+	filesystem_iterator_preload_entry *entry;
+	git_buf path = GIT_BUF_INIT;
+	size_t i, end;
+	int error = 0;
+
+	i = idx * FILESYSTEM_PRELOAD_CHUNK_SIZE;
+	end = min(i + FILESYSTEM_PRELOAD_CHUNK_SIZE, data->entries_len);
+
+	for (; i < end; i++) {
+		entry = &data->entries[i];
+
+		git_buf_clear(&path);
+
+		if ((error = git_buf_puts(&path, data->iter->root)) < 0 ||
+		    (error = git_buf_puts(&path, entry->path)) < 0)
+			break;
+
+		entry->error = p_lstat(path.ptr, &entry->st);
+	}
+
+	git_buf_dispose(&path);
+	return error;
+}
+
+static int filesystem_iterator_preload(filesystem_iterator *iter)
+{
+	filesystem_iterator_preload_data data = { 0 };
+	filesystem_iterator_preload_entry *entry;
+	const git_index_entry *index_entry;
+	const char *last = NULL;
+	iterator_pathlist_search_t match;
+	struct stat *st;
+	size_t i, chunks, nthreads;
+	bool is_dir;
+	int error;
+
+	if (!iter->index || !(iter->base.flags & GIT_ITERATOR_PRELOAD_STAT))
+		return 0;
+
+	data.iter = iter;
+	data.entries = git__calloc(iter->index_snapshot.length,
+		sizeof(filesystem_iterator_preload_entry));
+	GIT_ERROR_CHECK_ALLOC(data.entries);
+
+	git_vector_foreach(&iter->index_snapshot, i, index_entry) {
+		/* conflicts share a path; skip-worktree files are not here */
+		if ((last && strcmp(last, index_entry->path) == 0) ||
+		    (index_entry->flags_extended & GIT_INDEX_ENTRY_SKIP_WORKTREE))
+			continue;
+
+		last = index_entry->path;
+
+		if (!filesystem_iterator_examine_path(&is_dir, &match, iter,
+				NULL, index_entry->path, strlen(index_entry->path)))
+			continue;
+
+		data.entries[data.entries_len++].path = index_entry->path;
+	}
+
+	chunks = (data.entries_len + FILESYSTEM_PRELOAD_CHUNK_SIZE - 1) /
+		FILESYSTEM_PRELOAD_CHUNK_SIZE;
+	nthreads = min(data.entries_len / FILESYSTEM_PRELOAD_THREAD_COST + 1,
+		FILESYSTEM_PRELOAD_MAX_THREADS);
+
+	if ((error = git_parallel_foreach(chunks, nthreads,
+			filesystem_iterator_preload_chunk, &data)) < 0 ||
+	    (error = git_strmap_new(&iter->preload)) < 0 ||
+	    (error = git_pool_init(&iter->preload_pool, sizeof(struct stat))) < 0)
+		goto done;
+
+	for (i = 0; i < data.entries_len; i++) {
+		entry = &data.entries[i];
+
+		if (entry->error < 0)
+			continue;
+
+		st = git_pool_malloc(&iter->preload_pool, 1);
+		GIT_ERROR_CHECK_ALLOC(st);
+
+		memcpy(st, &entry->st, sizeof(struct stat));
+
+		if ((error = git_strmap_set(iter->preload, entry->path, st)) < 0)
+			goto done;
+	}
+
+	iter->base.stat_calls += data.entries_len;
+
+done:
+	git__free(data.entries);
+	return error;
+}
+
 static int filesystem_iterator_entry_hash(
 	filesystem_iterator *iter,
 	filesystem_iterator_entry *entry)
@@ -1335,7 +1458,8 @@ static int filesystem_iterator_frame_push(
 	git_buf root = GIT_BUF_INIT;
 	const char *path;
 	filesystem_iterator_entry *entry;
-	struct stat statbuf;
+	struct stat statbuf, *preloaded;
+	mode_t filetype;
 	size_t path_len;
 	int error;
 
@@ -1407,19 +1531,40 @@ static int filesystem_iterator_frame_push(
 		 * we have an index, we can just copy the data out of it.
 		 */
 
-		if ((error = git_path_diriter_stat(&statbuf, &diriter)) < 0) {
-			/* file was removed between readdir and lstat */
-			if (error == GIT_ENOTFOUND)
-				continue;
+		filetype = git_path_diriter_filetype(&diriter);
 
-			/* treat the file as unreadable */
+		if (iter->preload &&
+		    (preloaded = git_strmap_get(iter->preload, path)) != NULL) {
+			memcpy(&statbuf, preloaded, sizeof(struct stat));
+		} else if (filetype == S_IFDIR) {
+			/* nothing compares a directory's own stat data; the listing
+			 * has already told us everything that we need to know
+			 */
 			memset(&statbuf, 0, sizeof(statbuf));
-			statbuf.st_mode = GIT_FILEMODE_UNREADABLE;
+			statbuf.st_mode = S_IFDIR;
+		} else if (filetype && filetype != S_IFREG && filetype != S_IFLNK) {
+			/* fifos, sockets and devices are skipped below; don't stat them */
+			continue;
+		} else {
+			/* files are stat'ed even when they are not in the index:
+			 * untracked and ignored entries are reported with their
+			 * mode (and so the executable bit) and size, which the
+			 * directory listing does not tell us.
+			 */
+			if ((error = git_path_diriter_stat(&statbuf, &diriter)) < 0) {
+				/* file was removed between readdir and lstat */
+				if (error == GIT_ENOTFOUND)
+					continue;
 
-			error = 0;
-		}
+				/* treat the file as unreadable */
+				memset(&statbuf, 0, sizeof(statbuf));
+				statbuf.st_mode = GIT_FILEMODE_UNREADABLE;
 
-		iter->base.stat_calls++;
+				error = 0;
+			}
+
+			iter->base.stat_calls++;
+		}
 
 		/* Ignore wacky things in the filesystem */
 		if (!S_ISDIR(statbuf.st_mode) &&
@@ -1849,6 +1994,10 @@ static void filesystem_iterator_clear(filesystem_iterator *iter)
 
 	git_buf_dispose(&iter->tmp_buf);
 
+	git_strmap_free(iter->preload);
+	iter->preload = NULL;
+	git_pool_clear(&iter->preload_pool);
+
 	iterator_clear(&iter->base);
 }
 
@@ -1861,6 +2010,9 @@ static int filesystem_iterator_init(filesystem_iterator *iter)
 			".gitignore", &iter->ignores)) < 0)
 		return error;
 
+	if ((error = filesystem_iterator_preload(iter)) < 0)
+		return error;
+
 	if ((error = filesystem_iterator_frame_push(iter, NULL)) < 0)
 		return error;
 
@@ -1948,6 +2100,17 @@ static int iterator_for_filesystem(
 		(error = git_index_snapshot_new(&iter->index_snapshot, index)) < 0)
 		goto on_error;
 
+	/* preload the index entries' stat data if `core.preloadIndex` is set */
+	if (index && repo && type == GIT_ITERATOR_WORKDIR &&
+		(iter->base.flags & GIT_ITERATOR_PRELOAD_STAT) == 0) {
+		int preload;
+
+		if (git_repository__configmap_lookup(&preload, repo, GIT_CONFIGMAP_PRELOADINDEX) < 0)
+			git_error_clear();
+		else if (preload)
+			iter->base.flags |= GIT_ITERATOR_PRELOAD_STAT;
+	}
+
 	iter->index = index;
 	iter->dirload_flags =
 		(iterator__ignore_case(&iter->base) ? GIT_PATH_DIR_IGNORE_CASE : 0) |
@@ -2011,6 +2174,12 @@ typedef struct {
 	git_vector entries;
 	size_t next_idx;
 
+	/* entries that we expanded out of sparse directories */
+	git_vector sparse_entries;
+
+	/* sparse directories outside of the range and pathlist */
+	git_vector sparse_skipped;
+
 	/* the pseudotree entry */
 	git_index_entry tree_entry;
 	git_buf tree_buf;
@@ -2206,11 +2375,87 @@ static int index_iterator_init(index_iterator *iter)
 	return 0;
 }
 
+/*
+ * Whether any path in the sparse directory `dir` (which ends in a
+ * slash) may be in the iterator's range and pathlist.
+ */
+static bool index_iterator_wants_sparse_dir(
+	const git_index_entry *dir, void *payload)
+{
+	index_iterator *iter = payload;
+	git_iterator *base = &iter->base;
+	size_t dir_len = strlen(dir->path), p_len, i;
+	const char *p;
+
+	/* the start may be beneath the directory */
+	if (base->start && base->prefixcomp(dir->path, base->start) < 0 &&
+	    base->strncomp(dir->path, base->start, dir_len) != 0)
+		goto skip;
+
+	if (base->end && base->prefixcomp(dir->path, base->end) > 0)
+		goto skip;
+
+	if (!base->pathlist.length)
+		return true;
+
+	git_vector_foreach(&base->pathlist, i, p) {
+		p_len = strlen(p);
+
+		/* a path beneath the directory */
+		if (p_len >= dir_len && base->strncomp(p, dir->path, dir_len) == 0)
+			return true;
+
+		/* the directory itself, or one of its parents */
+		if (p_len && p[p_len - 1] == '/')
+			p_len--;
+
+		if (p_len < dir_len && dir->path[p_len] == '/' &&
+		    base->strncomp(p, dir->path, p_len) == 0)
+			return true;
+	}
+
+skip:
+	return false;
+}
+
+/*
+ * Expand the sparse directories that the iterator's range or pathlist
+ * reach into; the others are only expanded if a reset later reaches
+ * into them.
+ */
+static int index_iterator_expand_sparse(index_iterator *iter)
+{
+	git_index_entry *dir;
+	size_t i;
+	int error;
+
+	if (iter->sparse_skipped.length) {
+		git_vector_foreach(&iter->sparse_skipped, i, dir) {
+			if ((error = git_vector_insert(&iter->entries, dir)) < 0)
+				return error;
+		}
+
+		git_vector_clear(&iter->sparse_skipped);
+	} else if (!iter->base.index->sparse) {
+		return 0;
+	}
+
+	return git_index_snapshot_expand(&iter->entries, &iter->sparse_entries,
+		&iter->sparse_skipped, iter->base.index,
+		index_iterator_wants_sparse_dir, iter);
+}
+
 static int index_iterator_reset(git_iterator *i)
 {
 	index_iterator *iter = GIT_CONTAINER_OF(i, index_iterator, base);
+	int error;
 
 	index_iterator_clear(iter);
+
+	if (iter->sparse_skipped.length &&
+	    (error = index_iterator_expand_sparse(iter)) < 0)
+		return error;
+
 	return index_iterator_init(iter);
 }
 
@@ -2219,6 +2464,8 @@ static void index_iterator_free(git_iterator *i)
 	index_iterator *iter = GIT_CONTAINER_OF(i, index_iterator, base);
 
 	git_index_snapshot_release(&iter->entries, iter->base.index);
+	git_index_snapshot_expanded_free(&iter->sparse_entries);
+	git_vector_free(&iter->sparse_skipped);
 	git_buf_dispose(&iter->tree_buf);
 }
 
@@ -2252,14 +2499,17 @@ int git_iterator_for_index(
 	iter->base.cb = &callbacks;
 
 	if ((error = iterator_init_common(&iter->base, repo, index, options)) < 0 ||
-		(error = git_index_snapshot_new(&iter->entries, index)) < 0 ||
-		(error = index_iterator_init(iter)) < 0)
+		(error = git_index_snapshot_new(&iter->entries, index)) < 0)
 		goto on_error;
 
 	git_vector_set_cmp(&iter->entries, iterator__ignore_case(&iter->base) ?
 		git_index_entry_icmp : git_index_entry_cmp);
 	git_vector_sort(&iter->entries);
 
+	if ((error = index_iterator_expand_sparse(iter)) < 0 ||
+		(error = index_iterator_init(iter)) < 0)
+		goto on_error;
+
 	*out = &iter->base;
 	return 0;
 
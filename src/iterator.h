@@ -43,6 +43,8 @@ typedef enum {
 	GIT_ITERATOR_DESCEND_SYMLINKS = (1u << 7),
 	/** hash files in workdir or filesystem iterators */
 	GIT_ITERATOR_INCLUDE_HASH = (1u << 8),
+	/** stat the index entries' files on multiple threads before iterating */
+	GIT_ITERATOR_PRELOAD_STAT = (1u << 9),
 } git_iterator_flag_t;
 
 typedef enum {
@@ -20,6 +20,7 @@
 #include "diff.h"
 #include "diff_generate.h"
 #include "diff_tform.h"
+#include "hashsig_cache.h"
 #include "checkout.h"
 #include "tree.h"
 #include "blob.h"
@@ -34,6 +35,7 @@
 #include "merge_driver.h"
 #include "oidmap.h"
 #include "array.h"
+#include "thread-utils.h"
 
 #include "git2/types.h"
 #include "git2/repository.h"
@@ -307,12 +309,12 @@ on_error:
 	return -1;
 }
 
-static int interesting(git_pqueue *list)
+static int interesting(git_commit_queue *list)
 {
 	size_t i;
 
-	for (i = 0; i < git_pqueue_size(list); i++) {
-		git_commit_list_node *commit = git_pqueue_get(list, i);
+	for (i = 0; i < git_commit_queue_size(list); i++) {
+		git_commit_list_node *commit = git_commit_queue_get(list, i);
 		if ((commit->flags & STALE) == 0)
 			return 1;
 	}
@@ -371,47 +373,99 @@ static int clear_commit_marks(git_commit_list_node *commit, unsigned int mark)
 	return 0;
 }
 
+/*
+ * Find the stored generations of the commits to paint; they are only
+ * used when all of them are known.  Computing them here would walk the
+ * whole history of the commits, which is what we try to avoid.
+ */
+static int paint_generations(
+	bool *use_generations,
+	git_revwalk *walk,
+	git_commit_list_node *one,
+	git_vector *twos)
+{
+	git_commit_list_node *two;
+	uint32_t generation;
+	size_t i;
+	int error;
+
+	*use_generations = false;
+
+	if ((error = git_commit_list_generation(&generation, walk, one)) < 0 ||
+	    !generation)
+		return error;
+
+	git_vector_foreach(twos, i, two) {
+		if ((error = git_commit_list_generation(&generation, walk, two)) < 0 ||
+		    !generation)
+			return error;
+	}
+
+	*use_generations = true;
+	return 0;
+}
+
+/*
+ * Paint the history of `one` and `twos` until their common ancestors are
+ * found.  When generation numbers are available, commits are visited in
+ * generation order, and painting stops at the first commit below
+ * `min_generation`: those commits cannot reach any commit that is at or
+ * above it.
+ */
 static int paint_down_to_common(
-	git_commit_list **out, git_revwalk *walk, git_commit_list_node *one, git_vector *twos)
+	git_commit_list **out,
+	git_revwalk *walk,
+	git_commit_list_node *one,
+	git_vector *twos,
+	uint32_t min_generation)
 {
-	git_pqueue list;
+	git_commit_queue list;
 	git_commit_list *result = NULL;
 	git_commit_list_node *two;
+	uint32_t generation;
+	bool use_generations;
 
 	int error;
 	unsigned int i;
 
-	if (git_pqueue_init(&list, 0, twos->length * 2, git_commit_list_time_cmp) < 0)
-		return -1;
+	if ((error = paint_generations(&use_generations, walk, one, twos)) < 0)
+		return error;
+
+	git_commit_queue_init(&list, use_generations);
 
 	one->flags |= PARENT1;
-	if (git_pqueue_insert(&list, one) < 0)
-		return -1;
+	if ((error = git_commit_queue_insert(&list, one)) < 0)
+		goto done;
 
 	git_vector_foreach(twos, i, two) {
-		if (git_commit_list_parse(walk, two) < 0)
-			return -1;
+		if ((error = git_commit_list_parse(walk, two)) < 0)
+			goto done;
 
 		two->flags |= PARENT2;
 
-		if (git_pqueue_insert(&list, two) < 0)
-			return -1;
+		if ((error = git_commit_queue_insert(&list, two)) < 0)
+			goto done;
 	}
 
 	/* as long as there are non-STALE commits */
 	while (interesting(&list)) {
-		git_commit_list_node *commit = git_pqueue_pop(&list);
+		git_commit_list_node *commit = git_commit_queue_pop(&list);
 		int flags;
 
 		if (commit == NULL)
 			break;
 
+		if (use_generations && commit->generation < min_generation)
+			break;
+
 		flags = commit->flags & (PARENT1 | PARENT2 | STALE);
 		if (flags == (PARENT1 | PARENT2)) {
 			if (!(commit->flags & RESULT)) {
 				commit->flags |= RESULT;
-				if (git_commit_list_insert(commit, &result) == NULL)
-					return -1;
+				if (git_commit_list_insert(commit, &result) == NULL) {
+					error = -1;
+					goto done;
+				}
 			}
 			/* we mark the parents of a merge stale */
 			flags |= STALE;
@@ -423,15 +477,26 @@ static int paint_down_to_common(
 				continue;
 
 			if ((error = git_commit_list_parse(walk, p)) < 0)
-				return error;
+				goto done;
+
+			if (use_generations &&
+			    (error = git_commit_list_generation(&generation, walk, p)) < 0)
+				goto done;
 
 			p->flags |= flags;
-			if (git_pqueue_insert(&list, p) < 0)
-				return -1;
+			if ((error = git_commit_queue_insert(&list, p)) < 0)
+				goto done;
 		}
 	}
 
-	git_pqueue_free(&list);
+done:
+	git_commit_queue_free(&list);
+
+	if (error < 0) {
+		git_commit_list_free(&result);
+		return error;
+	}
+
 	*out = result;
 	return 0;
 }
@@ -442,6 +507,7 @@ static int remove_redundant(git_revwalk *walk, git_vector *commits)
 	unsigned char *redundant;
 	unsigned int *filled_index;
 	unsigned int i, j;
+	uint32_t generation, min_generation = 0;
 	int error = 0;
 
 	redundant = git__calloc(commits->length, 1);
@@ -450,8 +516,15 @@ static int remove_redundant(git_revwalk *walk, git_vector *commits)
 	GIT_ERROR_CHECK_ALLOC(filled_index);
 
 	for (i = 0; i < commits->length; ++i) {
-		if ((error = git_commit_list_parse(walk, commits->contents[i])) < 0)
+		if ((error = git_commit_list_parse(walk, commits->contents[i])) < 0 ||
+		    (error = git_commit_list_generation(&generation, walk, commits->contents[i])) < 0)
 			goto done;
+
+		/* nothing below the lowest of the commits can tell us whether
+		 * one of them is an ancestor of another
+		 */
+		if (i == 0 || generation < min_generation)
+			min_generation = generation;
 	}
 
 	for (i = 0; i < commits->length; ++i) {
@@ -472,7 +545,7 @@ static int remove_redundant(git_revwalk *walk, git_vector *commits)
 				goto done;
 		}
 
-		error = paint_down_to_common(&common, walk, commit, &work);
+		error = paint_down_to_common(&common, walk, commit, &work, min_generation);
 		if (error < 0)
 			goto done;
 
@@ -504,6 +577,43 @@ done:
 	return error;
 }
 
+int git_merge__descendant_of(
+	git_revwalk *walk,
+	git_commit_list_node *commit,
+	git_commit_list_node *ancestor)
+{
+	git_vector twos = GIT_VECTOR_INIT;
+	git_commit_list *result = NULL;
+	uint32_t commit_generation, ancestor_generation;
+	int error;
+
+	if (commit == ancestor)
+		return 0;
+
+	if ((error = git_commit_list_parse(walk, commit)) < 0 ||
+	    (error = git_commit_list_parse(walk, ancestor)) < 0 ||
+	    (error = git_commit_list_generation(&commit_generation, walk, commit)) < 0 ||
+	    (error = git_commit_list_generation(&ancestor_generation, walk, ancestor)) < 0)
+		return error;
+
+	/* a commit can only reach commits with a lower generation */
+	if (commit_generation && ancestor_generation &&
+	    commit_generation <= ancestor_generation)
+		return 0;
+
+	if ((error = git_vector_insert(&twos, commit)) < 0)
+		return error;
+
+	/* the ancestor is painted as "two" once the commit's history reaches it */
+	if ((error = paint_down_to_common(&result, walk,
+			ancestor, &twos, ancestor_generation)) == 0)
+		error = (ancestor->flags & PARENT2) ? 1 : 0;
+
+	git_commit_list_free(&result);
+	git_vector_free(&twos);
+	return error;
+}
+
 int git_merge__bases_many(git_commit_list **out, git_revwalk *walk, git_commit_list_node *one, git_vector *twos)
 {
 	int error;
@@ -526,7 +636,7 @@ int git_merge__bases_many(git_commit_list **out, git_revwalk *walk, git_commit_l
 	if (git_commit_list_parse(walk, one) < 0)
 		return -1;
 
-	error = paint_down_to_common(&result, walk, one, twos);
+	error = paint_down_to_common(&result, walk, one, twos, 0);
 	if (error < 0)
 		return error;
 
@@ -859,26 +969,22 @@ static bool merge_conflict_can_resolve_contents(
 	return true;
 }
 
-static int merge_conflict_invoke_driver(
+static int merge_conflict_result_entry(
 	git_index_entry **out,
-	const char *name,
-	git_merge_driver *driver,
 	git_merge_diff_list *diff_list,
-	git_merge_driver_source *src)
+	const char *path,
+	uint32_t mode,
+	const git_buf *buf)
 {
 	git_index_entry *result;
-	git_buf buf = GIT_BUF_INIT;
-	const char *path;
-	uint32_t mode;
 	git_odb *odb = NULL;
 	git_oid oid;
 	int error;
 
 	*out = NULL;
 
-	if ((error = driver->apply(driver, &path, &mode, &buf, name, src)) < 0 ||
-		(error = git_repository_odb(&odb, src->repo)) < 0 ||
-		(error = git_odb_write(&oid, odb, buf.ptr, buf.size, GIT_OBJECT_BLOB)) < 0)
+	if ((error = git_repository_odb(&odb, diff_list->repo)) < 0 ||
+		(error = git_odb_write(&oid, odb, buf->ptr, buf->size, GIT_OBJECT_BLOB)) < 0)
 		goto done;
 
 	result = git_pool_mallocz(&diff_list->pool, sizeof(git_index_entry));
@@ -886,7 +992,7 @@ static int merge_conflict_invoke_driver(
 
 	git_oid_cpy(&result->id, &oid);
 	result->mode = mode;
-	result->file_size = (uint32_t)buf.size;
+	result->file_size = (uint32_t)buf->size;
 
 	result->path = git_pool_strdup(&diff_list->pool, path);
 	GIT_ERROR_CHECK_ALLOC(result->path);
@@ -894,25 +1000,244 @@ static int merge_conflict_invoke_driver(
 	*out = result;
 
 done:
-	git_buf_dispose(&buf);
 	git_odb_free(odb);
 
 	return error;
 }
 
+static int merge_conflict_invoke_driver(
+	git_index_entry **out,
+	const char *name,
+	git_merge_driver *driver,
+	git_merge_diff_list *diff_list,
+	git_merge_driver_source *src)
+{
+	git_buf buf = GIT_BUF_INIT;
+	const char *path;
+	uint32_t mode;
+	int error;
+
+	*out = NULL;
+
+	if ((error = driver->apply(driver, &path, &mode, &buf, name, src)) == 0)
+		error = merge_conflict_result_entry(out, diff_list, path, mode, &buf);
+
+	git_buf_dispose(&buf);
+
+	return error;
+}
+
+static void merge_driver_source_init(
+	git_merge_driver_source *source,
+	git_merge_diff_list *diff_list,
+	const git_merge_diff *conflict,
+	const git_merge_options *merge_opts,
+	const git_merge_file_options *file_opts)
+{
+	memset(source, 0, sizeof(git_merge_driver_source));
+
+	source->repo = diff_list->repo;
+	source->default_driver = merge_opts->default_driver;
+	source->file_opts = file_opts;
+	source->ancestor = GIT_MERGE_INDEX_ENTRY_EXISTS(conflict->ancestor_entry) ?
+		&conflict->ancestor_entry : NULL;
+	source->ours = GIT_MERGE_INDEX_ENTRY_EXISTS(conflict->our_entry) ?
+		&conflict->our_entry : NULL;
+	source->theirs = GIT_MERGE_INDEX_ENTRY_EXISTS(conflict->their_entry) ?
+		&conflict->their_entry : NULL;
+}
+
+#define MERGE_CONTENTS_BATCH 256
+#define MERGE_CONTENTS_THREAD_COST 4
+
+/*
+ * A content merge that is run ahead of time on a worker thread.  Only
+ * conflicts whose sides all differ and that use one of the builtin text
+ * drivers are queued; conflicts are still resolved one at
+ * a time in their original order, and take the result of their queued
+ * merge when they get to it, so the resulting index does not depend on
+ * the order in which the merges finished.  The merges are run in batches
+ * so that only a limited number of merged files is held in memory.
+ */
+typedef struct {
+	size_t idx;
+	git_merge_driver_source source;
+	const char *name;
+	git_merge_driver *driver;
+
+	const char *path;
+	uint32_t mode;
+	git_buf buf;
+	int error;
+} merge_contents_job;
+
+typedef struct {
+	git_array_t(merge_contents_job) jobs;
+	size_t next;
+	size_t batch;
+	size_t computed;
+	git_merge_driver__builtin favored;
+} merge_contents;
+
+static bool merge_conflict_needs_contents(const git_merge_diff *conflict)
+{
+	if (!merge_conflict_can_resolve_contents(conflict))
+		return false;
+
+	if (git_oid__cmp(&conflict->our_entry.id, &conflict->their_entry.id) == 0)
+		return false;
+
+	return !GIT_MERGE_INDEX_ENTRY_EXISTS(conflict->ancestor_entry) ||
+		(git_oid__cmp(&conflict->ancestor_entry.id, &conflict->our_entry.id) != 0 &&
+		 git_oid__cmp(&conflict->ancestor_entry.id, &conflict->their_entry.id) != 0);
+}
+
+/*
+ * Pick the driver for each conflict that needs a content merge; this
+ * reads the attributes, so it is done up front on this thread.
+ */
+static int merge_contents_init(
+	merge_contents *contents,
+	git_merge_diff_list *diff_list,
+	const git_vector *changes,
+	const git_merge_options *merge_opts,
+	const git_merge_file_options *file_opts)
+{
+	git_merge_driver_source source;
+	git_merge_driver *driver;
+	merge_contents_job *job;
+	git_merge_diff *conflict;
+	const char *name;
+	size_t i;
+	int error;
+
+	contents->favored.base.apply = git_merge_driver__builtin_apply;
+	contents->favored.favor = file_opts->favor;
+
+	git_vector_foreach(changes, i, conflict) {
+		if (!merge_conflict_needs_contents(conflict))
+			continue;
+
+		merge_driver_source_init(&source,
+			diff_list, conflict, merge_opts, file_opts);
+
+		if (file_opts->favor != GIT_MERGE_FILE_FAVOR_NORMAL) {
+			name = "text";
+			driver = &contents->favored.base;
+		} else {
+			if ((error = git_merge_driver_for_source(&name, &driver, &source)) < 0)
+				return error;
+
+			if (driver == NULL) {
+				name = "text";
+				driver = &git_merge_driver__text.base;
+			}
+
+			/* other drivers may not be safe to call from threads */
+			if (driver != &git_merge_driver__text.base &&
+			    driver != &git_merge_driver__union.base)
+				continue;
+		}
+
+		job = git_array_alloc(contents->jobs);
+		GIT_ERROR_CHECK_ALLOC(job);
+
+		memset(job, 0, sizeof(merge_contents_job));
+		job->idx = i;
+		job->source = source;
+		job->name = name;
+		job->driver = driver;
+	}
+
+	return 0;
+}
+
+static int merge_contents_batch_cb(size_t idx, void *payload)
+{
+	merge_contents *contents = payload;
+	merge_contents_job *job =
+		git_array_get(contents->jobs, contents->batch + idx);
+
+	job->error = job->driver->apply(job->driver, &job->path, &job->mode,
+		&job->buf, job->name, &job->source);
+
+	/* a conflicted merge is a result for the conflict, not a failure */
+	if (job->error == GIT_EMERGECONFLICT) {
+		git_error_clear();
+		return 0;
+	}
+
+	return job->error;
+}
+
+/*
+ * Return the queued merge for the conflict at the given index, running
+ * the next batch of merges if it has not been run yet, or NULL if the
+ * conflict was not queued.
+ */
+static int merge_contents_job_for(
+	merge_contents_job **out,
+	merge_contents *contents,
+	size_t idx)
+{
+	merge_contents_job *job;
+	size_t count, nthreads;
+	int error;
+
+	*out = NULL;
+
+	/* drop the merges of conflicts that were resolved some other way */
+	while ((job = git_array_get(contents->jobs, contents->next)) != NULL &&
+	       job->idx < idx) {
+		git_buf_dispose(&job->buf);
+		contents->next++;
+	}
+
+	if (!job || job->idx != idx)
+		return 0;
+
+	if (contents->next >= contents->computed) {
+		count = min(git_array_size(contents->jobs) - contents->next,
+			(size_t)MERGE_CONTENTS_BATCH);
+		nthreads = min(count / MERGE_CONTENTS_THREAD_COST + 1,
+			(size_t)git_online_cpus());
+
+		contents->batch = contents->next;
+		contents->computed = contents->next + count;
+
+		if ((error = git_parallel_foreach(count, nthreads,
+				merge_contents_batch_cb, contents)) < 0)
+			return error;
+	}
+
+	contents->next++;
+
+	*out = job;
+	return 0;
+}
+
+static void merge_contents_free(merge_contents *contents)
+{
+	merge_contents_job *job;
+	size_t i;
+
+	git_array_foreach(contents->jobs, i, job)
+		git_buf_dispose(&job->buf);
+
+	git_array_clear(contents->jobs);
+}
 static int merge_conflict_resolve_contents(
 	int *resolved,
 	git_merge_diff_list *diff_list,
 	const git_merge_diff *conflict,
 	const git_merge_options *merge_opts,
-	const git_merge_file_options *file_opts)
+	const git_merge_file_options *file_opts,
+	merge_contents_job *job)
 {
-	git_merge_driver_source source = {0};
-	git_merge_file_result result = {0};
+	git_merge_driver_source source;
 	git_merge_driver *driver;
 	git_merge_driver__builtin builtin = {{0}};
 	git_index_entry *merge_result;
-	git_odb *odb = NULL;
 	const char *name;
 	bool fallback = false;
 	int error;
@@ -924,15 +1249,17 @@ static int merge_conflict_resolve_contents(
 	if (!merge_conflict_can_resolve_contents(conflict))
 		return 0;
 
-	source.repo = diff_list->repo;
-	source.default_driver = merge_opts->default_driver;
-	source.file_opts = file_opts;
-	source.ancestor = GIT_MERGE_INDEX_ENTRY_EXISTS(conflict->ancestor_entry) ?
-		&conflict->ancestor_entry : NULL;
-	source.ours = GIT_MERGE_INDEX_ENTRY_EXISTS(conflict->our_entry) ?
-		&conflict->our_entry : NULL;
-	source.theirs = GIT_MERGE_INDEX_ENTRY_EXISTS(conflict->their_entry) ?
-		&conflict->their_entry : NULL;
+	if (job) {
+		if ((error = job->error) == 0)
+			error = merge_conflict_result_entry(&merge_result,
+				diff_list, job->path, job->mode, &job->buf);
+
+		git_buf_dispose(&job->buf);
+		goto finish;
+	}
+
+	merge_driver_source_init(&source,
+		diff_list, conflict, merge_opts, file_opts);
 
 	if (file_opts->favor != GIT_MERGE_FILE_FAVOR_NORMAL) {
 		/* if the user requested a particular type of resolution (via the
@@ -947,7 +1274,7 @@ static int merge_conflict_resolve_contents(
 	} else {
 		/* find the merge driver for this file */
 		if ((error = git_merge_driver_for_source(&name, &driver, &source)) < 0)
-			goto done;
+			return error;
 
 		if (driver == NULL)
 			fallback = true;
@@ -966,11 +1293,12 @@ static int merge_conflict_resolve_contents(
 			&git_merge_driver__text.base, diff_list, &source);
 	}
 
+finish:
 	if (error < 0) {
 		if (error == GIT_EMERGECONFLICT)
 			error = 0;
 
-		goto done;
+		return error;
 	}
 
 	git_vector_insert(&diff_list->staged, merge_result);
@@ -978,11 +1306,7 @@ static int merge_conflict_resolve_contents(
 
 	*resolved = 1;
 
-done:
-	git_merge_file_result_free(&result);
-	git_odb_free(odb);
-
-	return error;
+	return 0;
 }
 
 static int merge_conflict_resolve(
@@ -990,7 +1314,8 @@ static int merge_conflict_resolve(
 	git_merge_diff_list *diff_list,
 	const git_merge_diff *conflict,
 	const git_merge_options *merge_opts,
-	const git_merge_file_options *file_opts)
+	const git_merge_file_options *file_opts,
+	merge_contents_job *job)
 {
 	int resolved = 0;
 	int error = 0;
@@ -1010,7 +1335,8 @@ static int merge_conflict_resolve(
 		goto done;
 
 	if (!resolved && (error = merge_conflict_resolve_contents(
-			&resolved, diff_list, conflict, merge_opts, file_opts)) < 0)
+			&resolved, diff_list, conflict, merge_opts, file_opts,
+			job)) < 0)
 		goto done;
 
 	*out = resolved;
@@ -1035,6 +1361,7 @@ static int index_entry_similarity_calc(
 	git_blob *blob;
 	git_diff_file diff_file = {{{0}}};
 	git_object_size_t blobsize;
+	bool cacheable;
 	int error;
 
 	if (*out || *out == &cache_invalid_marker)
@@ -1042,6 +1369,13 @@ static int index_entry_similarity_calc(
 
 	*out = NULL;
 
+	/* the builtin signatures of blobs may be cached on disk */
+	cacheable = opts->metric->buffer_signature == git_diff_find_similar__hashsig_for_buf;
+
+	if (cacheable && git_hashsig_cache_get((git_hashsig **)out, &blobsize, repo,
+			&entry->id, (git_hashsig_option_t)(intptr_t)opts->metric->payload) == 0)
+		return 0;
+
 	if ((error = git_blob_lookup(&blob, repo, &entry->id)) < 0)
 		return error;
 
@@ -1062,6 +1396,8 @@ static int index_entry_similarity_calc(
 		opts->metric->payload);
 	if (error == GIT_EBUFS)
 		*out = &cache_invalid_marker;
+	else if (!error && cacheable)
+		git_hashsig_cache_put(repo, &entry->id, blobsize, *out);
 
 	git_blob_free(blob);
 
@@ -1240,83 +1576,311 @@ done:
 	return error;
 }
 
-static int merge_diff_mark_similarity_inexact(
-	git_repository *repo,
-	git_merge_diff_list *diff_list,
-	struct merge_diff_similarity *similarity_ours,
-	struct merge_diff_similarity *similarity_theirs,
+/*
+ * Like `index_entry_similarity_inexact`, but only using signatures that
+ * have already been calculated; this does not modify the signature cache,
+ * so it can be called from several threads at once.
+ */
+static int index_entry_similarity_cached(
+	git_index_entry *a,
+	size_t a_idx,
+	git_index_entry *b,
+	size_t b_idx,
 	void **cache,
 	const git_merge_options *opts)
 {
-	size_t i, j;
+	int score = 0;
+
+	if (!GIT_MODE_ISBLOB(a->mode) || !GIT_MODE_ISBLOB(b->mode))
+		return 0;
+
+	if (!cache[a_idx] || !cache[b_idx] ||
+	    cache[a_idx] == &cache_invalid_marker || cache[b_idx] == &cache_invalid_marker)
+		return 0;
+
+	if (opts->metric->similarity(&score, cache[a_idx], cache[b_idx], opts->metric->payload) < 0)
+		return -1;
+
+	if (score < 0)
+		score = 0;
+	else if (score > 100)
+		score = 100;
+
+	return score;
+}
+
+#define MERGE_RENAME_THREAD_COST 8
+
+typedef git_array_t(size_t) merge_similarity_indices;
+
+typedef struct {
+	size_t cache_idx;
+	git_index_entry *entry;
+} merge_similarity_entry;
+
+/*
+ * The similarity of every rename source to every target is computed up
+ * front, one row of scores per source, and the best matches are then
+ * picked from these scores in order.  With the builtin metric, all of
+ * the signatures are calculated first and the rows are scored on several
+ * threads; since the scores do not depend on the order in which they are
+ * computed, the matches are the same as when scoring serially.
+ */
+typedef struct {
+	git_repository *repo;
+	git_merge_diff_list *diff_list;
+	void **cache;
+	const git_merge_options *opts;
+	git_array_t(merge_similarity_entry) entries;
+	merge_similarity_indices sources;
+	merge_similarity_indices targets;
+	int *ours;
+	int *theirs;
+	bool preloaded;
+} merge_similarity_scoring;
+
+static int merge_similarity_entry_cb(size_t idx, void *payload)
+{
+	merge_similarity_scoring *scoring = payload;
+	merge_similarity_entry *entry = git_array_get(scoring->entries, idx);
+	int error;
+
+	error = index_entry_similarity_calc(&scoring->cache[entry->cache_idx],
+		scoring->repo, entry->entry, scoring->opts);
+
+	/* the metric does not wish to process this file */
+	if (error == GIT_EBUFS) {
+		git_error_clear();
+		error = 0;
+	}
+
+	return error;
+}
+
+static int merge_similarity_score(
+	merge_similarity_scoring *scoring,
+	git_index_entry *a,
+	size_t a_idx,
+	git_index_entry *b,
+	size_t b_idx)
+{
+	if (scoring->preloaded)
+		return index_entry_similarity_cached(
+			a, a_idx, b, b_idx, scoring->cache, scoring->opts);
+
+	return index_entry_similarity_inexact(scoring->repo,
+		a, a_idx, b, b_idx, scoring->cache, scoring->opts);
+}
+
+static int merge_similarity_row_cb(size_t row, void *payload)
+{
+	merge_similarity_scoring *scoring = payload;
+	git_vector *conflicts = &scoring->diff_list->conflicts;
+	size_t i = *git_array_get(scoring->sources, row), j, k;
+	size_t offset = row * scoring->targets.size;
 	git_merge_diff *conflict_src, *conflict_tgt;
 	int similarity;
 
-	git_vector_foreach(&diff_list->conflicts, i, conflict_src) {
+	conflict_src = GIT_VECTOR_GET(conflicts, i);
+
+	for (k = 0; k < scoring->targets.size; k++) {
+		j = *git_array_get(scoring->targets, k);
+		conflict_tgt = GIT_VECTOR_GET(conflicts, j);
+
+		if (GIT_MERGE_INDEX_ENTRY_EXISTS(conflict_tgt->our_entry) &&
+			!GIT_MERGE_INDEX_ENTRY_EXISTS(conflict_src->our_entry)) {
+			similarity = merge_similarity_score(scoring,
+				&conflict_src->ancestor_entry, i,
+				&conflict_tgt->our_entry, conflicts->length + j);
+
+			if (similarity == GIT_EBUFS)
+				similarity = 0;
+			else if (similarity < 0)
+				return similarity;
+
+			scoring->ours[offset + k] = similarity;
+		}
+
+		if (GIT_MERGE_INDEX_ENTRY_EXISTS(conflict_tgt->their_entry) &&
+			!GIT_MERGE_INDEX_ENTRY_EXISTS(conflict_src->their_entry)) {
+			similarity = merge_similarity_score(scoring,
+				&conflict_src->ancestor_entry, i,
+				&conflict_tgt->their_entry, (conflicts->length * 2) + j);
+
+			if (similarity == GIT_EBUFS)
+				similarity = 0;
+			else if (similarity < 0)
+				return similarity;
+
+			scoring->theirs[offset + k] = similarity;
+		}
+	}
+
+	return 0;
+}
+
+static int merge_similarity_add_entry(
+	merge_similarity_scoring *scoring,
+	size_t cache_idx,
+	git_index_entry *index_entry)
+{
+	merge_similarity_entry *entry;
+
+	if (!GIT_MODE_ISBLOB(index_entry->mode))
+		return 0;
+
+	entry = git_array_alloc(scoring->entries);
+	GIT_ERROR_CHECK_ALLOC(entry);
+
+	entry->cache_idx = cache_idx;
+	entry->entry = index_entry;
+	return 0;
+}
+
+static int merge_similarity_add_index(
+	merge_similarity_indices *indices, size_t idx)
+{
+	size_t *entry = git_array_alloc(*indices);
+	GIT_ERROR_CHECK_ALLOC(entry);
+
+	*entry = idx;
+	return 0;
+}
+
+static int merge_similarity_scoring_init(
+	merge_similarity_scoring *scoring)
+{
+	git_vector *conflicts = &scoring->diff_list->conflicts;
+	git_merge_diff *conflict;
+	size_t i, rows;
+	int error = 0;
+
+	git_vector_foreach(conflicts, i, conflict) {
 		/* Items can be the source of a rename iff they have an item in the
 		 * ancestor slot and lack an item in the ours or theirs slot. */
-		if (!GIT_MERGE_INDEX_ENTRY_EXISTS(conflict_src->ancestor_entry) ||
-			(GIT_MERGE_INDEX_ENTRY_EXISTS(conflict_src->our_entry) &&
-			 GIT_MERGE_INDEX_ENTRY_EXISTS(conflict_src->their_entry)))
+		if (GIT_MERGE_INDEX_ENTRY_EXISTS(conflict->ancestor_entry) &&
+			(!GIT_MERGE_INDEX_ENTRY_EXISTS(conflict->our_entry) ||
+			 !GIT_MERGE_INDEX_ENTRY_EXISTS(conflict->their_entry))) {
+			if ((error = merge_similarity_add_index(&scoring->sources, i)) < 0 ||
+			    (error = merge_similarity_add_entry(scoring, i, &conflict->ancestor_entry)) < 0)
+				return error;
+		}
+
+		if (GIT_MERGE_INDEX_ENTRY_EXISTS(conflict->ancestor_entry))
 			continue;
 
-		git_vector_foreach(&diff_list->conflicts, j, conflict_tgt) {
-			size_t our_idx = diff_list->conflicts.length + j;
-			size_t their_idx = (diff_list->conflicts.length * 2) + j;
+		if ((error = merge_similarity_add_index(&scoring->targets, i)) < 0)
+			return error;
+
+		if (GIT_MERGE_INDEX_ENTRY_EXISTS(conflict->our_entry) &&
+		    (error = merge_similarity_add_entry(scoring,
+				conflicts->length + i, &conflict->our_entry)) < 0)
+			return error;
 
-			if (GIT_MERGE_INDEX_ENTRY_EXISTS(conflict_tgt->ancestor_entry))
-				continue;
+		if (GIT_MERGE_INDEX_ENTRY_EXISTS(conflict->their_entry) &&
+		    (error = merge_similarity_add_entry(scoring,
+				(conflicts->length * 2) + i, &conflict->their_entry)) < 0)
+			return error;
+	}
 
-			if (GIT_MERGE_INDEX_ENTRY_EXISTS(conflict_tgt->our_entry) &&
-				!GIT_MERGE_INDEX_ENTRY_EXISTS(conflict_src->our_entry)) {
-				similarity = index_entry_similarity_inexact(repo, &conflict_src->ancestor_entry, i, &conflict_tgt->our_entry, our_idx, cache, opts);
+	GIT_ERROR_CHECK_ALLOC_MULTIPLY(&rows, scoring->sources.size, scoring->targets.size);
+
+	scoring->ours = git__calloc(rows ? rows : 1, sizeof(int));
+	GIT_ERROR_CHECK_ALLOC(scoring->ours);
+	scoring->theirs = git__calloc(rows ? rows : 1, sizeof(int));
+	GIT_ERROR_CHECK_ALLOC(scoring->theirs);
+
+	return 0;
+}
+
+static void merge_similarity_scoring_free(merge_similarity_scoring *scoring)
+{
+	git_array_clear(scoring->entries);
+	git_array_clear(scoring->sources);
+	git_array_clear(scoring->targets);
+	git__free(scoring->ours);
+	git__free(scoring->theirs);
+}
+
+static void merge_similarity_update(
+	struct merge_diff_similarity *similarity,
+	size_t i,
+	size_t j,
+	int score)
+{
+	if (score > similarity[i].similarity &&
+		score > similarity[j].similarity) {
+		/* Clear previous best similarity */
+		if (similarity[i].similarity > 0)
+			similarity[similarity[i].other_idx].similarity = 0;
+
+		if (similarity[j].similarity > 0)
+			similarity[similarity[j].other_idx].similarity = 0;
+
+		similarity[i].similarity = score;
+		similarity[i].other_idx = j;
+
+		similarity[j].similarity = score;
+		similarity[j].other_idx = i;
+	}
+}
+
+static int merge_diff_mark_similarity_inexact(
+	git_repository *repo,
+	git_merge_diff_list *diff_list,
+	struct merge_diff_similarity *similarity_ours,
+	struct merge_diff_similarity *similarity_theirs,
+	void **cache,
+	const git_merge_options *opts)
+{
+	merge_similarity_scoring scoring = {0};
+	size_t row, k, i, j, nthreads = 1;
+	int error;
 
-				if (similarity == GIT_EBUFS)
-					continue;
-				else if (similarity < 0)
-					return similarity;
+	scoring.repo = repo;
+	scoring.diff_list = diff_list;
+	scoring.cache = cache;
+	scoring.opts = opts;
 
-				if (similarity > similarity_ours[i].similarity &&
-					similarity > similarity_ours[j].similarity) {
-					/* Clear previous best similarity */
-					if (similarity_ours[i].similarity > 0)
-						similarity_ours[similarity_ours[i].other_idx].similarity = 0;
+	/* only the builtin metric is known to be safe to use from threads */
+	scoring.preloaded =
+		opts->metric->buffer_signature == git_diff_find_similar__hashsig_for_buf;
 
-					if (similarity_ours[j].similarity > 0)
-						similarity_ours[similarity_ours[j].other_idx].similarity = 0;
+	if ((error = merge_similarity_scoring_init(&scoring)) < 0)
+		goto done;
 
-					similarity_ours[i].similarity = similarity;
-					similarity_ours[i].other_idx = j;
+	if (scoring.preloaded) {
+		nthreads = min(scoring.entries.size / MERGE_RENAME_THREAD_COST + 1,
+			(size_t)git_online_cpus());
 
-					similarity_ours[j].similarity = similarity;
-					similarity_ours[j].other_idx = i;
-				}
-			}
+		if ((error = git_parallel_foreach(scoring.entries.size, nthreads,
+				merge_similarity_entry_cb, &scoring)) < 0)
+			goto done;
 
-			if (GIT_MERGE_INDEX_ENTRY_EXISTS(conflict_tgt->their_entry) &&
-				!GIT_MERGE_INDEX_ENTRY_EXISTS(conflict_src->their_entry)) {
-				similarity = index_entry_similarity_inexact(repo, &conflict_src->ancestor_entry, i, &conflict_tgt->their_entry, their_idx, cache, opts);
+		nthreads = min(scoring.sources.size / MERGE_RENAME_THREAD_COST + 1,
+			(size_t)git_online_cpus());
+	}
 
-				if (similarity > similarity_theirs[i].similarity &&
-					similarity > similarity_theirs[j].similarity) {
-					/* Clear previous best similarity */
-					if (similarity_theirs[i].similarity > 0)
-						similarity_theirs[similarity_theirs[i].other_idx].similarity = 0;
+	if ((error = git_parallel_foreach(scoring.sources.size, nthreads,
+			merge_similarity_row_cb, &scoring)) < 0)
+		goto done;
 
-					if (similarity_theirs[j].similarity > 0)
-						similarity_theirs[similarity_theirs[j].other_idx].similarity = 0;
+	for (row = 0; row < scoring.sources.size; row++) {
+		i = *git_array_get(scoring.sources, row);
 
-					similarity_theirs[i].similarity = similarity;
-					similarity_theirs[i].other_idx = j;
+		for (k = 0; k < scoring.targets.size; k++) {
+			j = *git_array_get(scoring.targets, k);
 
-					similarity_theirs[j].similarity = similarity;
-					similarity_theirs[j].other_idx = i;
-				}
-			}
+			merge_similarity_update(similarity_ours, i, j,
+				scoring.ours[row * scoring.targets.size + k]);
+			merge_similarity_update(similarity_theirs, i, j,
+				scoring.theirs[row * scoring.targets.size + k]);
 		}
 	}
 
-	return 0;
+done:
+	merge_similarity_scoring_free(&scoring);
+	return error;
 }
 
 /*
@@ -1902,6 +2466,33 @@ done:
 }
 
 
+static void merge_normalized_opts_dispose(
+	git_merge_options *opts,
+	const git_merge_options *given)
+{
+	if (!given || !given->metric)
+		git__free(opts->metric);
+
+	git__free((char *)opts->default_driver);
+}
+
+static void merge_file_opts_from_merge_opts(
+	git_merge_file_options *file_opts,
+	const git_merge_options *opts)
+{
+	file_opts->favor = opts->file_favor;
+	file_opts->flags = opts->file_flags;
+
+	/* use the git-inspired labels when virtual base building */
+	if (opts->flags & GIT_MERGE__VIRTUAL_BASE) {
+		file_opts->ancestor_label = "merged common ancestors";
+		file_opts->our_label = "Temporary merge branch 1";
+		file_opts->their_label = "Temporary merge branch 2";
+		file_opts->flags |= GIT_MERGE_FILE_FAVOR__CONFLICTED;
+		file_opts->marker_size = GIT_MERGE_CONFLICT_MARKER_SIZE + 2;
+	}
+}
+
 static int merge_index_insert_reuc(
 	git_index *index,
 	size_t idx,
@@ -2067,6 +2658,7 @@ int git_merge__iterators(
 	git_merge_file_options file_opts = GIT_MERGE_FILE_OPTIONS_INIT;
 	git_merge_diff *conflict;
 	git_vector changes;
+	merge_contents contents = {{0}};
 	size_t i;
 	int error = 0;
 
@@ -2080,17 +2672,7 @@ int git_merge__iterators(
 	if ((error = merge_normalize_opts(repo, &opts, given_opts)) < 0)
 		return error;
 
-	file_opts.favor = opts.file_favor;
-	file_opts.flags = opts.file_flags;
-
-	/* use the git-inspired labels when virtual base building */
-	if (opts.flags & GIT_MERGE__VIRTUAL_BASE) {
-		file_opts.ancestor_label = "merged common ancestors";
-		file_opts.our_label = "Temporary merge branch 1";
-		file_opts.their_label = "Temporary merge branch 2";
-		file_opts.flags |= GIT_MERGE_FILE_FAVOR__CONFLICTED;
-		file_opts.marker_size = GIT_MERGE_CONFLICT_MARKER_SIZE + 2;
-	}
+	merge_file_opts_from_merge_opts(&file_opts, &opts);
 
 	diff_list = git_merge_diff_list__alloc(repo);
 	GIT_ERROR_CHECK_ALLOC(diff_list);
@@ -2107,11 +2689,17 @@ int git_merge__iterators(
 	memcpy(&changes, &diff_list->conflicts, sizeof(git_vector));
 	git_vector_clear(&diff_list->conflicts);
 
+	if ((error = merge_contents_init(&contents,
+			diff_list, &changes, &opts, &file_opts)) < 0)
+		goto done;
+
 	git_vector_foreach(&changes, i, conflict) {
+		merge_contents_job *job;
 		int resolved = 0;
 
-		if ((error = merge_conflict_resolve(
-			&resolved, diff_list, conflict, &opts, &file_opts)) < 0)
+		if ((error = merge_contents_job_for(&job, &contents, i)) < 0 ||
+		    (error = merge_conflict_resolve(&resolved,
+				diff_list, conflict, &opts, &file_opts, job)) < 0)
 			goto done;
 
 		if (!resolved) {
@@ -2129,11 +2717,9 @@ int git_merge__iterators(
 		(opts.flags & GIT_MERGE_SKIP_REUC));
 
 done:
-	if (!given_opts || !given_opts->metric)
-		git__free(opts.metric);
-
-	git__free((char *)opts.default_driver);
+	merge_normalized_opts_dispose(&opts, given_opts);
 
+	merge_contents_free(&contents);
 	git_merge_diff_list__free(diff_list);
 	git_iterator_free(empty_ancestor);
 	git_iterator_free(empty_ours);
@@ -2195,6 +2781,474 @@ done:
 	return error;
 }
 
+/*
+ * Tree-only merge: walk the three trees together, taking any entry or
+ * subtree that only one side changed as it is, and only descending into
+ * subtrees that both sides changed.  Files changed on both sides are
+ * resolved the same way `git_merge__iterators` resolves them.  Changes
+ * that depend on the rest of the merge (directory/file conflicts, and
+ * adds and deletes that rename detection may pair up) make the walk give
+ * up with GIT_PASSTHROUGH so that the full merge can be run instead.
+ */
+typedef struct {
+	git_repository *repo;
+	const git_merge_options *opts;
+	const git_merge_file_options *file_opts;
+	git_merge_diff_list *diff_list;
+	git_index *conflicts;
+	git_buf path;
+} merge_tree_data;
+
+GIT_INLINE(bool) merge_tree_entry_eq(
+	const git_tree_entry *a, const git_tree_entry *b)
+{
+	if (!a || !b)
+		return (a == b);
+
+	return git_tree_entry_filemode_raw(a) == git_tree_entry_filemode_raw(b) &&
+		git_oid_equal(git_tree_entry_id(a), git_tree_entry_id(b));
+}
+
+GIT_INLINE(bool) merge_tree_eq(const git_tree *a, const git_tree *b)
+{
+	if (!a || !b)
+		return (a == b);
+
+	return git_oid_equal(git_tree_id(a), git_tree_id(b));
+}
+
+GIT_INLINE(bool) merge_tree_entry_is_tree(const git_tree_entry *entry)
+{
+	return entry && git_tree_entry_type(entry) == GIT_OBJECT_TREE;
+}
+
+static int merge_tree_update(
+	git_treebuilder *bld,
+	const char *name,
+	const git_oid *id,
+	git_filemode_t mode)
+{
+	if (id)
+		return git_treebuilder_insert(NULL, bld, name, id, mode);
+
+	if (git_treebuilder_get(bld, name) == NULL)
+		return 0;
+
+	return git_treebuilder_remove(bld, name);
+}
+
+static void merge_tree_index_entry(
+	git_index_entry *out,
+	const git_tree_entry *entry,
+	const char *path)
+{
+	memset(out, 0, sizeof(git_index_entry));
+
+	out->mode = git_tree_entry_filemode_raw(entry);
+	out->path = path;
+	git_oid_cpy(&out->id, git_tree_entry_id(entry));
+}
+
+static int merge_tree_file(
+	merge_tree_data *data,
+	git_treebuilder *bld,
+	const char *name,
+	const git_tree_entry *tree_entries[3])
+{
+	git_index_entry entries[3];
+	const git_index_entry *items[3] = { NULL, NULL, NULL };
+	const git_index_entry *result;
+	git_merge_diff *conflict;
+	size_t i, staged = git_vector_length(&data->diff_list->staged);
+	int resolved = 0, error;
+
+	for (i = 0; i < 3; i++) {
+		if (tree_entries[i]) {
+			merge_tree_index_entry(&entries[i],
+				tree_entries[i], data->path.ptr);
+			items[i] = &entries[i];
+		}
+	}
+
+	if ((conflict = merge_diff_from_index_entries(data->diff_list, items)) == NULL ||
+	    merge_diff_detect_type(conflict) < 0)
+		return -1;
+
+	if ((error = merge_conflict_resolve(&resolved, data->diff_list,
+			conflict, data->opts, data->file_opts, NULL)) < 0)
+		return error;
+
+	if (resolved) {
+		result = git_vector_length(&data->diff_list->staged) > staged ?
+			git_vector_last(&data->diff_list->staged) : NULL;
+
+		return merge_tree_update(bld, name,
+			result ? &result->id : NULL,
+			result ? result->mode : 0);
+	}
+
+	if ((data->opts->flags & GIT_MERGE_FAIL_ON_CONFLICT)) {
+		git_error_set(GIT_ERROR_MERGE, "merge conflicts exist");
+		return GIT_EMERGECONFLICT;
+	}
+
+	if (!data->conflicts && (error = git_index_new(&data->conflicts)) < 0)
+		return error;
+
+	return git_index_conflict_add(data->conflicts, items[TREE_IDX_ANCESTOR],
+		items[TREE_IDX_OURS], items[TREE_IDX_THEIRS]);
+}
+
+static int merge_tree_level(
+	git_oid *out,
+	merge_tree_data *data,
+	const git_tree *ancestor_tree,
+	const git_tree *our_tree,
+	const git_tree *their_tree);
+
+static int merge_tree_subtree(
+	merge_tree_data *data,
+	git_treebuilder *bld,
+	const char *name,
+	const git_tree_entry *tree_entries[3])
+{
+	git_tree *trees[3] = { NULL, NULL, NULL };
+	size_t i, path_len = git_buf_len(&data->path);
+	git_oid id;
+	int error = 0;
+
+	for (i = 0; i < 3; i++) {
+		if (tree_entries[i] && (error = git_tree_lookup(&trees[i],
+				data->repo, git_tree_entry_id(tree_entries[i]))) < 0)
+			goto done;
+	}
+
+	if ((error = git_buf_puts(&data->path, name)) < 0 ||
+	    (error = git_buf_putc(&data->path, '/')) < 0 ||
+	    (error = merge_tree_level(&id, data,
+			trees[TREE_IDX_ANCESTOR], trees[TREE_IDX_OURS],
+			trees[TREE_IDX_THEIRS])) < 0)
+		goto done;
+
+	git_buf_truncate(&data->path, path_len);
+
+	/* a subtree that was emptied by the merge is removed */
+	error = merge_tree_update(bld, name,
+		git_oid_is_zero(&id) ? NULL : &id, GIT_FILEMODE_TREE);
+
+done:
+	for (i = 0; i < 3; i++)
+		git_tree_free(trees[i]);
+
+	return error;
+}
+
+static int merge_tree_entry(
+	merge_tree_data *data,
+	git_treebuilder *bld,
+	const git_tree_entry *tree_entries[3])
+{
+	const git_tree_entry *ancestor = tree_entries[TREE_IDX_ANCESTOR],
+		*ours = tree_entries[TREE_IDX_OURS],
+		*theirs = tree_entries[TREE_IDX_THEIRS];
+	bool find_renames = (data->opts->flags & GIT_MERGE_FIND_RENAMES) != 0;
+	bool is_tree;
+	const char *name;
+	size_t i, path_len;
+	int error;
+
+	name = git_tree_entry_name(ours ? ours : theirs ? theirs : ancestor);
+
+	/* an add or a delete on both sides may be part of a rename */
+	if (find_renames &&
+	    ((!ancestor && ours && theirs) || (ancestor && !ours && !theirs)))
+		return GIT_PASSTHROUGH;
+
+	if (merge_tree_entry_eq(ours, theirs) ||
+	    merge_tree_entry_eq(ancestor, theirs))
+		return 0;
+
+	if (merge_tree_entry_eq(ancestor, ours))
+		return merge_tree_update(bld, name,
+			theirs ? git_tree_entry_id(theirs) : NULL,
+			theirs ? git_tree_entry_filemode_raw(theirs) : 0);
+
+	/* changed on both sides */
+	if (find_renames && (!ancestor || !ours || !theirs))
+		return GIT_PASSTHROUGH;
+
+	is_tree = merge_tree_entry_is_tree(ours ? ours : theirs);
+
+	for (i = 0; i < 3; i++) {
+		if (tree_entries[i] &&
+		    merge_tree_entry_is_tree(tree_entries[i]) != is_tree)
+			return GIT_PASSTHROUGH;
+	}
+
+	if (is_tree)
+		return merge_tree_subtree(data, bld, name, tree_entries);
+
+	path_len = git_buf_len(&data->path);
+
+	if ((error = git_buf_puts(&data->path, name)) == 0)
+		error = merge_tree_file(data, bld, name, tree_entries);
+
+	git_buf_truncate(&data->path, path_len);
+
+	return error;
+}
+
+static const git_tree_entry *merge_tree_entry_byname(
+	const git_tree *tree, const char *name)
+{
+	return tree ? git_tree_entry_byname(tree, name) : NULL;
+}
+
+static int merge_tree_level(
+	git_oid *out,
+	merge_tree_data *data,
+	const git_tree *ancestor_tree,
+	const git_tree *our_tree,
+	const git_tree *their_tree)
+{
+	const git_tree *trees[3] = { ancestor_tree, our_tree, their_tree };
+	const git_tree_entry *entries[3];
+	const git_tree *result = NULL;
+	git_treebuilder *bld = NULL;
+	const char *name;
+	size_t i, j, k;
+	int error = 0;
+
+	memset(out, 0, sizeof(git_oid));
+
+	if (merge_tree_eq(our_tree, their_tree) ||
+	    merge_tree_eq(ancestor_tree, their_tree))
+		result = our_tree;
+	else if (merge_tree_eq(ancestor_tree, our_tree))
+		result = their_tree;
+	else
+		goto merge;
+
+	if (result && git_tree_entrycount(result) > 0)
+		git_oid_cpy(out, git_tree_id(result));
+
+	return 0;
+
+merge:
+	if ((error = git_treebuilder_new(&bld, data->repo, our_tree)) < 0)
+		return error;
+
+	/* visit each name once: ours first, then theirs, then the ancestor */
+	for (i = TREE_IDX_OURS; i < 3 + TREE_IDX_OURS; i++) {
+		const git_tree *tree = trees[i % 3];
+		size_t count = tree ? git_tree_entrycount(tree) : 0;
+
+		for (j = 0; j < count; j++) {
+			name = git_tree_entry_name(git_tree_entry_byindex(tree, j));
+
+			for (k = TREE_IDX_OURS; k < i; k++) {
+				if (merge_tree_entry_byname(trees[k % 3], name))
+					break;
+			}
+
+			if (k < i)
+				continue;
+
+			for (k = 0; k < 3; k++)
+				entries[k] = merge_tree_entry_byname(trees[k], name);
+
+			if ((error = merge_tree_entry(data, bld, entries)) < 0)
+				goto done;
+		}
+	}
+
+	/* with conflicts there is no result tree, only the conflicts */
+	if (!data->conflicts && git_treebuilder_entrycount(bld) > 0)
+		error = git_treebuilder_write(out, bld);
+
+done:
+	git_treebuilder_free(bld);
+	return error;
+}
+
+static int merge_tree_conflicts_from_index(git_index **out, git_index *index)
+{
+	git_index *conflicts = NULL;
+	git_index_conflict_iterator *iter = NULL;
+	const git_index_entry *ancestor, *ours, *theirs;
+	const git_index_name_entry *name;
+	size_t i;
+	int error;
+
+	if ((error = git_index_new(&conflicts)) < 0 ||
+	    (error = git_index_conflict_iterator_new(&iter, index)) < 0)
+		goto done;
+
+	while ((error = git_index_conflict_next(&ancestor, &ours, &theirs, iter)) == 0) {
+		if ((error = git_index_conflict_add(conflicts, ancestor, ours, theirs)) < 0)
+			goto done;
+	}
+
+	if (error != GIT_ITEROVER)
+		goto done;
+
+	error = 0;
+
+	for (i = 0; i < git_index_name_entrycount(index); i++) {
+		name = git_index_name_get_byindex(index, i);
+
+		if ((error = git_index_name_add(conflicts,
+				name->ancestor, name->ours, name->theirs)) < 0)
+			goto done;
+	}
+
+	*out = conflicts;
+	conflicts = NULL;
+
+done:
+	git_index_conflict_iterator_free(iter);
+	git_index_free(conflicts);
+	return error;
+}
+
+/*
+ * Run the full merge into an index, for when the tree walk cannot
+ * decide the result by itself.
+ */
+static int merge_trees_to_tree_with_index(
+	git_oid *out,
+	git_index **conflicts_out,
+	git_index **index_out,
+	git_repository *repo,
+	const git_tree *ancestor_tree,
+	const git_tree *our_tree,
+	const git_tree *their_tree,
+	const git_merge_options *opts)
+{
+	git_index *index = NULL;
+	int error;
+
+	if ((error = git_merge_trees(&index, repo,
+			ancestor_tree, our_tree, their_tree, opts)) < 0)
+		goto done;
+
+	if (git_index_has_conflicts(index)) {
+		if (conflicts_out &&
+		    (error = merge_tree_conflicts_from_index(conflicts_out, index)) < 0)
+			goto done;
+
+		if (index_out) {
+			*index_out = index;
+			index = NULL;
+		}
+
+		git_error_set(GIT_ERROR_MERGE, "merge conflicts exist");
+		error = GIT_EMERGECONFLICT;
+		goto done;
+	}
+
+	error = git_index_write_tree_to(out, index, repo);
+
+done:
+	git_index_free(index);
+	return error;
+}
+
+int git_merge__trees_to_tree(
+	git_oid *out,
+	git_index **conflicts_out,
+	git_index **index_out,
+	git_repository *repo,
+	const git_tree *ancestor_tree,
+	const git_tree *our_tree,
+	const git_tree *their_tree,
+	const git_merge_options *given_opts)
+{
+	merge_tree_data data = { 0 };
+	git_merge_options opts;
+	git_merge_file_options file_opts = GIT_MERGE_FILE_OPTIONS_INIT;
+	git_treebuilder *bld = NULL;
+	int error;
+
+	assert(out && repo);
+
+	memset(out, 0, sizeof(git_oid));
+
+	if (conflicts_out)
+		*conflicts_out = NULL;
+
+	if (index_out)
+		*index_out = NULL;
+
+	GIT_ERROR_CHECK_VERSION(
+		given_opts, GIT_MERGE_OPTIONS_VERSION, "git_merge_options");
+
+	if ((error = merge_normalize_opts(repo, &opts, given_opts)) < 0)
+		return error;
+
+	merge_file_opts_from_merge_opts(&file_opts, &opts);
+
+	data.repo = repo;
+	data.opts = &opts;
+	data.file_opts = &file_opts;
+
+	if ((data.diff_list = git_merge_diff_list__alloc(repo)) == NULL) {
+		error = -1;
+		goto done;
+	}
+
+	error = merge_tree_level(out, &data, ancestor_tree, our_tree, their_tree);
+
+	if (error == GIT_PASSTHROUGH) {
+		error = merge_trees_to_tree_with_index(out, conflicts_out, index_out,
+			repo, ancestor_tree, our_tree, their_tree, given_opts);
+		goto done;
+	}
+
+	if (error < 0)
+		goto done;
+
+	if (data.conflicts) {
+		memset(out, 0, sizeof(git_oid));
+
+		if (conflicts_out) {
+			*conflicts_out = data.conflicts;
+			data.conflicts = NULL;
+		}
+
+		git_error_set(GIT_ERROR_MERGE, "merge conflicts exist");
+		error = GIT_EMERGECONFLICT;
+		goto done;
+	}
+
+	/* a merge that removed every file still has an (empty) root tree */
+	if (git_oid_is_zero(out) &&
+	    (error = git_treebuilder_new(&bld, repo, NULL)) == 0)
+		error = git_treebuilder_write(out, bld);
+
+done:
+	git_treebuilder_free(bld);
+	git_index_free(data.conflicts);
+	git_buf_dispose(&data.path);
+	git_merge_diff_list__free(data.diff_list);
+	merge_normalized_opts_dispose(&opts, given_opts);
+
+	return error;
+}
+
+int git_merge_trees_to_tree(
+	git_oid *out,
+	git_index **conflicts_out,
+	git_repository *repo,
+	const git_tree *ancestor_tree,
+	const git_tree *our_tree,
+	const git_tree *their_tree,
+	const git_merge_options *given_opts)
+{
+	return git_merge__trees_to_tree(out, conflicts_out, NULL, repo,
+		ancestor_tree, our_tree, their_tree, given_opts);
+}
+
 static int merge_annotated_commits(
 	git_index **index_out,
 	git_annotated_commit **base_out,
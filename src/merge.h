@@ -125,6 +125,15 @@ typedef struct {
 
 } git_merge_diff;
 
+/*
+ * Determine whether `ancestor` is reachable from `commit`; returns 1 if
+ * it is, 0 if it is not, or an error code.
+ */
+int git_merge__descendant_of(
+	git_revwalk *walk,
+	git_commit_list_node *commit,
+	git_commit_list_node *ancestor);
+
 int git_merge__bases_many(
 	git_commit_list **out,
 	git_revwalk *walk,
@@ -163,6 +172,23 @@ int git_merge__iterators(
 	git_iterator *their_iter,
 	const git_merge_options *given_opts);
 
+/*
+ * Like `git_merge_trees_to_tree`; when the merge has conflicts and the
+ * full merge had to be run to find them, its index is also given in
+ * `index_out` (if it is not NULL), so that a caller who needs all of
+ * the merged entries does not have to merge again.  Otherwise,
+ * `index_out` is set to NULL.
+ */
+int git_merge__trees_to_tree(
+	git_oid *out,
+	git_index **conflicts_out,
+	git_index **index_out,
+	git_repository *repo,
+	const git_tree *ancestor_tree,
+	const git_tree *our_tree,
+	const git_tree *their_tree,
+	const git_merge_options *given_opts);
+
 int git_merge__check_result(git_repository *repo, git_index *index_new);
 
 int git_merge__append_conflicts_to_merge_msg(git_repository *repo, git_index *index);
@@ -746,6 +746,99 @@ int git_patch_generated_from_diff(
 	return error;
 }
 
+typedef struct {
+	size_t adds;
+	size_t dels;
+} patch_generated_line_counts;
+
+static int patch_generated_count_hunk_cb(
+	const git_diff_delta *delta,
+	const git_diff_hunk *hunk,
+	void *payload)
+{
+	GIT_UNUSED(delta); GIT_UNUSED(hunk); GIT_UNUSED(payload);
+	return 0;
+}
+
+static int patch_generated_count_line_cb(
+	const git_diff_delta *delta,
+	const git_diff_hunk *hunk,
+	const git_diff_line *line,
+	void *payload)
+{
+	patch_generated_line_counts *counts = payload;
+
+	GIT_UNUSED(delta); GIT_UNUSED(hunk);
+
+	/* like git_patch_line_stats, don't count EOFNL marks */
+	if (line->origin == GIT_DIFF_LINE_ADDITION)
+		counts->adds++;
+	else if (line->origin == GIT_DIFF_LINE_DELETION)
+		counts->dels++;
+
+	return 0;
+}
+
+int git_patch_generated_line_stats(
+	size_t *total_adds,
+	size_t *total_dels,
+	git_diff *diff,
+	size_t idx,
+	git_mutex *init_lock)
+{
+	git_xdiff_output xo;
+	git_diff_delta *delta;
+	git_patch_generated patch;
+	patch_generated_line_counts counts = { 0, 0 };
+	int error;
+
+	*total_adds = *total_dels = 0;
+
+	if (diff_required(diff, "git_patch_generated_line_stats") < 0)
+		return -1;
+
+	if ((delta = git_vector_get(&diff->deltas, idx)) == NULL) {
+		git_error_set(GIT_ERROR_INVALID, "index out of range for delta in diff");
+		return GIT_ENOTFOUND;
+	}
+
+	if (git_diff_delta__should_skip(&diff->opts, delta))
+		return 0;
+
+	/* looking up the diff drivers is not safe to do concurrently */
+	if (init_lock && git_mutex_lock(init_lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "unable to lock diff");
+		return -1;
+	}
+
+	error = patch_generated_init(&patch, diff, idx);
+
+	if (init_lock)
+		git_mutex_unlock(init_lock);
+
+	/* the patch only holds a reference to the diff once initialized */
+	if (error < 0) {
+		patch.diff = NULL;
+		goto done;
+	}
+
+	memset(&xo, 0, sizeof(xo));
+	diff_output_init(&xo.output, &diff->opts, NULL, NULL,
+		patch_generated_count_hunk_cb, patch_generated_count_line_cb,
+		&counts);
+	git_xdiff_init(&xo, &diff->opts);
+
+	if ((error = patch_generated_create(&patch, &xo.output)) < 0)
+		goto done;
+
+	*total_adds = counts.adds;
+	*total_dels = counts.dels;
+
+done:
+	patch_generated_free(&patch.base);
+	return error;
+}
+
 git_diff_driver *git_patch_generated_driver(git_patch_generated *patch)
 {
 	/* ofile driver is representative for whole patch */
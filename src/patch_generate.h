@@ -46,6 +46,16 @@ extern void git_patch_generated_new_data(
 extern int git_patch_generated_from_diff(
 	git_patch **, git_diff *, size_t);
 
+/*
+ * Count the added and deleted lines of a delta, without building a
+ * patch for it.  Several deltas of a diff between trees and the index
+ * may be counted concurrently, provided that the callers share an
+ * `init_lock` (which may be NULL otherwise).
+ */
+extern int git_patch_generated_line_stats(
+	size_t *adds, size_t *dels, git_diff *diff, size_t idx,
+	git_mutex *init_lock);
+
 typedef struct git_patch_generated_output git_patch_generated_output;
 
 struct git_patch_generated_output {
@@ -1341,6 +1341,14 @@ int git_path_diriter_stat(struct stat *out, git_path_diriter *diriter)
 		diriter->path);
 }
 
+mode_t git_path_diriter_filetype(git_path_diriter *diriter)
+{
+	assert(diriter);
+
+	/* the stat data already comes from the directory listing */
+	return 0;
+}
+
 void git_path_diriter_free(git_path_diriter *diriter)
 {
 	if (diriter == NULL)
@@ -1419,6 +1427,19 @@ int git_path_diriter_next(git_path_diriter *diriter)
 	filename = de->d_name;
 	filename_len = strlen(filename);
 
+#ifdef DT_DIR
+	switch (de->d_type) {
+	case DT_DIR: diriter->type = S_IFDIR; break;
+	case DT_REG: diriter->type = S_IFREG; break;
+	case DT_LNK: diriter->type = S_IFLNK; break;
+	case DT_FIFO: diriter->type = S_IFIFO; break;
+	case DT_SOCK: diriter->type = S_IFSOCK; break;
+	case DT_CHR: diriter->type = S_IFCHR; break;
+	case DT_BLK: diriter->type = S_IFBLK; break;
+	default: diriter->type = 0; break;
+	}
+#endif
+
 #ifdef GIT_USE_ICONV
 	if ((diriter->flags & GIT_PATH_DIR_PRECOMPOSE_UNICODE) != 0 &&
 		(error = git_path_iconv(&diriter->ic, &filename, &filename_len)) < 0)
@@ -1472,6 +1493,13 @@ int git_path_diriter_stat(struct stat *out, git_path_diriter *diriter)
 	return git_path_lstat(diriter->path.ptr, out);
 }
 
+mode_t git_path_diriter_filetype(git_path_diriter *diriter)
+{
+	assert(diriter);
+
+	return diriter->type;
+}
+
 void git_path_diriter_free(git_path_diriter *diriter)
 {
 	if (diriter == NULL)
@@ -486,6 +486,7 @@ struct git_path_diriter
 	unsigned int flags;
 
 	DIR *dir;
+	mode_t type;
 
 #ifdef GIT_USE_ICONV
 	git_path_iconv_t ic;
@@ -555,6 +556,16 @@ extern int git_path_diriter_fullpath(
  */
 extern int git_path_diriter_stat(struct stat *out, git_path_diriter *diriter);
 
+/**
+ * Returns the file type (`S_IFDIR`, `S_IFREG`, `S_IFLNK`, ...) of the
+ * current item in the iterator, when the directory listing reported it.
+ * Returns 0 when the type is unknown and the item must be `lstat`ed.
+ *
+ * @param diriter The directory iterator
+ * @return the file type bits of the item's mode, or 0
+ */
+extern mode_t git_path_diriter_filetype(git_path_diriter *diriter);
+
 /**
  * Closes the directory iterator.
  *
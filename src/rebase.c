@@ -75,6 +75,13 @@ struct git_rebase {
 	git_index *index;
 	git_commit *last_commit;
 
+	/*
+	 * Result of the last clean in-memory merge; when `index_stale` is
+	 * set, `index` does not reflect it yet and is loaded on demand.
+	 */
+	git_oid tree_id;
+	bool index_stale;
+
 	/* Used by regular (not in-memory) merge-style rebase */
 	git_oid orig_head_id;
 	char *orig_head_name;
@@ -852,6 +859,26 @@ done:
 	return error;
 }
 
+static int rebase_inmemory_index_load(git_rebase *rebase)
+{
+	git_tree *tree = NULL;
+	int error;
+
+	if (!rebase->index_stale)
+		return 0;
+
+	if ((error = git_tree_lookup(&tree, rebase->repo, &rebase->tree_id)) < 0 ||
+		(!rebase->index && (error = git_index_new(&rebase->index)) < 0) ||
+		(error = git_index_read_tree(rebase->index, tree)) < 0)
+		goto done;
+
+	rebase->index_stale = false;
+
+done:
+	git_tree_free(tree);
+	return error;
+}
+
 static int rebase_next_inmemory(
 	git_rebase_operation **out,
 	git_rebase *rebase)
@@ -859,7 +886,7 @@ static int rebase_next_inmemory(
 	git_commit *current_commit = NULL, *parent_commit = NULL;
 	git_tree *current_tree = NULL, *head_tree = NULL, *parent_tree = NULL;
 	git_rebase_operation *operation;
-	git_index *index = NULL;
+	git_index *index = NULL, *conflicts = NULL;
 	unsigned int parent_count;
 	int error;
 
@@ -881,16 +908,44 @@ static int rebase_next_inmemory(
 			goto done;
 	}
 
-	if ((error = git_commit_tree(&head_tree, rebase->last_commit)) < 0 ||
-		(error = git_merge_trees(&index, rebase->repo, parent_tree, head_tree, current_tree, &rebase->options.merge_options)) < 0)
+	if ((error = git_commit_tree(&head_tree, rebase->last_commit)) < 0)
 		goto done;
 
-	if (!rebase->index) {
-		rebase->index = index;
-		index = NULL;
-	} else {
-		if ((error = git_index_read_index(rebase->index, index)) < 0)
+	/*
+	 * Merge straight to a tree first; this only descends into the
+	 * subtrees that the picked commit changed.  The index is only
+	 * needed when there are conflicts for the caller to resolve, and
+	 * it is reused if the full merge already had to be run.
+	 */
+	error = git_merge__trees_to_tree(&rebase->tree_id, &conflicts, &index,
+		rebase->repo, parent_tree, head_tree, current_tree,
+		&rebase->options.merge_options);
+
+	if (error == 0) {
+		rebase->index_stale = true;
+
+		/* keep an index that the caller is holding on to up to date */
+		if (rebase->index && GIT_REFCOUNT_VAL(rebase->index) > 1 &&
+			(error = rebase_inmemory_index_load(rebase)) < 0)
+			goto done;
+	} else if (error == GIT_EMERGECONFLICT && conflicts) {
+		git_error_clear();
+		rebase->index_stale = false;
+
+		if (!index &&
+			(error = git_merge_trees(&index, rebase->repo, parent_tree,
+				head_tree, current_tree, &rebase->options.merge_options)) < 0)
 			goto done;
+
+		if (!rebase->index) {
+			rebase->index = index;
+			index = NULL;
+		} else {
+			if ((error = git_index_read_index(rebase->index, index)) < 0)
+				goto done;
+		}
+	} else {
+		goto done;
 	}
 
 	*out = operation;
@@ -901,6 +956,7 @@ done:
 	git_tree_free(current_tree);
 	git_tree_free(head_tree);
 	git_tree_free(parent_tree);
+	git_index_free(conflicts);
 	git_index_free(index);
 
 	return error;
@@ -931,7 +987,12 @@ int git_rebase_inmemory_index(
 	git_index **out,
 	git_rebase *rebase)
 {
-	assert(out && rebase && rebase->index);
+	int error;
+
+	assert(out && rebase && (rebase->index || rebase->index_stale));
+
+	if ((error = rebase_inmemory_index_load(rebase)) < 0)
+		return error;
 
 	GIT_REFCOUNT_INC(rebase->index);
 	*out = rebase->index;
@@ -943,6 +1004,7 @@ static int rebase_commit__create(
 	git_commit **out,
 	git_rebase *rebase,
 	git_index *index,
+	const git_oid *merged_tree_id,
 	git_commit *parent_commit,
 	const git_signature *author,
 	const git_signature *committer,
@@ -961,15 +1023,18 @@ static int rebase_commit__create(
 
 	operation = git_array_get(rebase->operations, rebase->current);
 
-	if (git_index_has_conflicts(index)) {
+	if (merged_tree_id) {
+		git_oid_cpy(&tree_id, merged_tree_id);
+	} else if (git_index_has_conflicts(index)) {
 		git_error_set(GIT_ERROR_REBASE, "conflicts have not been resolved");
 		error = GIT_EUNMERGED;
 		goto done;
+	} else if ((error = git_index_write_tree_to(&tree_id, index, rebase->repo)) < 0) {
+		goto done;
 	}
 
 	if ((error = git_commit_lookup(&current_commit, rebase->repo, &operation->id)) < 0 ||
 		(error = git_commit_tree(&parent_tree, parent_commit)) < 0 ||
-		(error = git_index_write_tree_to(&tree_id, index, rebase->repo)) < 0 ||
 		(error = git_tree_lookup(&tree, rebase->repo, &tree_id)) < 0)
 		goto done;
 
@@ -1061,7 +1126,7 @@ static int rebase_commit_merge(
 		(error = git_repository_head(&head, rebase->repo)) < 0 ||
 		(error = git_reference_peel((git_object **)&head_commit, head, GIT_OBJECT_COMMIT)) < 0 ||
 		(error = git_repository_index(&index, rebase->repo)) < 0 ||
-		(error = rebase_commit__create(&commit, rebase, index, head_commit,
+		(error = rebase_commit__create(&commit, rebase, index, NULL, head_commit,
 			author, committer, message_encoding, message)) < 0 ||
 		(error = git_reference__update_for_commit(
 			rebase->repo, NULL, "HEAD", git_commit_id(commit), "rebase")) < 0)
@@ -1095,12 +1160,13 @@ static int rebase_commit_inmemory(
 	git_commit *commit = NULL;
 	int error = 0;
 
-	assert(rebase->index);
+	assert(rebase->index || rebase->index_stale);
 	assert(rebase->last_commit);
 	assert(rebase->current < rebase->operations.size);
 
 	if ((error = rebase_commit__create(&commit, rebase, rebase->index,
-		rebase->last_commit, author, committer, message_encoding, message)) < 0)
+		rebase->index_stale ? &rebase->tree_id : NULL, rebase->last_commit,
+		author, committer, message_encoding, message)) < 0)
 		goto done;
 
 	git_commit_free(rebase->last_commit);
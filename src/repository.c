@@ -170,6 +170,13 @@ void git_repository_free(git_repository *repo)
 	git_diff_driver_registry_free(repo->diff_drivers);
 	repo->diff_drivers = NULL;
 
+	git_commit_generations_free(repo->generations);
+	repo->generations = NULL;
+	git_commit_bloom_free(repo->bloom);
+	repo->bloom = NULL;
+	git_hashsig_cache_free(repo->hashsig_cache);
+	repo->hashsig_cache = NULL;
+
 	for (i = 0; i < repo->reserved_names.size; i++)
 		git_buf_dispose(git_array_get(repo->reserved_names, i));
 	git_array_clear(repo->reserved_names);
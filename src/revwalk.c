@@ -8,8 +8,10 @@
 #include "revwalk.h"
 
 #include "commit.h"
+#include "commit_bloom.h"
 #include "odb.h"
 #include "pool.h"
+#include "tree.h"
 
 #include "git2/revparse.h"
 #include "merge.h"
@@ -256,7 +258,7 @@ int git_revwalk_hide_ref(git_revwalk *walk, const char *refname)
 
 static int revwalk_enqueue_timesort(git_revwalk *walk, git_commit_list_node *commit)
 {
-	return git_pqueue_insert(&walk->iterator_time, commit);
+	return git_commit_queue_insert(&walk->iterator_time, commit);
 }
 
 static int revwalk_enqueue_unsorted(git_revwalk *walk, git_commit_list_node *commit)
@@ -268,9 +270,9 @@ static int revwalk_next_timesort(git_commit_list_node **object_out, git_revwalk
 {
 	git_commit_list_node *next;
 
-	while ((next = git_pqueue_pop(&walk->iterator_time)) != NULL) {
+	while ((next = git_commit_queue_pop(&walk->iterator_time)) != NULL) {
 		/* Some commits might become uninteresting after being added to the list */
-		if (!next->uninteresting) {
+		if (!next->uninteresting && !next->treesame) {
 			*object_out = next;
 			return 0;
 		}
@@ -287,7 +289,7 @@ static int revwalk_next_unsorted(git_commit_list_node **object_out, git_revwalk
 
 	while (!(error = get_revision(&next, walk, &walk->iterator_rand))) {
 		/* Some commits might become uninteresting after being added to the list */
-		if (!next->uninteresting) {
+		if (!next->uninteresting && !next->treesame) {
 			*object_out = next;
 			return 0;
 		}
@@ -303,7 +305,7 @@ static int revwalk_next_toposort(git_commit_list_node **object_out, git_revwalk
 
 	while (!(error = get_revision(&next, walk, &walk->iterator_topo))) {
 		/* Some commits might become uninteresting after being added to the list */
-		if (!next->uninteresting) {
+		if (!next->uninteresting && !next->treesame) {
 			*object_out = next;
 			return 0;
 		}
@@ -350,8 +352,150 @@ static void mark_parents_uninteresting(git_commit_list_node *commit)
 	}
 }
 
+typedef struct {
+	git_oid id;
+	uint16_t mode; /* 0 when there is nothing at the path */
+} revwalk_path_entry;
+
+/*
+ * Look up what a commit has at each of the walk's paths.  A commit's
+ * entries are looked up once and kept for the rest of the walk, so they
+ * can be compared against both its parents and its children.
+ */
+static int path_entries_lookup(
+	revwalk_path_entry **out, git_revwalk *walk, git_commit_list_node *node)
+{
+	revwalk_path_entry *entries;
+	git_commit *commit = NULL;
+	git_tree *tree = NULL;
+	git_tree_entry *entry;
+	const char *path;
+	size_t i;
+	int error;
+
+	if ((*out = git_oidmap_get(walk->path_entries, &node->oid)) != NULL)
+		return 0;
+
+	entries = git_pool_mallocz(&walk->path_pool, walk->paths.length);
+	GIT_ERROR_CHECK_ALLOC(entries);
+
+	if ((error = git_commit_lookup(&commit, walk->repo, &node->oid)) < 0 ||
+	    (error = git_commit_tree(&tree, commit)) < 0)
+		goto done;
+
+	git_vector_foreach(&walk->paths, i, path) {
+		if (!*path) {
+			git_oid_cpy(&entries[i].id, git_tree_id(tree));
+			entries[i].mode = GIT_FILEMODE_TREE;
+			continue;
+		}
+
+		if ((error = git_tree_entry_bypath(&entry, tree, path)) == GIT_ENOTFOUND) {
+			git_error_clear();
+			error = 0;
+			continue;
+		} else if (error < 0) {
+			goto done;
+		}
+
+		git_oid_cpy(&entries[i].id, git_tree_entry_id(entry));
+		entries[i].mode = git_tree_entry_filemode_raw(entry);
+		git_tree_entry_free(entry);
+	}
+
+	if ((error = git_oidmap_set(walk->path_entries, &node->oid, entries)) < 0)
+		goto done;
+
+	*out = entries;
+
+done:
+	git_tree_free(tree);
+	git_commit_free(commit);
+	return error;
+}
+
+/*
+ * The changed-path filters can tell that a commit is the same as its
+ * first parent at all of the paths without loading any trees.
+ */
+static bool bloom_treesame(git_revwalk *walk, git_commit_list_node *commit)
+{
+	const char *path;
+	size_t i;
+
+	git_vector_foreach(&walk->paths, i, path) {
+		if (!*path ||
+		    git_commit_bloom_maybe_changed(walk->repo, &commit->oid, path) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Decide whether a commit changes any of the walk's paths.  When it is
+ * the same as one of its parents at all of them ("TREESAME"), it is not
+ * shown, and `*follow` is set to that parent: the history of the paths
+ * came from there.
+ */
+static int simplify_by_paths(
+	git_commit_list_node **follow, git_revwalk *walk, git_commit_list_node *commit)
+{
+	revwalk_path_entry *entries, *parent_entries;
+	unsigned short i, parents = commit->out_degree;
+	size_t j;
+	int error;
+
+	*follow = NULL;
+	commit->treesame = 0;
+
+	if (parents && bloom_treesame(walk, commit)) {
+		commit->treesame = 1;
+		*follow = commit->parents[0];
+		return 0;
+	}
+
+	if ((error = path_entries_lookup(&entries, walk, commit)) < 0)
+		return error;
+
+	/* a root commit matters when it adds anything at the paths */
+	if (!parents) {
+		for (j = 0; j < walk->paths.length; j++)
+			if (entries[j].mode)
+				return 0;
+
+		commit->treesame = 1;
+		return 0;
+	}
+
+	if (walk->first_parent)
+		parents = 1;
+
+	for (i = 0; i < parents; i++) {
+		git_commit_list_node *p = commit->parents[i];
+
+		if ((error = path_entries_lookup(&parent_entries, walk, p)) < 0)
+			return error;
+
+		for (j = 0; j < walk->paths.length; j++) {
+			if (entries[j].mode != parent_entries[j].mode ||
+			    !git_oid_equal(&entries[j].id, &parent_entries[j].id))
+				break;
+		}
+
+		if (j == walk->paths.length) {
+			commit->treesame = 1;
+			*follow = p;
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
 static int add_parents_to_list(git_revwalk *walk, git_commit_list_node *commit, git_commit_list **list)
 {
+	git_commit_list_node *follow = NULL;
 	unsigned short i;
 	int error;
 
@@ -392,9 +536,16 @@ static int add_parents_to_list(git_revwalk *walk, git_commit_list_node *commit,
 	 * interesting. Here we do want things like first-parent take
 	 * effect as this is what we'll be showing.
 	 */
+	if (walk->paths.length &&
+	    (error = simplify_by_paths(&follow, walk, commit)) < 0)
+		return error;
+
 	for (i = 0; i < commit->out_degree; i++) {
 		git_commit_list_node *p = commit->parents[i];
 
+		if (follow && p != follow)
+			continue;
+
 		if ((error = git_commit_list_parse(walk, p)) < 0)
 			return error;
 
@@ -587,6 +738,140 @@ cleanup:
 	return error;
 }
 
+GIT_INLINE(unsigned short) topo_walk_parents(
+	git_revwalk *walk, git_commit_list_node *commit)
+{
+	return walk->first_parent ? min(commit->out_degree, 1) : commit->out_degree;
+}
+
+/*
+ * Count the children of every commit whose generation is at least `depth`.
+ * A commit can only be reached from commits of a higher generation, so
+ * the in-degree of every commit at or above that depth is then final.
+ */
+static int topo_walk_explore(git_revwalk *walk, uint32_t depth)
+{
+	git_commit_list_node *commit, *parent;
+	uint32_t generation;
+	unsigned short i;
+	int error;
+
+	while ((commit = git_pqueue_get(&walk->topo_explore, 0)) != NULL &&
+	       commit->generation >= depth) {
+		git_pqueue_pop(&walk->topo_explore);
+
+		for (i = 0; i < topo_walk_parents(walk, commit); i++) {
+			parent = commit->parents[i];
+
+			if (parent->in_degree) {
+				parent->in_degree++;
+				continue;
+			}
+
+			if ((error = git_commit_list_parse(walk, parent)) < 0 ||
+			    (error = git_commit_list_generation(&generation, walk, parent)) < 0)
+				return error;
+
+			parent->in_degree = 2;
+
+			if ((error = git_pqueue_insert(&walk->topo_explore, parent)) < 0)
+				return error;
+		}
+	}
+
+	walk->topo_depth = depth;
+	return 0;
+}
+
+/*
+ * Without hidden commits, the topological order can be produced as the
+ * walk goes rather than by sorting all of history up front: in-degrees
+ * are only counted down to the lowest generation that we have reached,
+ * which is all the lookahead we need to know that every child of a
+ * commit has been shown.  As in `sort_in_topological_order`, an in-degree
+ * of 1 means that all of a commit's children have been shown.
+ *
+ * Returns 1 when the walk has been set up, or 0 if it cannot be done
+ * incrementally (eg, when generation numbers are not available).
+ */
+static int topo_walk_init(git_revwalk *walk, git_commit_list *commits)
+{
+	git_commit_list *list;
+	git_commit_list_node *commit;
+	uint32_t generation, depth = UINT32_MAX;
+	int error;
+
+	if (walk->did_hide || walk->hide_cb || walk->paths.length)
+		return 0;
+
+	for (list = commits; list; list = list->next) {
+		if ((error = git_commit_list_generation(&generation, walk, list->item)) < 0)
+			return error;
+
+		if (!generation)
+			return 0;
+
+		depth = min(depth, generation);
+	}
+
+	if ((error = git_pqueue_init(&walk->topo_explore, 0, 8,
+			git_commit_list_generation_cmp)) < 0 ||
+	    (error = git_pqueue_init(&walk->topo_ready, 0, 8,
+			(walk->sorting & GIT_SORT_TIME) ? git_commit_list_time_cmp : NULL)) < 0)
+		return error;
+
+	for (list = commits; list; list = list->next) {
+		list->item->in_degree = 1;
+
+		if ((error = git_pqueue_insert(&walk->topo_explore, list->item)) < 0)
+			return error;
+	}
+
+	if ((error = topo_walk_explore(walk, depth)) < 0)
+		return error;
+
+	for (list = commits; list; list = list->next) {
+		commit = list->item;
+
+		if (commit->in_degree == 1 &&
+		    (error = git_pqueue_insert(&walk->topo_ready, commit)) < 0)
+			return error;
+	}
+
+	/* emit the tips in the order that they were given, as below */
+	if ((walk->sorting & GIT_SORT_TIME) == 0)
+		git_pqueue_reverse(&walk->topo_ready);
+
+	return 1;
+}
+
+static int revwalk_next_toposort_incremental(git_commit_list_node **object_out, git_revwalk *walk)
+{
+	git_commit_list_node *next, *parent;
+	unsigned short i;
+	int error;
+
+	if ((next = git_pqueue_pop(&walk->topo_ready)) == NULL) {
+		git_error_clear();
+		return GIT_ITEROVER;
+	}
+
+	for (i = 0; i < topo_walk_parents(walk, next); i++) {
+		parent = next->parents[i];
+
+		if (parent->generation < walk->topo_depth &&
+		    (error = topo_walk_explore(walk, parent->generation)) < 0)
+			return error;
+
+		if (--parent->in_degree == 1 &&
+		    (error = git_pqueue_insert(&walk->topo_ready, parent)) < 0)
+			return error;
+	}
+
+	*object_out = next;
+	return 0;
+}
+
 static int prepare_walk(git_revwalk *walk)
 {
 	int error = 0;
@@ -599,6 +884,9 @@ static int prepare_walk(git_revwalk *walk)
 		return GIT_ITEROVER;
 	}
 
+	if (walk->paths.length && (error = git_commit_bloom_refresh(walk->repo)) < 0)
+		return error;
+
 	for (list = walk->user_input; list; list = list->next) {
 		git_commit_list_node *commit = list->item;
 		if ((error = git_commit_list_parse(walk, commit)) < 0)
@@ -613,10 +901,17 @@ static int prepare_walk(git_revwalk *walk)
 		}
 	}
 
-	if (walk->limited && (error = limit_list(&commits, walk, commits)) < 0)
-		return error;
+	if ((walk->sorting & GIT_SORT_TOPOLOGICAL) &&
+	    (error = topo_walk_init(walk, commits)) != 0) {
+		git_commit_list_free(&commits);
+
+		if (error < 0)
+			return error;
 
-	if (walk->sorting & GIT_SORT_TOPOLOGICAL) {
+		walk->get_next = &revwalk_next_toposort_incremental;
+	} else if (walk->limited && (error = limit_list(&commits, walk, commits)) < 0) {
+		return error;
+	} else if (walk->sorting & GIT_SORT_TOPOLOGICAL) {
 		error = sort_in_topological_order(&walk->iterator_topo, walk, commits);
 		git_commit_list_free(&commits);
 
@@ -660,8 +955,10 @@ int git_revwalk_new(git_revwalk **revwalk_out, git_repository *repo)
 	GIT_ERROR_CHECK_ALLOC(walk);
 
 	if (git_oidmap_new(&walk->commits) < 0 ||
-	    git_pqueue_init(&walk->iterator_time, 0, 8, git_commit_list_time_cmp) < 0 ||
-	    git_pool_init(&walk->commit_pool, COMMIT_ALLOC) < 0)
+	    git_oidmap_new(&walk->path_entries) < 0 ||
+	    git_pool_init(&walk->commit_pool, COMMIT_ALLOC) < 0 ||
+	    git_pool_init(&walk->parents_pool, sizeof(git_commit_list_node *)) < 0 ||
+	    git_pool_init(&walk->path_pool, sizeof(revwalk_path_entry)) < 0)
 		return -1;
 
 	walk->get_next = &revwalk_next_unsorted;
@@ -687,8 +984,11 @@ void git_revwalk_free(git_revwalk *walk)
 	git_odb_free(walk->odb);
 
 	git_oidmap_free(walk->commits);
+	git_oidmap_free(walk->path_entries);
 	git_pool_clear(&walk->commit_pool);
-	git_pqueue_free(&walk->iterator_time);
+	git_pool_clear(&walk->parents_pool);
+	git_pool_clear(&walk->path_pool);
+	git_commit_queue_free(&walk->iterator_time);
 	git__free(walk);
 }
 
@@ -727,6 +1027,34 @@ int git_revwalk_simplify_first_parent(git_revwalk *walk)
 	return 0;
 }
 
+int git_revwalk_pathspec(git_revwalk *walk, const git_strarray *pathspec)
+{
+	char *path;
+	size_t i, len;
+
+	assert(walk && pathspec);
+
+	for (i = 0; i < pathspec->count; i++) {
+		path = git__strdup(pathspec->strings[i]);
+		GIT_ERROR_CHECK_ALLOC(path);
+
+		/* "dir/" is the same as "dir", and "." is the whole tree */
+		len = strlen(path);
+		while (len > 0 && path[len - 1] == '/')
+			path[--len] = '\0';
+
+		if (!strcmp(path, "."))
+			path[0] = '\0';
+
+		if (git_vector_insert(&walk->paths, path) < 0) {
+			git__free(path);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
 int git_revwalk_next(git_oid *oid, git_revwalk *walk)
 {
 	int error;
@@ -765,14 +1093,21 @@ int git_revwalk_reset(git_revwalk *walk)
 		commit->topo_delay = 0;
 		commit->uninteresting = 0;
 		commit->added = 0;
+		commit->treesame = 0;
 		commit->flags = 0;
 		});
 
-	git_pqueue_clear(&walk->iterator_time);
+	git_commit_queue_clear(&walk->iterator_time);
+	git_pqueue_free(&walk->topo_ready);
+	git_pqueue_free(&walk->topo_explore);
+	walk->topo_depth = 0;
 	git_commit_list_free(&walk->iterator_topo);
 	git_commit_list_free(&walk->iterator_rand);
 	git_commit_list_free(&walk->iterator_reverse);
 	git_commit_list_free(&walk->user_input);
+	git_vector_free_deep(&walk->paths);
+	git_oidmap_clear(walk->path_entries);
+	git_pool_clear(&walk->path_pool);
 	walk->first_parent = 0;
 	walk->walking = 0;
 	walk->limited = 0;
@@ -24,11 +24,17 @@ struct git_revwalk {
 
 	git_oidmap *commits;
 	git_pool commit_pool;
+	git_pool parents_pool;
 
 	git_commit_list *iterator_topo;
 	git_commit_list *iterator_rand;
 	git_commit_list *iterator_reverse;
-	git_pqueue iterator_time;
+	git_commit_queue iterator_time;
+
+	/* incremental topological sort, see topo_walk_init */
+	git_pqueue topo_ready;
+	git_pqueue topo_explore;
+	uint32_t topo_depth;
 
 	int (*get_next)(git_commit_list_node **, git_revwalk *);
 	int (*enqueue)(git_revwalk *, git_commit_list_node *);
@@ -37,12 +43,18 @@ struct git_revwalk {
 		first_parent: 1,
 		did_hide: 1,
 		did_push: 1,
-		limited: 1;
+		limited: 1,
+		generations_loaded: 1;
 	unsigned int sorting;
 
 	/* the pushes and hides */
 	git_commit_list *user_input;
 
+	/* pathspec limiting, and the entries at those paths for each commit */
+	git_vector paths;
+	git_oidmap *path_entries;
+	git_pool path_pool;
+
 	/* hide callback */
 	git_revwalk_hide_cb hide_cb;
 	void *hide_cb_payload;
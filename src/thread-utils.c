@@ -56,3 +56,117 @@ int git_online_cpus(void)
 
 	return 1;
 }
+
+typedef struct {
+	git_parallel_cb cb;
+	void *payload;
+	size_t count;
+
+	git_mutex lock;
+	size_t next;
+	size_t failed_idx;
+	git_error_state failure;
+} parallel_foreach_data;
+
+static int parallel_foreach_take(size_t *out, parallel_foreach_data *data)
+{
+	int more = 0;
+
+	if (git_mutex_lock(&data->lock) < 0)
+		return 0;
+
+	if (data->next < data->count && data->next < data->failed_idx) {
+		*out = data->next++;
+		more = 1;
+	}
+
+	git_mutex_unlock(&data->lock);
+	return more;
+}
+
+static void *parallel_foreach_worker(void *arg)
+{
+	parallel_foreach_data *data = arg;
+	size_t idx;
+	int error;
+
+	while (parallel_foreach_take(&idx, data)) {
+		if ((error = data->cb(idx, data->payload)) >= 0)
+			continue;
+
+		git_mutex_lock(&data->lock);
+
+		if (idx < data->failed_idx) {
+			git_error_state_free(&data->failure);
+			git_error_state_capture(&data->failure, error);
+			data->failed_idx = idx;
+		} else {
+			git_error_clear();
+		}
+
+		git_mutex_unlock(&data->lock);
+	}
+
+	return NULL;
+}
+
+int git_parallel_foreach(
+	size_t count, size_t nthreads, git_parallel_cb cb, void *payload)
+{
+#ifdef GIT_THREADS
+	parallel_foreach_data data = { 0 };
+	git_thread *threads;
+	size_t i, started = 0;
+#endif
+	size_t idx;
+	int error;
+
+	if (nthreads > count)
+		nthreads = count;
+
+#ifdef GIT_THREADS
+	if (nthreads > 1) {
+		threads = git__calloc(nthreads - 1, sizeof(git_thread));
+		GIT_ERROR_CHECK_ALLOC(threads);
+
+		data.cb = cb;
+		data.payload = payload;
+		data.count = count;
+		data.failed_idx = SIZE_MAX;
+
+		if (git_mutex_init(&data.lock) < 0) {
+			git_error_set(GIT_ERROR_OS, "failed to initialize lock");
+			git__free(threads);
+			return -1;
+		}
+
+		/* if we cannot start more threads, make do with what we have */
+		for (i = 0; i < nthreads - 1; i++) {
+			if (git_thread_create(&threads[i], parallel_foreach_worker, &data) != 0)
+				break;
+
+			started++;
+		}
+
+		parallel_foreach_worker(&data);
+
+		for (i = 0; i < started; i++)
+			git_thread_join(&threads[i], NULL);
+
+		git_mutex_free(&data.lock);
+		git__free(threads);
+
+		if (data.failed_idx != SIZE_MAX)
+			return git_error_state_restore(&data.failure);
+
+		return 0;
+	}
+#endif
+
+	for (idx = 0; idx < count; idx++) {
+		if ((error = cb(idx, payload)) < 0)
+			return error;
+	}
+
+	return 0;
+}
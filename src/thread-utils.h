@@ -235,6 +235,28 @@ GIT_INLINE(int) git_atomic_get(git_atomic *a)
 
 extern int git_online_cpus(void);
 
+/**
+ * Callback for `git_parallel_foreach`; invoked once for each item index.
+ * A negative return value stops the remaining work.
+ */
+typedef int (*git_parallel_cb)(size_t idx, void *payload);
+
+/**
+ * Invoke `cb` for every index in `[0, count)`, spreading the work across
+ * up to `nthreads` threads (including the calling thread).  Items are
+ * handed out in order, but may complete in any order, so `cb` must only
+ * touch state belonging to its own item or protect shared state itself.
+ *
+ * When threading is disabled, or when `nthreads` is less than two, the
+ * items are processed serially on the calling thread.
+ *
+ * If any callback fails, no further items are started and the error
+ * (and error message) of the failing item with the lowest index is
+ * returned on the calling thread.
+ */
+extern int git_parallel_foreach(
+	size_t count, size_t nthreads, git_parallel_cb cb, void *payload);
+
 #if defined(GIT_THREADS) && defined(_MSC_VER)
 # define GIT_MEMORY_BARRIER MemoryBarrier()
 #elif defined(GIT_THREADS)
@@ -566,7 +566,17 @@ static int write_tree(
 		if (*filename == '/')
 			filename++;
 		next_slash = strchr(filename, '/');
-		if (next_slash) {
+		if (next_slash && next_slash[1] == '\0' &&
+		    git_index_entry__is_sparse_dir(entry)) {
+			/* A sparse directory already names its tree */
+			char *subdir = git__strndup(filename, next_slash - filename);
+			GIT_ERROR_CHECK_ALLOC(subdir);
+
+			error = append_entry(bld, subdir, &entry->id, S_IFDIR, true);
+			git__free(subdir);
+			if (error < 0)
+				goto on_error;
+		} else if (next_slash) {
 			git_oid sub_oid;
 			int written;
 			char *subdir, *last_comp;
@@ -120,25 +120,25 @@ void *xdl_cha_alloc(chastore_t *cha) {
 	return data;
 }
 
-long xdl_guess_lines(mmfile_t *mf, long sample) {
-	long nl = 0, size, tsize = 0;
-	char const *data, *cur, *top;
+/*
+ * Count the lines of a file exactly, rather than estimating them, so
+ * that the records of the file can be allocated in one go.  memchr()
+ * is vectorized by the C library and is much faster than a byte loop.
+ */
+long xdl_count_lines(mmfile_t *mf) {
+	long nl = 0, size;
+	char const *cur, *top;
 
-	if ((cur = data = xdl_mmfile_first(mf, &size)) != NULL) {
-		for (top = data + size; nl < sample && cur < top; ) {
-			nl++;
+	if ((cur = xdl_mmfile_first(mf, &size)) != NULL) {
+		for (top = cur + size; cur < top; nl++) {
 			if (!(cur = memchr(cur, '\n', top - cur)))
 				cur = top;
 			else
 				cur++;
 		}
-		tsize += (long) (cur - data);
 	}
 
-	if (nl && tsize)
-		nl = xdl_mmfile_size(mf) / (tsize / nl);
-
-	return nl + 1;
+	return nl;
 }
 
 int xdl_blankline(const char *line, long size, long flags)
@@ -254,10 +254,13 @@ int xdl_recmatch(const char *l1, long s1, const char *l2, long s2, long flags)
 static unsigned long xdl_hash_record_with_whitespace(char const **data,
 		char const *top, long flags) {
 	unsigned long ha = 5381;
-	char const *ptr = *data;
+	char const *ptr = *data, *eol;
 	int cr_at_eol_only = (flags & XDF_WHITESPACE_FLAGS) == XDF_IGNORE_CR_AT_EOL;
 
-	for (; ptr < top && *ptr != '\n'; ptr++) {
+	if (!(eol = memchr(ptr, '\n', top - ptr)))
+		eol = top;
+
+	for (; ptr < eol; ptr++) {
 		if (cr_at_eol_only) {
 			/* do not ignore CR at the end of an incomplete line */
 			if (*ptr == '\r' &&
@@ -298,12 +301,29 @@ static unsigned long xdl_hash_record_with_whitespace(char const **data,
 
 unsigned long xdl_hash_record(char const **data, char const *top, long flags) {
 	unsigned long ha = 5381;
-	char const *ptr = *data;
+	char const *ptr = *data, *eol;
 
 	if (flags & XDF_WHITESPACE_FLAGS)
 		return xdl_hash_record_with_whitespace(data, top, flags);
 
-	for (; ptr < top && *ptr != '\n'; ptr++) {
+	/*
+	 * Find the end of the line first, so that the hashing loop does
+	 * not have to look for it, and can be unrolled.
+	 */
+	if (!(eol = memchr(ptr, '\n', top - ptr)))
+		eol = top;
+
+	for (; eol - ptr >= 4; ptr += 4) {
+		ha += (ha << 5);
+		ha ^= (unsigned long) ptr[0];
+		ha += (ha << 5);
+		ha ^= (unsigned long) ptr[1];
+		ha += (ha << 5);
+		ha ^= (unsigned long) ptr[2];
+		ha += (ha << 5);
+		ha ^= (unsigned long) ptr[3];
+	}
+	for (; ptr < eol; ptr++) {
 		ha += (ha << 5);
 		ha ^= (unsigned long) *ptr;
 	}
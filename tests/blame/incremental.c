@@ -0,0 +1,168 @@
+#include "blame_helpers.h"
+
+static git_repository *g_repo;
+static bool g_sandboxed;
+
+struct incremental_data {
+	size_t hunks;
+	size_t lines;
+	git_oid line_commits[16];
+	size_t abort_after;
+};
+
+void test_blame_incremental__initialize(void)
+{
+	cl_git_pass(git_repository_open(&g_repo, cl_fixture("blametest.git")));
+}
+
+void test_blame_incremental__cleanup(void)
+{
+	if (g_sandboxed)
+		cl_git_sandbox_cleanup();
+	else
+		git_repository_free(g_repo);
+
+	g_sandboxed = false;
+	g_repo = NULL;
+}
+
+static int record_hunk(const git_blame_hunk *hunk, void *payload)
+{
+	struct incremental_data *data = payload;
+	size_t i;
+
+	cl_assert(hunk->final_start_line_number > 0);
+	cl_assert(hunk->final_start_line_number + hunk->lines_in_hunk - 1 <=
+		ARRAY_SIZE(data->line_commits));
+
+	for (i = 0; i < hunk->lines_in_hunk; i++) {
+		git_oid *line = &data->line_commits[hunk->final_start_line_number + i - 1];
+
+		/* every line is reported exactly once */
+		cl_assert(git_oid_is_zero(line));
+		git_oid_cpy(line, &hunk->final_commit_id);
+	}
+
+	data->lines += hunk->lines_in_hunk;
+
+	if (++data->hunks == data->abort_after)
+		return -42;
+
+	return 0;
+}
+
+static void assert_same_as_blame(
+	struct incremental_data *data, git_blame_options *opts)
+{
+	git_blame *blame;
+	const git_blame_hunk *hunk;
+	size_t line, expected_lines = 0;
+
+	cl_git_pass(git_blame_file(&blame, g_repo, "b.txt", opts));
+
+	for (line = 1; line <= ARRAY_SIZE(data->line_commits); line++) {
+		if ((hunk = git_blame_get_hunk_byline(blame, line)) == NULL) {
+			cl_assert(git_oid_is_zero(&data->line_commits[line - 1]));
+			continue;
+		}
+
+		cl_assert_equal_oid(&hunk->final_commit_id, &data->line_commits[line - 1]);
+		expected_lines++;
+	}
+
+	cl_assert_equal_sz(expected_lines, data->lines);
+	git_blame_free(blame);
+}
+
+void test_blame_incremental__reports_every_line(void)
+{
+	struct incremental_data data = {0};
+
+	cl_git_pass(git_blame_file_incremental(g_repo, "b.txt", NULL, record_hunk, &data));
+
+	cl_assert_equal_sz(15, data.lines);
+	cl_assert(data.hunks >= 4);
+	assert_same_as_blame(&data, NULL);
+}
+
+void test_blame_incremental__only_blames_the_line_range(void)
+{
+	git_blame_options opts = GIT_BLAME_OPTIONS_INIT;
+	struct incremental_data data = {0};
+
+	opts.min_line = 2;
+	opts.max_line = 7;
+
+	cl_git_pass(git_blame_file_incremental(g_repo, "b.txt", &opts, record_hunk, &data));
+
+	cl_assert_equal_sz(6, data.lines);
+	cl_assert(git_oid_is_zero(&data.line_commits[0]));
+	cl_assert(git_oid_is_zero(&data.line_commits[7]));
+	assert_same_as_blame(&data, &opts);
+}
+
+void test_blame_incremental__callback_can_stop_the_blame(void)
+{
+	struct incremental_data data = {0};
+
+	data.abort_after = 1;
+
+	cl_assert_equal_i(-42,
+		git_blame_file_incremental(g_repo, "b.txt", NULL, record_hunk, &data));
+	cl_assert_equal_sz(1, data.hunks);
+}
+
+void test_blame_incremental__rejects_lines_outside_of_the_file(void)
+{
+	git_blame_options opts = GIT_BLAME_OPTIONS_INIT;
+	struct incremental_data data = {0};
+	git_treebuilder *builder;
+	git_signature *sig;
+	git_commit *head;
+	git_tree *tree;
+	git_blame *blame;
+	git_oid id;
+
+	opts.max_line = 16;
+	cl_git_fail_with(GIT_ERROR,
+		git_blame_file_incremental(g_repo, "b.txt", &opts, record_hunk, &data));
+	cl_git_fail(git_blame_file(&blame, g_repo, "b.txt", &opts));
+
+	opts.min_line = 16;
+	opts.max_line = 0;
+	cl_git_fail(git_blame_file(&blame, g_repo, "b.txt", &opts));
+
+	opts.min_line = 7;
+	opts.max_line = 2;
+	cl_git_fail(git_blame_file(&blame, g_repo, "b.txt", &opts));
+	cl_assert_equal_sz(0, data.hunks);
+
+	/* an empty file only has room for the first line */
+	git_repository_free(g_repo);
+	g_repo = cl_git_sandbox_init("blametest.git");
+	g_sandboxed = true;
+
+	cl_git_pass(git_revparse_single((git_object **)&head, g_repo, "HEAD"));
+	cl_git_pass(git_treebuilder_new(&builder, g_repo, NULL));
+	cl_git_pass(git_blob_create_from_buffer(&id, g_repo, "", 0));
+	cl_git_pass(git_treebuilder_insert(NULL, builder, "empty.txt", &id, GIT_FILEMODE_BLOB));
+	cl_git_pass(git_treebuilder_write(&id, builder));
+	cl_git_pass(git_tree_lookup(&tree, g_repo, &id));
+
+	cl_git_pass(git_signature_new(&sig, "Tester", "tester@example.com", 1600000000, 0));
+	cl_git_pass(git_commit_create(&id, g_repo, "HEAD", sig, sig, NULL,
+		"add an empty file\n", tree, 1, (const git_commit **)&head));
+
+	opts.min_line = 1;
+	opts.max_line = 0;
+	cl_git_pass(git_blame_file(&blame, g_repo, "empty.txt", &opts));
+	git_blame_free(blame);
+
+	opts.min_line = 2;
+	cl_git_fail(git_blame_file(&blame, g_repo, "empty.txt", &opts));
+
+	git_signature_free(sig);
+	git_tree_free(tree);
+	git_treebuilder_free(builder);
+	git_commit_free(head);
+}
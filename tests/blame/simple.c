@@ -360,3 +360,74 @@ void test_blame_simple__can_restrict_to_first_parent_commits(void)
 	check_blame_hunk_index(g_repo, g_blame, 2,  6, 5, 0, "63d671eb", "b.txt");
 	check_blame_hunk_index(g_repo, g_blame, 3, 11, 5, 0, "bc7c5ac2", "b.txt");
 }
+
+static void commit_lines(
+	git_oid *out,
+	size_t changed_a,
+	size_t changed_b,
+	const git_oid *parents,
+	size_t parents_len)
+{
+	git_buf content = GIT_BUF_INIT;
+	git_treebuilder *builder;
+	git_signature *sig;
+	git_commit *parent_commits[2];
+	git_tree *tree;
+	git_oid blob_id, tree_id;
+	size_t i;
+
+	for (i = 1; i <= 2000; i++)
+		cl_git_pass(git_buf_printf(&content, "%s line %"PRIuZ"\n",
+			(i == changed_a || i == changed_b) ? "changed" : "original", i));
+
+	cl_git_pass(git_blob_create_from_buffer(&blob_id, g_repo, content.ptr, content.size));
+	cl_git_pass(git_treebuilder_new(&builder, g_repo, NULL));
+	cl_git_pass(git_treebuilder_insert(NULL, builder, "large.txt", &blob_id, GIT_FILEMODE_BLOB));
+	cl_git_pass(git_treebuilder_write(&tree_id, builder));
+	cl_git_pass(git_tree_lookup(&tree, g_repo, &tree_id));
+
+	for (i = 0; i < parents_len; i++)
+		cl_git_pass(git_commit_lookup(&parent_commits[i], g_repo, &parents[i]));
+
+	cl_git_pass(git_signature_new(&sig, "Blamer", "blamer@example.com", 1234567890 + parents_len, 0));
+	cl_git_pass(git_commit_create(out, g_repo, NULL, sig, sig, NULL, "commit",
+		tree, parents_len, (const git_commit **)parent_commits));
+
+	for (i = 0; i < parents_len; i++)
+		git_commit_free(parent_commits[i]);
+	git_signature_free(sig);
+	git_tree_free(tree);
+	git_treebuilder_free(builder);
+	git_buf_dispose(&content);
+}
+
+static void assert_line_blamed_on(size_t line, const git_oid *expected)
+{
+	const git_blame_hunk *hunk = git_blame_get_hunk_byline(g_blame, line);
+
+	cl_assert(hunk);
+	cl_assert_equal_oid(expected, &hunk->final_commit_id);
+}
+
+void test_blame_simple__can_blame_merge_of_large_file(void)
+{
+	git_blame_options opts = GIT_BLAME_OPTIONS_INIT;
+	git_oid base, sides[2], merge;
+
+	cl_git_pass(git_repository_init(&g_repo, "merge_of_large_file.git", true));
+
+	commit_lines(&base, 0, 0, NULL, 0);
+	commit_lines(&sides[0], 10, 0, &base, 1);
+	commit_lines(&sides[1], 1500, 0, &base, 1);
+	commit_lines(&merge, 10, 1500, sides, 2);
+
+	git_oid_cpy(&opts.newest_commit, &merge);
+	cl_git_pass(git_blame_file(&g_blame, g_repo, "large.txt", &opts));
+
+	cl_assert_equal_i(5, git_blame_get_hunk_count(g_blame));
+	assert_line_blamed_on(1, &base);
+	assert_line_blamed_on(10, &sides[0]);
+	assert_line_blamed_on(11, &base);
+	assert_line_blamed_on(1500, &sides[1]);
+	assert_line_blamed_on(2000, &base);
+}
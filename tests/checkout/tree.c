@@ -1636,3 +1636,74 @@ void test_checkout_tree__no_index_refresh(void)
 	modify_index_and_checkout_tree(&opts);
 	assert_status_entrycount(g_repo, 0);
 }
+
+static void wide_tree_file(
+	git_buf *path, git_buf *content, size_t i, void *payload)
+{
+	size_t *count = payload;
+
+	/* an attributes file that applies to every other file */
+	if (i == *count) {
+		cl_git_pass(git_buf_puts(path, ".gitattributes"));
+		cl_git_pass(git_buf_puts(content, "*.txt text eol=crlf\n"));
+		return;
+	}
+
+	cl_git_pass(git_buf_printf(path, "dir%d/sub%d/file%d.txt",
+		(int)(i % 7), (int)(i % 3), (int)i));
+	cl_git_pass(git_buf_printf(content, "file %d\nsecond line\n", (int)i));
+}
+
+static void create_wide_tree(git_oid *out, size_t count)
+{
+	cl_repo_write_tree_of_files(out, g_repo, count + 1, wide_tree_file, &count);
+}
+
+void test_checkout_tree__can_write_files_in_parallel(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+	git_buf path = GIT_BUF_INIT, content = GIT_BUF_INIT;
+	git_diff_options diff_opts = GIT_DIFF_OPTIONS_INIT;
+	char *pathspec = "dir*";
+	git_index *index;
+	git_diff *diff;
+	git_oid tree_id;
+	size_t i;
+
+	create_wide_tree(&tree_id, 500);
+	cl_git_pass(git_object_lookup(&g_object, g_repo, &tree_id, GIT_OBJECT_TREE));
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE | GIT_CHECKOUT_REMOVE_UNTRACKED;
+	opts.workers = 8;
+
+	cl_git_pass(git_checkout_tree(g_repo, g_object, &opts));
+
+	for (i = 0; i < 500; i++) {
+		git_buf_clear(&path);
+		git_buf_clear(&content);
+		cl_git_pass(git_buf_printf(&path, "testrepo/dir%d/sub%d/file%d.txt",
+			(int)(i % 7), (int)(i % 3), (int)i));
+		cl_git_pass(git_buf_printf(&content, "file %d\r\nsecond line\r\n", (int)i));
+
+		check_file_contents(path.ptr, content.ptr);
+	}
+
+	cl_assert(!git_path_exists("testrepo/README"));
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_assert(git_index_get_bypath(index, ".gitattributes", 0) != NULL);
+	cl_assert(git_index_get_bypath(index, "dir6/sub2/file20.txt", 0) != NULL);
+	cl_assert(git_index_get_bypath(index, "dir3/sub2/file479.txt", 0) != NULL);
+
+	/* the stat data written to the index matches the new files */
+	diff_opts.pathspec.strings = &pathspec;
+	diff_opts.pathspec.count = 1;
+	cl_git_pass(git_diff_index_to_workdir(&diff, g_repo, index, &diff_opts));
+	cl_assert_equal_sz(0, git_diff_num_deltas(diff));
+
+	git_diff_free(diff);
+	git_index_free(index);
+
+	git_buf_dispose(&path);
+	git_buf_dispose(&content);
+}
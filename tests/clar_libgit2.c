@@ -268,6 +268,36 @@ bool cl_is_chmod_supported(void)
 	return _is_supported;
 }
 
+bool cl_is_dirent_type_supported(void)
+{
+	static int _is_supported = -1;
+
+	if (_is_supported < 0) {
+		git_path_diriter diriter = GIT_PATH_DIRITER_INIT;
+		const char *name;
+		size_t name_len;
+
+		cl_must_pass(p_mkdir("dirent.t", 0777));
+		cl_git_pass(git_path_diriter_init(&diriter, ".", 0));
+		_is_supported = 0;
+
+		while (git_path_diriter_next(&diriter) == 0) {
+			cl_git_pass(git_path_diriter_filename(&name, &name_len, &diriter));
+
+			if (strcmp(name, "dirent.t") == 0) {
+				_is_supported =
+					(git_path_diriter_filetype(&diriter) == S_IFDIR);
+				break;
+			}
+		}
+
+		git_path_diriter_free(&diriter);
+		cl_must_pass(p_rmdir("dirent.t"));
+	}
+
+	return _is_supported;
+}
+
 const char* cl_git_fixture_url(const char *fixturename)
 {
 	return cl_git_path_url(cl_fixture(fixturename));
@@ -456,6 +486,42 @@ void cl_repo_commit_from_index(
 	git_tree_free(tree);
 }
 
+void cl_repo_write_tree_of_files(
+	git_oid *out,
+	git_repository *repo,
+	size_t count,
+	cl_tree_file_cb file_cb,
+	void *payload)
+{
+	git_index *index;
+	git_index_entry entry;
+	git_buf path = GIT_BUF_INIT, content = GIT_BUF_INIT;
+	size_t i;
+
+	cl_git_pass(git_index_new(&index));
+
+	memset(&entry, 0, sizeof(entry));
+	entry.mode = GIT_FILEMODE_BLOB;
+
+	for (i = 0; i < count; i++) {
+		git_buf_clear(&path);
+		git_buf_clear(&content);
+
+		file_cb(&path, &content, i, payload);
+
+		cl_git_pass(git_blob_create_from_buffer(&entry.id, repo,
+			content.ptr, content.size));
+		entry.path = path.ptr;
+		cl_git_pass(git_index_add(index, &entry));
+	}
+
+	cl_git_pass(git_index_write_tree_to(out, index, repo));
+
+	git_buf_dispose(&path);
+	git_buf_dispose(&content);
+	git_index_free(index);
+}
+
 void cl_repo_set_bool(git_repository *repo, const char *cfg, int value)
 {
 	git_config *config;
@@ -169,6 +169,10 @@ void cl_git_rmfile(const char *filename);
 
 bool cl_toggle_filemode(const char *filename);
 bool cl_is_chmod_supported(void);
+bool cl_is_dirent_type_supported(void);
+
+/* Directories are only stat'ed when readdir cannot tell us their type */
+#define cl_dir_stat_calls(n) (cl_is_dirent_type_supported() ? 0 : (n))
 
 /* Environment wrappers */
 char *cl_getenv(const char *name);
@@ -207,6 +211,22 @@ void cl_repo_commit_from_index(
 	git_time_t time,
 	const char *msg);
 
+/* tree creation helpers */
+typedef void (*cl_tree_file_cb)(
+	git_buf *path, git_buf *content, size_t i, void *payload);
+
+/*
+ * Write a tree of `count` generated blobs; the callback is given empty
+ * buffers for the path (which may include directories) and the contents
+ * of the i-th file.
+ */
+void cl_repo_write_tree_of_files(
+	git_oid *out,
+	git_repository *repo,
+	size_t count,
+	cl_tree_file_cb file_cb,
+	void *payload);
+
 /* config setting helpers */
 void cl_repo_set_bool(git_repository *repo, const char *cfg, int value);
 int cl_repo_get_bool(git_repository *repo, const char *cfg);
@@ -2,6 +2,7 @@
 #include "buffer.h"
 #include "buf_text.h"
 #include "git2/sys/hashsig.h"
+#include "hashsig.h"
 #include "futils.h"
 
 #define TESTSTR "Have you seen that? Have you seeeen that??"
@@ -982,6 +983,70 @@ void test_core_buffer__similarity_metric(void)
 }
 
 
+void test_core_buffer__similarity_signature_can_be_serialized(void)
+{
+	git_hashsig *a, *b;
+	git_buf buf = GIT_BUF_INIT;
+
+	cl_git_pass(git_hashsig_create(&a, SIMILARITY_TEST_DATA_1,
+		strlen(SIMILARITY_TEST_DATA_1), GIT_HASHSIG_SMART_WHITESPACE));
+	cl_git_pass(git_hashsig__serialize(&buf, a));
+
+	cl_git_pass(git_hashsig__parse(&b, buf.ptr, buf.size));
+	cl_assert_equal_i(GIT_HASHSIG_SMART_WHITESPACE, git_hashsig__options(b));
+	cl_assert_equal_i(100, git_hashsig_compare(a, b));
+	git_hashsig_free(b);
+
+	/* truncated data is rejected */
+	cl_git_fail(git_hashsig__parse(&b, buf.ptr, buf.size - 1));
+	cl_git_fail(git_hashsig__parse(&b, buf.ptr, 3));
+
+	git_hashsig_free(a);
+	git_buf_dispose(&buf);
+}
+
+
+void test_core_buffer__similarity_signature_ignores_alignment(void)
+{
+	git_hashsig *a;
+	git_buf expected = GIT_BUF_INIT, actual = GIT_BUF_INIT;
+	char data[1024];
+	const char *line =
+		"  a line that is long enough to be split into more than one run, "
+		"since runs end after eighty characters\r\n";
+	git_hashsig_option_t opt;
+	size_t offset, len = strlen(line) * 3;
+
+	/* signatures are hashed a word at a time, wherever the data starts */
+	for (opt = GIT_HASHSIG_NORMAL; opt <= GIT_HASHSIG_SMART_WHITESPACE; ++opt) {
+		git_buf_clear(&expected);
+
+		for (offset = 0; offset < 8; offset++) {
+			p_snprintf(data + offset, sizeof(data) - offset, "%s%s%s",
+				line, line, line);
+
+			cl_git_pass(git_hashsig_create(&a, data + offset, len, opt));
+
+			if (!offset) {
+				cl_git_pass(git_hashsig__serialize(&expected, a));
+				git_hashsig_free(a);
+				continue;
+			}
+
+			git_buf_clear(&actual);
+			cl_git_pass(git_hashsig__serialize(&actual, a));
+			cl_assert_equal_i(expected.size, actual.size);
+			cl_assert(memcmp(expected.ptr, actual.ptr, actual.size) == 0);
+
+			git_hashsig_free(a);
+		}
+	}
+
+	git_buf_dispose(&expected);
+	git_buf_dispose(&actual);
+}
+
+
 void test_core_buffer__similarity_metric_whitespace(void)
 {
 	git_hashsig *a, *b;
@@ -1,5 +1,6 @@
 #include "clar_libgit2.h"
 #include "pqueue.h"
+#include "commit_list.h"
 
 static int cmp_ints(const void *v1, const void *v2)
 {
@@ -148,3 +149,66 @@ void test_core_pqueue__interleaved_pushes_and_pops(void)
 	git_pqueue_free(&pq);
 }
 
+
+void test_core_pqueue__commit_queue_by_time(void)
+{
+	git_commit_list_node nodes[300];
+	git_commit_queue queue;
+	git_commit_list_node *node;
+	int64_t last = INT64_MAX;
+	size_t i, popped = 0;
+
+	memset(nodes, 0, sizeof(nodes));
+	git_commit_queue_init(&queue, false);
+
+	for (i = 0; i < ARRAY_SIZE(nodes); i++) {
+		nodes[i].time = (int64_t)((i * 7919) % 101);
+		nodes[i].generation = (uint32_t)i;
+		cl_git_pass(git_commit_queue_insert(&queue, &nodes[i]));
+
+		/* interleave some pops to exercise partially drained heaps */
+		if (i % 3 == 2) {
+			cl_assert((node = git_commit_queue_pop(&queue)) != NULL);
+			popped++;
+		}
+	}
+
+	cl_assert_equal_sz(ARRAY_SIZE(nodes) - popped, git_commit_queue_size(&queue));
+
+	while ((node = git_commit_queue_pop(&queue)) != NULL) {
+		cl_assert(node->time <= last);
+		last = node->time;
+	}
+
+	cl_assert_equal_sz(0, git_commit_queue_size(&queue));
+	git_commit_queue_free(&queue);
+}
+
+void test_core_pqueue__commit_queue_by_generation(void)
+{
+	git_commit_list_node nodes[257];
+	git_commit_queue queue;
+	git_commit_list_node *node, *last = NULL;
+	size_t i;
+
+	memset(nodes, 0, sizeof(nodes));
+	git_commit_queue_init(&queue, true);
+
+	for (i = 0; i < ARRAY_SIZE(nodes); i++) {
+		nodes[i].generation = (uint32_t)((i * 31) % 17);
+		nodes[i].time = (int64_t)((i * 13) % 29);
+		cl_git_pass(git_commit_queue_insert(&queue, &nodes[i]));
+	}
+
+	for (i = 0; (node = git_commit_queue_pop(&queue)) != NULL; i++) {
+		if (last) {
+			cl_assert(node->generation <= last->generation);
+			cl_assert(node->generation < last->generation || node->time <= last->time);
+		}
+
+		last = node;
+	}
+
+	cl_assert_equal_sz(ARRAY_SIZE(nodes), i);
+	git_commit_queue_free(&queue);
+}
@@ -1045,3 +1045,49 @@ void test_diff_blob__can_compare_buffer_to_buffer(void)
 		diff_file_cb, diff_binary_cb, diff_hunk_cb, diff_line_cb, &expected));
 	assert_one_modified(4, 9, 0, 5, 4, &expected);
 }
+
+static void build_many_lines(git_buf *out, bool changed)
+{
+	size_t i;
+
+	for (i = 0; i < 20000; i++) {
+		/* some lines are long, some end in whitespace when changed */
+		cl_git_pass(git_buf_printf(out, "line %"PRIuZ"%s%s%s\n", i,
+			(i % 13) ? "" : " that goes on for rather longer than the others do",
+			(changed && i % 1000 == 500) ? " changed" : "",
+			(changed && i % 7 == 0) ? " \t" : ""));
+	}
+
+	/* and the last one has no newline */
+	cl_git_pass(git_buf_puts(out, changed ? "the end" : "the end."));
+}
+
+void test_diff_blob__can_compare_buffers_of_many_lines(void)
+{
+	git_buf a = GIT_BUF_INIT, b = GIT_BUF_INIT;
+
+	build_many_lines(&a, false);
+	build_many_lines(&b, true);
+
+	opts.interhunk_lines = 0;
+	opts.context_lines = 0;
+
+	memset(&expected, 0, sizeof(expected));
+
+	cl_git_pass(git_diff_buffers(
+		a.ptr, a.size, NULL, b.ptr, b.size, NULL, &opts,
+		diff_file_cb, diff_binary_cb, diff_hunk_cb, diff_line_cb, &expected));
+	cl_assert_equal_i(2869, expected.hunks); /* as `git diff -U0` */
+
+	/* only the changed words and the last line (without a newline) remain */
+	opts.flags |= GIT_DIFF_IGNORE_WHITESPACE_EOL;
+	memset(&expected, 0, sizeof(expected));
+
+	cl_git_pass(git_diff_buffers(
+		a.ptr, a.size, NULL, b.ptr, b.size, NULL, &opts,
+		diff_file_cb, diff_binary_cb, diff_hunk_cb, diff_line_cb, &expected));
+	assert_one_modified(21, 44, 0, 22, 22, &expected);
+
+	git_buf_dispose(&a);
+	git_buf_dispose(&b);
+}
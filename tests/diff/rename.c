@@ -1,6 +1,8 @@
 #include "clar_libgit2.h"
 #include "diff_helpers.h"
 #include "buf_text.h"
+#include "diff_tform.h"
+#include "git2/sys/hashsig.h"
 
 static git_repository *g_repo = NULL;
 
@@ -1978,3 +1980,357 @@ void test_diff_rename__delete_and_rename(void)
 	git_tree_free(old_tree);
 	git_tree_free(new_tree);
 }
+
+typedef struct {
+	const char *prefix;
+	size_t changed_line;
+} many_files_opts;
+
+static void many_files_file(
+	git_buf *path, git_buf *content, size_t i, void *payload)
+{
+	many_files_opts *opts = payload;
+	size_t line;
+
+	for (line = 0; line < 20; line++)
+		cl_git_pass(git_buf_printf(content, "%s %"PRIuZ" of file %"PRIuZ"\n",
+			line == opts->changed_line ? "changed line" : "line", line, i));
+
+	cl_git_pass(git_buf_printf(path, "%s%03"PRIuZ".txt", opts->prefix, i));
+}
+
+static void build_tree_of_many_files(
+	git_oid *out, const char *prefix, size_t count, size_t changed_line)
+{
+	many_files_opts opts;
+
+	opts.prefix = prefix;
+	opts.changed_line = changed_line;
+
+	cl_repo_write_tree_of_files(out, g_repo, count, many_files_file, &opts);
+}
+
+void test_diff_rename__mid_size_renames_within_the_rename_limit(void)
+{
+	git_diff_find_options opts = GIT_DIFF_FIND_OPTIONS_INIT;
+	git_tree *old_tree, *new_tree;
+	git_oid old_id, new_id;
+	git_diff *diff;
+	const git_diff_delta *delta;
+	size_t i;
+
+	build_tree_of_many_files(&old_id, "before", 150, 2);
+	build_tree_of_many_files(&new_id, "after", 150, 17);
+
+	cl_git_pass(git_tree_lookup(&old_tree, g_repo, &old_id));
+	cl_git_pass(git_tree_lookup(&new_tree, g_repo, &new_id));
+	cl_git_pass(git_diff_tree_to_tree(&diff, g_repo, old_tree, new_tree, NULL));
+	cl_assert_equal_i(300, git_diff_num_deltas(diff));
+
+	/* fewer sources than the default limit: every pair is compared */
+	opts.flags = GIT_DIFF_FIND_RENAMES;
+	cl_git_pass(git_diff_find_similar(diff, &opts));
+
+	cl_assert_equal_i(150, git_diff_num_deltas(diff));
+
+	for (i = 0; i < 150; i++) {
+		delta = git_diff_get_delta(diff, i);
+
+		cl_assert_equal_i(GIT_DELTA_RENAMED, delta->status);
+		cl_assert(delta->similarity >= 90);
+		cl_assert_equal_strn(delta->old_file.path + strlen("before"),
+			delta->new_file.path + strlen("after"), 3);
+	}
+
+	git_diff_free(diff);
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+}
+
+void test_diff_rename__many_renames_beyond_the_rename_limit(void)
+{
+	git_diff_find_options opts = GIT_DIFF_FIND_OPTIONS_INIT;
+	git_tree *old_tree, *new_tree;
+	git_oid old_id, new_id;
+	git_diff *diff;
+	const git_diff_delta *delta;
+	size_t i;
+
+	build_tree_of_many_files(&old_id, "before", 300, 20);
+	build_tree_of_many_files(&new_id, "after", 300, 7);
+
+	cl_git_pass(git_tree_lookup(&old_tree, g_repo, &old_id));
+	cl_git_pass(git_tree_lookup(&new_tree, g_repo, &new_id));
+	cl_git_pass(git_diff_tree_to_tree(&diff, g_repo, old_tree, new_tree, NULL));
+	cl_assert_equal_i(600, git_diff_num_deltas(diff));
+
+	/* more sources than the rename limit */
+	opts.flags = GIT_DIFF_FIND_RENAMES;
+	opts.rename_limit = 100;
+	cl_git_pass(git_diff_find_similar(diff, &opts));
+
+	cl_assert_equal_i(300, git_diff_num_deltas(diff));
+
+	for (i = 0; i < 300; i++) {
+		delta = git_diff_get_delta(diff, i);
+
+		cl_assert_equal_i(GIT_DELTA_RENAMED, delta->status);
+		cl_assert(delta->similarity >= 90);
+		cl_assert_equal_strn(delta->old_file.path + strlen("before"),
+			delta->new_file.path + strlen("after"), 3);
+	}
+
+	git_diff_free(diff);
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+}
+
+static int wrapped_buffer_signature(
+	void **out, const git_diff_file *file, const char *buf, size_t len, void *payload)
+{
+	return git_diff_find_similar__hashsig_for_buf(out, file, buf, len, payload);
+}
+
+void test_diff_rename__many_renames_same_with_serial_scoring(void)
+{
+	git_diff_find_options opts = GIT_DIFF_FIND_OPTIONS_INIT;
+	git_diff_similarity_metric metric = {
+		git_diff_find_similar__hashsig_for_file,
+		wrapped_buffer_signature,
+		git_diff_find_similar__hashsig_free,
+		git_diff_find_similar__calc_similarity,
+		(void *)(GIT_HASHSIG_SMART_WHITESPACE | GIT_HASHSIG_ALLOW_SMALL_FILES)
+	};
+	git_tree *old_tree, *new_tree;
+	git_oid old_id, new_id;
+	git_diff *builtin, *serial;
+	const git_diff_delta *a, *b;
+	size_t i;
+
+	build_tree_of_many_files(&old_id, "before", 300, 3);
+	build_tree_of_many_files(&new_id, "after", 300, 11);
+
+	cl_git_pass(git_tree_lookup(&old_tree, g_repo, &old_id));
+	cl_git_pass(git_tree_lookup(&new_tree, g_repo, &new_id));
+	cl_git_pass(git_diff_tree_to_tree(&builtin, g_repo, old_tree, new_tree, NULL));
+	cl_git_pass(git_diff_tree_to_tree(&serial, g_repo, old_tree, new_tree, NULL));
+
+	/* an unknown metric is scored serially, comparing every pair */
+	opts.flags = GIT_DIFF_FIND_RENAMES | GIT_DIFF_FIND_COPIES;
+	opts.rename_limit = 1000;
+	cl_git_pass(git_diff_find_similar(builtin, &opts));
+
+	opts.metric = &metric;
+	cl_git_pass(git_diff_find_similar(serial, &opts));
+
+	cl_assert_equal_i(300, git_diff_num_deltas(builtin));
+	cl_assert_equal_i(git_diff_num_deltas(builtin), git_diff_num_deltas(serial));
+
+	for (i = 0; i < git_diff_num_deltas(builtin); i++) {
+		a = git_diff_get_delta(builtin, i);
+		b = git_diff_get_delta(serial, i);
+
+		cl_assert_equal_i(a->status, b->status);
+		cl_assert_equal_i(a->similarity, b->similarity);
+		cl_assert_equal_s(a->old_file.path, b->old_file.path);
+		cl_assert_equal_s(a->new_file.path, b->new_file.path);
+	}
+
+	git_diff_free(builtin);
+	git_diff_free(serial);
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+}
+
+typedef struct {
+	size_t count;
+	size_t touched;
+	bool backdate;
+} cached_signatures;
+
+#define CACHED_SIGNATURE_OLD_TIME 1234567890
+
+static int walk_cached_signatures(void *payload, git_buf *path)
+{
+	cached_signatures *sigs = payload;
+	const char *name = path->ptr + git_path_basename_offset(path);
+	struct p_timeval times[2];
+	struct stat st;
+
+	if (git_path_isdir(path->ptr))
+		return git_path_direach(path, 0, walk_cached_signatures, payload);
+
+	/* only count `<rest of the id>-<options>` files */
+	if (strlen(name) <= GIT_OID_HEXSZ - 2 || name[GIT_OID_HEXSZ - 2] != '-')
+		return 0;
+
+	sigs->count++;
+
+	if (sigs->backdate) {
+		times[0].tv_sec = times[1].tv_sec = CACHED_SIGNATURE_OLD_TIME;
+		times[0].tv_usec = times[1].tv_usec = 0;
+		cl_must_pass(p_utimes(path->ptr, times));
+	} else {
+		cl_must_pass(p_stat(path->ptr, &st));
+
+		if (st.st_mtime > CACHED_SIGNATURE_OLD_TIME)
+			sigs->touched++;
+	}
+
+	return 0;
+}
+
+static void walk_cache_dir(cached_signatures *sigs, const char *dir, bool backdate)
+{
+	git_buf path = GIT_BUF_INIT;
+
+	memset(sigs, 0, sizeof(*sigs));
+	sigs->backdate = backdate;
+
+	cl_git_pass(git_buf_joinpath(&path, git_repository_commondir(g_repo), dir));
+	cl_assert(git_path_isdir(path.ptr));
+	cl_git_pass(git_path_direach(&path, 0, walk_cached_signatures, sigs));
+
+	git_buf_dispose(&path);
+}
+
+void test_diff_rename__similarity_cache(void)
+{
+	git_diff_find_options opts = GIT_DIFF_FIND_OPTIONS_INIT;
+	git_tree *old_tree, *new_tree;
+	git_oid old_id, new_id;
+	git_diff *uncached, *cached;
+	cached_signatures sigs;
+	const git_diff_delta *a, *b;
+	size_t i;
+
+	build_tree_of_many_files(&old_id, "before", 300, 5);
+	build_tree_of_many_files(&new_id, "after", 300, 13);
+
+	cl_repo_set_bool(g_repo, "diff.similarityCache", true);
+
+	cl_git_pass(git_tree_lookup(&old_tree, g_repo, &old_id));
+	cl_git_pass(git_tree_lookup(&new_tree, g_repo, &new_id));
+	cl_git_pass(git_diff_tree_to_tree(&uncached, g_repo, old_tree, new_tree, NULL));
+	cl_git_pass(git_diff_tree_to_tree(&cached, g_repo, old_tree, new_tree, NULL));
+
+	opts.flags = GIT_DIFF_FIND_RENAMES;
+	opts.rename_limit = 1000;
+
+	/* the first pass computes the signatures and stores them... */
+	cl_git_pass(git_diff_find_similar(uncached, &opts));
+
+	walk_cache_dir(&sigs, "similarity-cache", true);
+	cl_assert_equal_i(600, sigs.count);
+
+	/* ...and the second pass only reads them back, which marks them used */
+	cl_git_pass(git_diff_find_similar(cached, &opts));
+
+	walk_cache_dir(&sigs, "similarity-cache", false);
+	cl_assert_equal_i(600, sigs.count);
+	cl_assert_equal_i(600, sigs.touched);
+
+	cl_assert_equal_i(300, git_diff_num_deltas(uncached));
+	cl_assert_equal_i(git_diff_num_deltas(uncached), git_diff_num_deltas(cached));
+
+	for (i = 0; i < git_diff_num_deltas(uncached); i++) {
+		a = git_diff_get_delta(uncached, i);
+		b = git_diff_get_delta(cached, i);
+
+		cl_assert_equal_i(GIT_DELTA_RENAMED, b->status);
+		cl_assert_equal_i(a->similarity, b->similarity);
+		cl_assert_equal_s(a->old_file.path, b->old_file.path);
+		cl_assert_equal_s(a->new_file.path, b->new_file.path);
+		cl_assert_equal_i(a->old_file.size, b->old_file.size);
+	}
+
+	git_diff_free(uncached);
+	git_diff_free(cached);
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+}
+
+static void diff_trees_of_many_files_with_renames(void)
+{
+	git_diff_find_options opts = GIT_DIFF_FIND_OPTIONS_INIT;
+	git_tree *old_tree, *new_tree;
+	git_oid old_id, new_id;
+	git_diff *diff;
+
+	build_tree_of_many_files(&old_id, "before", 300, 5);
+	build_tree_of_many_files(&new_id, "after", 300, 13);
+
+	cl_git_pass(git_tree_lookup(&old_tree, g_repo, &old_id));
+	cl_git_pass(git_tree_lookup(&new_tree, g_repo, &new_id));
+	cl_git_pass(git_diff_tree_to_tree(&diff, g_repo, old_tree, new_tree, NULL));
+
+	opts.flags = GIT_DIFF_FIND_RENAMES;
+	opts.rename_limit = 1000;
+	cl_git_pass(git_diff_find_similar(diff, &opts));
+	cl_assert_equal_i(300, git_diff_num_deltas(diff));
+
+	git_diff_free(diff);
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+}
+
+static void other_cache_file_path(git_buf *out, size_t fanout, bool lookalike)
+{
+	git_buf_clear(out);
+	cl_git_pass(git_buf_joinpath(out,
+		git_repository_commondir(g_repo), "similarity-cache"));
+	cl_git_pass(git_buf_printf(out, "/%02x/%s", (unsigned int)fanout,
+		lookalike ? "00000000000000000000000000000000000000-0" : "notes.txt"));
+}
+
+void test_diff_rename__similarity_cache_trim_keeps_other_files(void)
+{
+	git_buf path = GIT_BUF_INIT;
+	cached_signatures sigs;
+	size_t fanout;
+
+	cl_repo_set_bool(g_repo, "diff.similarityCache", true);
+	cl_repo_set_string(g_repo, "diff.similarityCacheSize", "1");
+
+	/* put other files, including one named like a signature, in every
+	 * fanout directory
+	 */
+	for (fanout = 0; fanout < 256; fanout++) {
+		other_cache_file_path(&path, fanout, false);
+		cl_git_pass(git_futils_mkpath2file(path.ptr, 0777));
+		cl_git_mkfile(path.ptr, "hello");
+
+		other_cache_file_path(&path, fanout, true);
+		cl_git_mkfile(path.ptr, "not a signature");
+	}
+
+	/* with no room in the cache, every trim removes all signatures... */
+	diff_trees_of_many_files_with_renames();
+
+	walk_cache_dir(&sigs, "similarity-cache", false);
+	cl_assert(sigs.count < 256 + 600);
+
+	/* ...but leaves the other files alone */
+	for (fanout = 0; fanout < 256; fanout++) {
+		other_cache_file_path(&path, fanout, false);
+		cl_assert(git_path_isfile(path.ptr));
+
+		other_cache_file_path(&path, fanout, true);
+		cl_assert(git_path_isfile(path.ptr));
+	}
+
+	git_buf_dispose(&path);
+}
+
+void test_diff_rename__similarity_cache_is_never_in_the_objects_dir(void)
+{
+	cached_signatures sigs;
+
+	cl_repo_set_bool(g_repo, "diff.similarityCache", true);
+	cl_repo_set_string(g_repo, "diff.similarityCacheDir", "objects");
+
+	diff_trees_of_many_files_with_renames();
+
+	walk_cache_dir(&sigs, "objects", false);
+	cl_assert_equal_i(0, sigs.count);
+}
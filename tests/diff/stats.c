@@ -343,3 +343,72 @@ void test_diff_stats__mode_change(void)
 	cl_assert_equal_s(stat, git_buf_cstr(&buf));
 	git_buf_dispose(&buf);
 }
+
+static void counted_lines_file(
+	git_buf *path, git_buf *content, size_t i, void *payload)
+{
+	bool modified = *(bool *)payload;
+	size_t line;
+
+	/* file i has i lines, of which every fifth one is changed */
+	for (line = 0; line < i; line++)
+		cl_git_pass(git_buf_printf(content, "line %"PRIuZ"%s\n", line,
+			(modified && line % 5 == 0) ? " changed" : ""));
+
+	/* and some new lines are added at the end */
+	for (line = 0; modified && line < i % 3; line++)
+		cl_git_pass(git_buf_puts(content, "added\n"));
+
+	cl_git_pass(git_buf_printf(path, "file%03"PRIuZ".txt", i));
+}
+
+static void build_tree_of_counted_lines(git_tree **out, bool modified)
+{
+	git_oid id;
+
+	cl_repo_write_tree_of_files(&id, _repo, 100, counted_lines_file, &modified);
+	cl_git_pass(git_tree_lookup(out, _repo, &id));
+}
+
+void test_diff_stats__many_files_match_their_patches(void)
+{
+	git_tree *old_tree, *new_tree;
+	git_diff *diff;
+	git_patch *patch;
+	git_buf buf = GIT_BUF_INIT, expected = GIT_BUF_INIT;
+	size_t i, adds, dels, total_adds = 0, total_dels = 0;
+
+	build_tree_of_counted_lines(&old_tree, false);
+	build_tree_of_counted_lines(&new_tree, true);
+
+	cl_git_pass(git_diff_tree_to_tree(&diff, _repo, old_tree, new_tree, NULL));
+	cl_assert_equal_sz(99, git_diff_num_deltas(diff));
+
+	cl_git_pass(git_diff_get_stats(&_stats, diff));
+
+	for (i = 0; i < git_diff_num_deltas(diff); i++) {
+		cl_git_pass(git_patch_from_diff(&patch, diff, i));
+		cl_git_pass(git_patch_line_stats(NULL, &adds, &dels, patch));
+
+		cl_git_pass(git_buf_printf(&expected, "%-8"PRIuZ"%-8"PRIuZ"%s\n",
+			adds, dels, git_patch_get_delta(patch)->new_file.path));
+
+		total_adds += adds;
+		total_dels += dels;
+
+		git_patch_free(patch);
+	}
+
+	cl_assert_equal_sz(99, git_diff_stats_files_changed(_stats));
+	cl_assert_equal_sz(total_adds, git_diff_stats_insertions(_stats));
+	cl_assert_equal_sz(total_dels, git_diff_stats_deletions(_stats));
+
+	cl_git_pass(git_diff_stats_to_buf(&buf, _stats, GIT_DIFF_STATS_NUMBER, 0));
+	cl_assert_equal_s(expected.ptr, buf.ptr);
+
+	git_buf_dispose(&buf);
+	git_buf_dispose(&expected);
+	git_diff_free(diff);
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+}
@@ -88,6 +88,51 @@ void test_diff_tree__0(void)
 	git_tree_free(c);
 }
 
+static int stop_after_two_files(
+	const git_diff_delta *delta, float progress, void *payload)
+{
+	int *files = payload;
+
+	GIT_UNUSED(delta);
+	GIT_UNUSED(progress);
+
+	return (++(*files) == 2) ? 42 : 0;
+}
+
+void test_diff_tree__foreach_streams_deltas(void)
+{
+	const char *a_commit = "605812a";
+	const char *b_commit = "370fe9ec22";
+	int files = 0;
+
+	g_repo = cl_git_sandbox_init("attr");
+
+	cl_assert((a = resolve_commit_oid_to_tree(g_repo, a_commit)) != NULL);
+	cl_assert((b = resolve_commit_oid_to_tree(g_repo, b_commit)) != NULL);
+
+	opts.context_lines = 1;
+	opts.interhunk_lines = 1;
+
+	cl_git_pass(git_diff_tree_to_tree_foreach(g_repo, a, b, &opts,
+		diff_file_cb, diff_binary_cb, diff_hunk_cb, diff_line_cb, &expect));
+
+	cl_assert_equal_i(5, expect.files);
+	cl_assert_equal_i(2, expect.file_status[GIT_DELTA_ADDED]);
+	cl_assert_equal_i(1, expect.file_status[GIT_DELTA_DELETED]);
+	cl_assert_equal_i(2, expect.file_status[GIT_DELTA_MODIFIED]);
+
+	cl_assert_equal_i(5, expect.hunks);
+
+	cl_assert_equal_i(7 + 24 + 1 + 6 + 6, expect.lines);
+	cl_assert_equal_i(1, expect.line_ctxt);
+	cl_assert_equal_i(24 + 1 + 5 + 5, expect.line_adds);
+	cl_assert_equal_i(7 + 1, expect.line_dels);
+
+	cl_assert_equal_i(42, git_diff_tree_to_tree_foreach(g_repo, a, b, &opts,
+		stop_after_two_files, NULL, NULL, NULL, &files));
+	cl_assert_equal_i(2, files);
+}
+
 #define DIFF_OPTS(FLAGS, CTXT) \
 	{GIT_DIFF_OPTIONS_VERSION, (FLAGS), GIT_SUBMODULE_IGNORE_UNSPECIFIED, \
 	{NULL,0}, NULL, NULL, NULL, (CTXT), 1}
@@ -2,12 +2,19 @@
 #include "diff_helpers.h"
 #include "repository.h"
 #include "git2/sys/diff.h"
+#include "git2/sys/filter.h"
 #include "../checkout/checkout_helpers.h"
 
 static git_repository *g_repo = NULL;
+static git_filter *g_filter = NULL;
 
 void test_diff_workdir__cleanup(void)
 {
+	if (g_filter) {
+		cl_git_pass(git_filter_unregister("threadcheck"));
+		g_filter = NULL;
+	}
+
 	cl_git_sandbox_cleanup();
 }
 
@@ -61,14 +68,46 @@ void test_diff_workdir__to_index(void)
 	{
 		git_diff_perfdata perf = GIT_DIFF_PERFDATA_INIT;
 		cl_git_pass(git_diff_get_perfdata(&perf, diff));
-		cl_assert_equal_sz(
-			13 /* in root */ + 3 /* in subdir */, perf.stat_calls);
+		cl_assert_equal_sz(11 /* in root */ + 3 /* in subdir */ +
+			cl_dir_stat_calls(2), perf.stat_calls);
 		cl_assert_equal_sz(5, perf.oid_calculations);
 	}
 
 	git_diff_free(diff);
 }
 
+void test_diff_workdir__to_index_foreach(void)
+{
+	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+	diff_expects exp;
+
+	g_repo = cl_git_sandbox_init("status");
+
+	opts.context_lines = 3;
+	opts.interhunk_lines = 1;
+	opts.flags |= GIT_DIFF_INCLUDE_IGNORED | GIT_DIFF_INCLUDE_UNTRACKED;
+
+	memset(&exp, 0, sizeof(exp));
+
+	cl_git_pass(git_diff_index_to_workdir_foreach(g_repo, NULL, &opts,
+		diff_file_cb, diff_binary_cb, diff_hunk_cb, diff_line_cb, &exp));
+
+	/* same results as test_diff_workdir__to_index */
+	cl_assert_equal_i(13, exp.files);
+	cl_assert_equal_i(0, exp.file_status[GIT_DELTA_ADDED]);
+	cl_assert_equal_i(4, exp.file_status[GIT_DELTA_DELETED]);
+	cl_assert_equal_i(4, exp.file_status[GIT_DELTA_MODIFIED]);
+	cl_assert_equal_i(1, exp.file_status[GIT_DELTA_IGNORED]);
+	cl_assert_equal_i(4, exp.file_status[GIT_DELTA_UNTRACKED]);
+
+	cl_assert_equal_i(8, exp.hunks);
+
+	cl_assert_equal_i(14, exp.lines);
+	cl_assert_equal_i(5, exp.line_ctxt);
+	cl_assert_equal_i(4, exp.line_adds);
+	cl_assert_equal_i(5, exp.line_dels);
+}
+
 void test_diff_workdir__to_index_with_conflicts(void)
 {
 	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
@@ -1815,7 +1854,7 @@ void test_diff_workdir__can_update_index(void)
 	basic_diff_status(&diff, &opts);
 
 	cl_git_pass(git_diff_get_perfdata(&perf, diff));
-	cl_assert_equal_sz(13 + 3, perf.stat_calls);
+	cl_assert_equal_sz(11 + 3 + cl_dir_stat_calls(2), perf.stat_calls);
 	cl_assert_equal_sz(5, perf.oid_calculations);
 
 	git_diff_free(diff);
@@ -1830,7 +1869,7 @@ void test_diff_workdir__can_update_index(void)
 	basic_diff_status(&diff, &opts);
 
 	cl_git_pass(git_diff_get_perfdata(&perf, diff));
-	cl_assert_equal_sz(13 + 3, perf.stat_calls);
+	cl_assert_equal_sz(11 + 3 + cl_dir_stat_calls(2), perf.stat_calls);
 	cl_assert_equal_sz(5, perf.oid_calculations);
 
 	git_diff_free(diff);
@@ -1842,12 +1881,154 @@ void test_diff_workdir__can_update_index(void)
 	basic_diff_status(&diff, &opts);
 
 	cl_git_pass(git_diff_get_perfdata(&perf, diff));
-	cl_assert_equal_sz(13 + 3, perf.stat_calls);
+	cl_assert_equal_sz(11 + 3 + cl_dir_stat_calls(2), perf.stat_calls);
 	cl_assert_equal_sz(0, perf.oid_calculations);
 
 	git_diff_free(diff);
 }
 
+void test_diff_workdir__hashes_many_uncertain_files(void)
+{
+	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+	git_diff *diff = NULL;
+	git_diff_perfdata perf = GIT_DIFF_PERFDATA_INIT;
+	git_index *index;
+	git_buf path = GIT_BUF_INIT;
+	diff_expects exp;
+	size_t i;
+
+	g_repo = cl_git_sandbox_init("empty_standard_repo");
+	cl_repo_set_bool(g_repo, "core.autocrlf", true);
+	cl_git_pass(git_repository_index(&index, g_repo));
+
+	/* enough files to be spread across several threads, hashed through
+	 * the crlf filter so that the index and workdir sizes differ */
+	for (i = 0; i < 200; i++) {
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, "empty_standard_repo/file%03d.txt", (int)i));
+		cl_git_rewritefile(path.ptr, "line one\r\nline two\r\n");
+		cl_git_pass(git_index_add_bypath(index, path.ptr + strlen("empty_standard_repo/")));
+	}
+
+	cl_git_pass(git_index_write(index));
+
+	/* change the contents of every tenth file without changing its size */
+	for (i = 0; i < 200; i += 10) {
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, "empty_standard_repo/file%03d.txt", (int)i));
+		cl_git_rewritefile(path.ptr, "line One\r\nline Two\r\n");
+	}
+
+	cl_git_pass(git_buf_sets(&path, "empty_standard_repo"));
+	cl_git_pass(git_path_direach(&path, 0, touch_file, NULL));
+	git_buf_dispose(&path);
+
+	opts.flags |= GIT_DIFF_UPDATE_INDEX;
+	tick_index(index);
+
+	cl_git_pass(git_diff_index_to_workdir(&diff, g_repo, index, &opts));
+
+	memset(&exp, 0, sizeof(exp));
+	cl_git_pass(git_diff_foreach(diff, diff_file_cb, NULL, NULL, NULL, &exp));
+	cl_assert_equal_i(20, exp.files);
+	cl_assert_equal_i(20, exp.file_status[GIT_DELTA_MODIFIED]);
+
+	cl_assert_equal_s("file000.txt", git_diff_get_delta(diff, 0)->new_file.path);
+	cl_assert_equal_s("file190.txt", git_diff_get_delta(diff, 19)->new_file.path);
+
+	cl_git_pass(git_diff_get_perfdata(&perf, diff));
+	cl_assert_equal_sz(200, perf.oid_calculations);
+	git_diff_free(diff);
+
+	/* the unmodified files were written back to the index */
+	tick_index(index);
+
+	cl_git_pass(git_diff_index_to_workdir(&diff, g_repo, index, &opts));
+	cl_assert_equal_sz(20, git_diff_num_deltas(diff));
+
+	cl_git_pass(git_diff_get_perfdata(&perf, diff));
+	cl_assert_equal_sz(20, perf.oid_calculations);
+	git_diff_free(diff);
+
+	git_index_free(index);
+}
+
+static size_t threadcheck_calls, threadcheck_other_threads;
+#ifdef GIT_THREADS
+static size_t threadcheck_thread;
+#endif
+
+static int threadcheck_apply(
+	git_filter *self,
+	void **payload,
+	git_buf *to,
+	const git_buf *from,
+	const git_filter_source *src)
+{
+	GIT_UNUSED(self); GIT_UNUSED(payload); GIT_UNUSED(to);
+	GIT_UNUSED(from); GIT_UNUSED(src);
+
+	threadcheck_calls++;
+
+#ifdef GIT_THREADS
+	if (git_thread_currentid() != threadcheck_thread)
+		threadcheck_other_threads++;
+#endif
+
+	return GIT_PASSTHROUGH;
+}
+
+void test_diff_workdir__custom_filters_are_applied_on_one_thread(void)
+{
+	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+	git_diff *diff = NULL;
+	static git_filter threadcheck;
+	git_index *index;
+	git_buf path = GIT_BUF_INIT;
+	size_t i;
+
+	cl_git_pass(git_filter_init(&threadcheck, GIT_FILTER_VERSION));
+	threadcheck.attributes = "threadcheck";
+	threadcheck.apply = threadcheck_apply;
+	cl_git_pass(git_filter_register("threadcheck", &threadcheck, 200));
+	g_filter = &threadcheck;
+
+	threadcheck_calls = threadcheck_other_threads = 0;
+#ifdef GIT_THREADS
+	threadcheck_thread = git_thread_currentid();
+#endif
+
+	g_repo = cl_git_sandbox_init("empty_standard_repo");
+	cl_git_mkfile("empty_standard_repo/.gitattributes", "*.txt threadcheck\n");
+	cl_git_pass(git_repository_index(&index, g_repo));
+
+	for (i = 0; i < 200; i++) {
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, "empty_standard_repo/file%03d.txt", (int)i));
+		cl_git_rewritefile(path.ptr, "line one\nline two\n");
+		cl_git_pass(git_index_add_bypath(index, path.ptr + strlen("empty_standard_repo/")));
+	}
+
+	cl_git_pass(git_index_write(index));
+
+	cl_git_pass(git_buf_sets(&path, "empty_standard_repo"));
+	cl_git_pass(git_path_direach(&path, 0, touch_file, NULL));
+	git_buf_dispose(&path);
+
+	/* every file has to be hashed through the custom filter */
+	threadcheck_calls = 0;
+	tick_index(index);
+
+	cl_git_pass(git_diff_index_to_workdir(&diff, g_repo, index, &opts));
+	cl_assert_equal_sz(0, git_diff_num_deltas(diff));
+
+	cl_assert_equal_sz(200, threadcheck_calls);
+	cl_assert_equal_sz(0, threadcheck_other_threads);
+
+	git_diff_free(diff);
+	git_index_free(index);
+}
+
 #define STR7    "0123456"
 #define STR8    "01234567"
 #define STR40   STR8   STR8   STR8   STR8   STR8
@@ -56,3 +56,64 @@ void test_graph_ahead_behind__returns_correct_result(void)
 
 	git_commit_free(other);
 }
+
+static void assert_many_matches_single(const char *upstream_ref, size_t count)
+{
+	const char *refs[] = {
+		"refs/heads/master", "refs/heads/br2", "refs/heads/chomped",
+		"refs/heads/haacked", "refs/heads/packed", "refs/heads/packed-test",
+		"refs/heads/subtrees", "refs/heads/track-local",
+		"refs/remotes/test/master",
+	};
+	git_oid *locals, upstream;
+	size_t *aheads, *behinds;
+	size_t i;
+
+	locals = git__calloc(count, sizeof(git_oid));
+	aheads = git__calloc(count, sizeof(size_t));
+	behinds = git__calloc(count, sizeof(size_t));
+	cl_assert(locals && aheads && behinds);
+
+	for (i = 0; i < count; i++)
+		cl_git_pass(git_reference_name_to_id(&locals[i], _repo,
+			refs[i % ARRAY_SIZE(refs)]));
+
+	cl_git_pass(git_reference_name_to_id(&upstream, _repo, upstream_ref));
+
+	cl_git_pass(git_graph_ahead_behind_many(aheads, behinds, _repo,
+		locals, count, &upstream));
+
+	for (i = 0; i < count; i++) {
+		cl_git_pass(git_graph_ahead_behind(&ahead, &behind, _repo,
+			&locals[i], &upstream));
+		cl_assert_equal_sz(ahead, aheads[i]);
+		cl_assert_equal_sz(behind, behinds[i]);
+	}
+
+	git__free(locals);
+	git__free(aheads);
+	git__free(behinds);
+}
+
+void test_graph_ahead_behind__many_matches_single(void)
+{
+	assert_many_matches_single("refs/heads/br2", 9);
+	assert_many_matches_single("refs/heads/master", 9);
+	assert_many_matches_single("refs/heads/subtrees", 9);
+	assert_many_matches_single("refs/heads/packed", 9);
+}
+
+void test_graph_ahead_behind__many_with_more_than_one_word(void)
+{
+	assert_many_matches_single("refs/heads/master", 150);
+	assert_many_matches_single("refs/heads/haacked", 63);
+	assert_many_matches_single("refs/heads/haacked", 64);
+}
+
+void test_graph_ahead_behind__many_with_no_locals(void)
+{
+	git_oid upstream;
+
+	cl_git_pass(git_reference_name_to_id(&upstream, _repo, "refs/heads/master"));
+	cl_git_pass(git_graph_ahead_behind_many(NULL, NULL, _repo, NULL, 0, &upstream));
+}
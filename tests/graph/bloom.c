@@ -0,0 +1,138 @@
+#include "clar_libgit2.h"
+#include "commit_bloom.h"
+#include "futils.h"
+
+static git_repository *_repo;
+
+void test_graph_bloom__initialize(void)
+{
+	_repo = cl_git_sandbox_init("testrepo.git");
+}
+
+void test_graph_bloom__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+static void update_from(const char *ref)
+{
+	git_oid tip;
+
+	cl_git_pass(git_reference_name_to_id(&tip, _repo, ref));
+	cl_git_pass(git_graph_bloom_update(_repo, &tip, 1));
+}
+
+static int maybe_changed(const char *commit, const char *path)
+{
+	git_oid id;
+
+	cl_git_pass(git_oid_fromstr(&id, commit));
+	return git_commit_bloom_maybe_changed(_repo, &id, path);
+}
+
+static size_t count_walk(const char *ref, const char *path)
+{
+	git_strarray pathspec = { (char **)&path, 1 };
+	git_revwalk *walk;
+	git_oid oid;
+	size_t count = 0;
+
+	cl_git_pass(git_revwalk_new(&walk, _repo));
+	cl_git_pass(git_revwalk_pathspec(walk, &pathspec));
+	cl_git_pass(git_revwalk_push_ref(walk, ref));
+
+	while (git_revwalk_next(&oid, walk) == 0)
+		count++;
+
+	git_revwalk_free(walk);
+	return count;
+}
+
+void test_graph_bloom__writes_filters(void)
+{
+	update_from("refs/heads/master");
+	cl_assert(git_path_exists("testrepo.git/objects/info/commit-bloom"));
+
+	/* 4a202b3 changed README, and be3563a merged it in */
+	cl_assert_equal_i(1, maybe_changed("4a202b346bb0fb0db7eff3cffeb3c70babbd2045", "README"));
+	cl_assert_equal_i(0, maybe_changed("c47800c7266a2be04c571c04d5a6614691ea99bd", "README"));
+	cl_assert_equal_i(1, maybe_changed("c47800c7266a2be04c571c04d5a6614691ea99bd", "branch_file.txt"));
+	cl_assert_equal_i(1, maybe_changed("8496071c1b46c854b31185ea97743be6a8774479", "README"));
+
+	/* commits outside of the history have no filters */
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		maybe_changed("763d71aadf09a7951596c9746c024e7eece7c7af", "README"));
+}
+
+void test_graph_bloom__filters_include_directories(void)
+{
+	update_from("refs/heads/subtrees");
+
+	cl_assert_equal_i(1, maybe_changed("763d71aadf09a7951596c9746c024e7eece7c7af", "ab"));
+	cl_assert_equal_i(1, maybe_changed("763d71aadf09a7951596c9746c024e7eece7c7af", "ab/de"));
+	cl_assert_equal_i(1, maybe_changed("763d71aadf09a7951596c9746c024e7eece7c7af", "ab/de/fgh/1.txt"));
+}
+
+void test_graph_bloom__updates_incrementally(void)
+{
+	update_from("refs/heads/br2");
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		maybe_changed("a65fedf39aefe402d3bb6e24df4d4f5fe4547750", "README"));
+
+	update_from("refs/heads/master");
+	cl_assert_equal_i(1, maybe_changed("4a202b346bb0fb0db7eff3cffeb3c70babbd2045", "README"));
+	cl_assert_equal_i(1, maybe_changed("a65fedf39aefe402d3bb6e24df4d4f5fe4547750", "branch_file.txt"));
+}
+
+void test_graph_bloom__walks_are_unchanged(void)
+{
+	const char *paths[] = { "README", "new.txt", "branch_file.txt", "ab", "ab/de", "nonexistent" };
+	const char *refs[] = { "refs/heads/master", "refs/heads/subtrees", "refs/heads/packed" };
+	size_t expected[ARRAY_SIZE(refs)][ARRAY_SIZE(paths)];
+	size_t i, j;
+
+	for (i = 0; i < ARRAY_SIZE(refs); i++)
+		for (j = 0; j < ARRAY_SIZE(paths); j++)
+			expected[i][j] = count_walk(refs[i], paths[j]);
+
+	for (i = 0; i < ARRAY_SIZE(refs); i++)
+		update_from(refs[i]);
+
+	for (i = 0; i < ARRAY_SIZE(refs); i++)
+		for (j = 0; j < ARRAY_SIZE(paths); j++)
+			cl_assert_equal_sz(expected[i][j], count_walk(refs[i], paths[j]));
+}
+
+void test_graph_bloom__blame_is_unchanged(void)
+{
+	git_blame *before, *after;
+	const git_blame_hunk *a, *b;
+	size_t i;
+
+	cl_git_pass(git_blame_file(&before, _repo, "README", NULL));
+	update_from("refs/heads/master");
+	cl_git_pass(git_blame_file(&after, _repo, "README", NULL));
+
+	cl_assert_equal_i(git_blame_get_hunk_count(before), git_blame_get_hunk_count(after));
+
+	for (i = 0; i < git_blame_get_hunk_count(before); i++) {
+		a = git_blame_get_hunk_byindex(before, (uint32_t)i);
+		b = git_blame_get_hunk_byindex(after, (uint32_t)i);
+
+		cl_assert_equal_oid(&a->final_commit_id, &b->final_commit_id);
+		cl_assert_equal_i(a->lines_in_hunk, b->lines_in_hunk);
+	}
+
+	git_blame_free(before);
+	git_blame_free(after);
+}
+
+void test_graph_bloom__corrupt_file(void)
+{
+	update_from("refs/heads/master");
+	cl_git_rewritefile("testrepo.git/objects/info/commit-bloom", "not a filter");
+
+	cl_git_fail(git_commit_bloom_refresh(_repo));
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		maybe_changed("4a202b346bb0fb0db7eff3cffeb3c70babbd2045", "README"));
+}
@@ -53,3 +53,22 @@ void test_graph_descendant_of__nopath(void)
 	git_oid_fromstr(&oid, "e90810b8df3e80c413d903f631643c716887138d");
 	cl_assert_equal_i(0, git_graph_descendant_of(_repo, git_commit_id(commit), &oid));
 }
+
+void test_graph_descendant_of__through_merges(void)
+{
+	git_oid tip, ancestor;
+
+	/* a65fedf is a descendant of 4a202b3 through the second parent of be3563a */
+	git_oid_fromstr(&tip, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+	git_oid_fromstr(&ancestor, "4a202b346bb0fb0db7eff3cffeb3c70babbd2045");
+
+	cl_assert_equal_i(1, git_graph_descendant_of(_repo, &tip, &ancestor));
+	cl_assert_equal_i(0, git_graph_descendant_of(_repo, &ancestor, &tip));
+
+	/* c47800c and 9fd738e are on parallel branches */
+	git_oid_fromstr(&tip, "c47800c7266a2be04c571c04d5a6614691ea99bd");
+	git_oid_fromstr(&ancestor, "9fd738e8f7967c078dceed8190330fc8648ee56a");
+
+	cl_assert_equal_i(0, git_graph_descendant_of(_repo, &tip, &ancestor));
+	cl_assert_equal_i(0, git_graph_descendant_of(_repo, &ancestor, &tip));
+}
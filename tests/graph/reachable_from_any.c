@@ -0,0 +1,178 @@
+#include "clar_libgit2.h"
+
+static git_repository *_repo;
+static bool _sandboxed;
+static git_oid commits[64];
+static size_t commits_len;
+
+void test_graph_reachable_from_any__initialize(void)
+{
+	git_revwalk *walk;
+	git_oid oid;
+
+	cl_git_pass(git_repository_open(&_repo, cl_fixture("testrepo.git")));
+
+	cl_git_pass(git_revwalk_new(&walk, _repo));
+	cl_git_pass(git_revwalk_push_glob(walk, "heads/*"));
+
+	for (commits_len = 0; git_revwalk_next(&oid, walk) == 0; commits_len++) {
+		cl_assert(commits_len < ARRAY_SIZE(commits));
+		git_oid_cpy(&commits[commits_len], &oid);
+	}
+
+	git_revwalk_free(walk);
+}
+
+void test_graph_reachable_from_any__cleanup(void)
+{
+	if (_sandboxed)
+		cl_git_sandbox_cleanup();
+	else
+		git_repository_free(_repo);
+
+	_sandboxed = false;
+	_repo = NULL;
+}
+
+static void assert_reachable_from(const char **tip_refs, size_t tips_len)
+{
+	git_oid tips[8];
+	int reachable[ARRAY_SIZE(commits)], expected;
+	size_t i, j;
+
+	cl_assert(tips_len <= ARRAY_SIZE(tips));
+
+	for (i = 0; i < tips_len; i++)
+		cl_git_pass(git_reference_name_to_id(&tips[i], _repo, tip_refs[i]));
+
+	cl_git_pass(git_graph_reachable_from_any(reachable, _repo,
+		commits, commits_len, tips, tips_len));
+
+	for (i = 0; i < commits_len; i++) {
+		expected = 0;
+
+		for (j = 0; !expected && j < tips_len; j++)
+			expected = git_oid_equal(&commits[i], &tips[j]) ||
+				git_graph_descendant_of(_repo, &tips[j], &commits[i]);
+
+		cl_assert_equal_i(expected, reachable[i]);
+	}
+}
+
+void test_graph_reachable_from_any__single_tip(void)
+{
+	const char *master[] = { "refs/heads/master" };
+	const char *br2[] = { "refs/heads/br2" };
+	const char *subtrees[] = { "refs/heads/subtrees" };
+	const char *haacked[] = { "refs/heads/haacked" };
+
+	assert_reachable_from(master, 1);
+	assert_reachable_from(br2, 1);
+	assert_reachable_from(subtrees, 1);
+	assert_reachable_from(haacked, 1);
+}
+
+void test_graph_reachable_from_any__many_tips(void)
+{
+	const char *tips[] = {
+		"refs/heads/br2", "refs/heads/haacked", "refs/heads/packed",
+		"refs/heads/packed-test", "refs/heads/br2",
+	};
+
+	assert_reachable_from(tips, ARRAY_SIZE(tips));
+	assert_reachable_from(tips + 1, 3);
+}
+
+void test_graph_reachable_from_any__with_stored_generations(void)
+{
+	const char *tips[] = {
+		"refs/heads/br2", "refs/heads/haacked", "refs/heads/subtrees",
+	};
+
+	git_repository_free(_repo);
+	_repo = cl_git_sandbox_init("testrepo.git");
+	_sandboxed = true;
+
+	cl_git_pass(git_graph_generations_update(_repo, commits, commits_len));
+
+	assert_reachable_from(tips, ARRAY_SIZE(tips));
+	assert_reachable_from(tips + 1, 1);
+}
+
+static void commit_at(
+	git_oid *out, git_time_t time, git_commit *parent)
+{
+	git_signature *sig;
+	git_tree *tree;
+
+	cl_git_pass(git_signature_new(&sig, "Tester", "tester@example.com", time, 0));
+	cl_git_pass(git_commit_tree(&tree, parent));
+	cl_git_pass(git_commit_create(out, _repo, NULL, sig, sig,
+		NULL, "commit\n", tree, 1, (const git_commit **)&parent));
+
+	git_tree_free(tree);
+	git_signature_free(sig);
+}
+
+void test_graph_reachable_from_any__with_skewed_dates(void)
+{
+	git_commit *head, *parent, *child;
+	git_oid parent_id, child_id, tip_id;
+	int reachable[2];
+	git_oid ids[2];
+
+	git_repository_free(_repo);
+	_repo = cl_git_sandbox_init("testrepo.git");
+	_sandboxed = true;
+
+	cl_git_pass(git_revparse_single((git_object **)&head, _repo, "master"));
+
+	/* the parent is dated five days after its child */
+	commit_at(&parent_id, 1600000000 + 5 * 24 * 60 * 60, head);
+	cl_git_pass(git_commit_lookup(&parent, _repo, &parent_id));
+	commit_at(&child_id, 1600000000, parent);
+	cl_git_pass(git_commit_lookup(&child, _repo, &child_id));
+	commit_at(&tip_id, 1600000000 + 10 * 24 * 60 * 60, child);
+
+	git_oid_cpy(&ids[0], &parent_id);
+	git_oid_cpy(&ids[1], git_commit_id(head));
+
+	/* the parent is only reachable through its older child */
+	cl_git_pass(git_graph_reachable_from_any(reachable, _repo,
+		ids, 1, &tip_id, 1));
+	cl_assert_equal_i(1, reachable[0]);
+
+	cl_git_pass(git_graph_reachable_from_any(reachable, _repo,
+		ids, 2, &tip_id, 1));
+	cl_assert_equal_i(1, reachable[0]);
+	cl_assert_equal_i(1, reachable[1]);
+
+	git_commit_free(child);
+	git_commit_free(parent);
+	git_commit_free(head);
+}
+
+void test_graph_reachable_from_any__no_tips(void)
+{
+	int reachable[ARRAY_SIZE(commits)];
+	size_t i;
+
+	cl_git_pass(git_graph_reachable_from_any(reachable, _repo,
+		commits, commits_len, NULL, 0));
+
+	for (i = 0; i < commits_len; i++)
+		cl_assert_equal_i(0, reachable[i]);
+}
+
+void test_graph_reachable_from_any__missing_commit(void)
+{
+	int reachable[2];
+	git_oid ids[2], tip;
+
+	cl_git_pass(git_reference_name_to_id(&tip, _repo, "refs/heads/master"));
+	git_oid_cpy(&ids[0], &tip);
+	cl_git_pass(git_oid_fromstr(&ids[1], "deadbeefdeadbeefdeadbeefdeadbeefdeadbeef"));
+
+	cl_git_fail_with(GIT_ENOTFOUND,
+		git_graph_reachable_from_any(reachable, _repo, ids, 2, &tip, 1));
+}
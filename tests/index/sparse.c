@@ -0,0 +1,283 @@
+#include "clar_libgit2.h"
+#include "index.h"
+#include "iterator.h"
+
+static git_repository *g_repo;
+static git_index *g_index;
+
+void test_index_sparse__initialize(void)
+{
+	g_repo = cl_git_sandbox_init("status");
+	cl_git_pass(git_repository_index(&g_index, g_repo));
+}
+
+void test_index_sparse__cleanup(void)
+{
+	git_index_free(g_index);
+	g_index = NULL;
+
+	cl_git_sandbox_cleanup();
+}
+
+static void skip_worktree(const char *prefix)
+{
+	const git_index_entry *entry;
+	git_index_entry copy;
+	size_t i;
+
+	for (i = 0; i < git_index_entrycount(g_index); i++) {
+		entry = git_index_get_byindex(g_index, i);
+
+		if (git__prefixcmp(entry->path, prefix) != 0)
+			continue;
+
+		memcpy(&copy, entry, sizeof(git_index_entry));
+		copy.flags_extended |= GIT_INDEX_ENTRY_SKIP_WORKTREE;
+		cl_git_pass(git_index_add(g_index, &copy));
+	}
+}
+
+static void assert_sparse_subdir(void)
+{
+	const git_index_entry *entry;
+	git_object *subdir;
+
+	cl_git_pass(git_revparse_single(&subdir, g_repo, "HEAD:subdir"));
+
+	cl_assert((entry = git_index_get_bypath(g_index, "subdir/", 0)) != NULL);
+	cl_assert_equal_i(GIT_FILEMODE_TREE, entry->mode);
+	cl_assert(entry->flags_extended & GIT_INDEX_ENTRY_SKIP_WORKTREE);
+	cl_assert_equal_oid(git_object_id(subdir), &entry->id);
+
+	git_object_free(subdir);
+}
+
+void test_index_sparse__collapse_directory(void)
+{
+	size_t count = git_index_entrycount(g_index);
+	git_oid before, after;
+
+	cl_git_pass(git_index_write_tree(&before, g_index));
+
+	skip_worktree("subdir/");
+	cl_git_pass(git_index_sparse_collapse(g_index, "subdir"));
+
+	cl_assert_equal_sz(count - 2, git_index_entrycount(g_index));
+	assert_sparse_subdir();
+
+	cl_git_pass(git_index_write_tree(&after, g_index));
+	cl_assert_equal_oid(&before, &after);
+}
+
+void test_index_sparse__collapse_requires_skip_worktree(void)
+{
+	size_t count = git_index_entrycount(g_index);
+
+	cl_git_fail(git_index_sparse_collapse(g_index, "subdir"));
+	cl_assert_equal_sz(count, git_index_entrycount(g_index));
+
+	cl_git_fail_with(GIT_ENOTFOUND,
+		git_index_sparse_collapse(g_index, "nonexistent"));
+}
+
+void test_index_sparse__write_and_read(void)
+{
+	git_oid before, after;
+
+	cl_git_pass(git_index_write_tree(&before, g_index));
+
+	skip_worktree("subdir/");
+	cl_git_pass(git_index_sparse_collapse(g_index, "subdir"));
+	cl_git_pass(git_index_write(g_index));
+
+	cl_git_pass(git_index_read(g_index, true));
+	cl_assert(g_index->sparse);
+	assert_sparse_subdir();
+
+	/* the tree cache is not needed to write a sparse directory */
+	g_index->tree = NULL;
+
+	cl_git_pass(git_index_write_tree(&after, g_index));
+	cl_assert_equal_oid(&before, &after);
+}
+
+void test_index_sparse__lookup_expands_lazily(void)
+{
+	size_t count = git_index_entrycount(g_index);
+	const git_index_entry *entry;
+
+	skip_worktree("subdir/");
+	cl_git_pass(git_index_sparse_collapse(g_index, "subdir"));
+
+	/* paths outside of the sparse directory do not expand it */
+	cl_assert(git_index_get_bypath(g_index, "subdir.txt", 0) != NULL);
+	cl_assert(git_index_get_bypath(g_index, "subdir/", 0) != NULL);
+
+	cl_assert((entry = git_index_get_bypath(g_index, "subdir/modified_file", 0)) != NULL);
+	cl_assert(entry->flags_extended & GIT_INDEX_ENTRY_SKIP_WORKTREE);
+	cl_assert_equal_i(GIT_FILEMODE_BLOB, entry->mode);
+
+	cl_assert_equal_sz(count, git_index_entrycount(g_index));
+	cl_assert(git_index_get_bypath(g_index, "subdir/", 0) == NULL);
+}
+
+void test_index_sparse__add_and_remove_expand(void)
+{
+	size_t count = git_index_entrycount(g_index);
+	git_index_entry entry;
+
+	skip_worktree("subdir/");
+	cl_git_pass(git_index_sparse_collapse(g_index, "subdir"));
+
+	cl_git_pass(git_index_remove(g_index, "subdir/deleted_file", 0));
+	cl_assert_equal_sz(count - 1, git_index_entrycount(g_index));
+	cl_assert(git_index_get_bypath(g_index, "subdir/current_file", 0) != NULL);
+
+	cl_git_pass(git_index_sparse_collapse(g_index, "subdir"));
+
+	memcpy(&entry, git_index_get_bypath(g_index, "subdir.txt", 0), sizeof(entry));
+	entry.path = "subdir/new_file";
+	cl_git_pass(git_index_add(g_index, &entry));
+
+	cl_assert_equal_sz(count, git_index_entrycount(g_index));
+	cl_assert(git_index_get_bypath(g_index, "subdir/", 0) == NULL);
+}
+
+void test_index_sparse__iterating_does_not_expand(void)
+{
+	size_t count = git_index_entrycount(g_index), deltas;
+	git_diff *diff;
+	git_object *head;
+
+	cl_git_pass(git_revparse_single(&head, g_repo, "HEAD^{tree}"));
+	cl_git_pass(git_diff_tree_to_index(&diff, g_repo, (git_tree *)head, g_index, NULL));
+	deltas = git_diff_num_deltas(diff);
+	git_diff_free(diff);
+
+	skip_worktree("subdir/");
+	cl_git_pass(git_index_sparse_collapse(g_index, "subdir"));
+
+	/* the iterator sees the contents of the sparse directory... */
+	cl_git_pass(git_diff_tree_to_index(&diff, g_repo, (git_tree *)head, g_index, NULL));
+	cl_assert_equal_sz(deltas, git_diff_num_deltas(diff));
+
+	/* ...but the index itself stays sparse */
+	cl_assert_equal_sz(count - 2, git_index_entrycount(g_index));
+	cl_assert(g_index->sparse);
+	assert_sparse_subdir();
+
+	git_diff_free(diff);
+	git_object_free(head);
+}
+
+static void break_sparse_subdir(void)
+{
+	git_index_entry *entry;
+
+	entry = (git_index_entry *)git_index_get_bypath(g_index, "subdir/", 0);
+	cl_assert(entry != NULL);
+	cl_git_pass(git_oid_fromstr(&entry->id,
+		"deadbeefdeadbeefdeadbeefdeadbeefdeadbeef"));
+}
+
+static int count_iterator(git_iterator *iter, size_t *count)
+{
+	const git_index_entry *entry;
+	int error;
+
+	*count = 0;
+
+	while ((error = git_iterator_advance(&entry, iter)) == 0)
+		(*count)++;
+
+	return (error == GIT_ITEROVER) ? 0 : error;
+}
+
+void test_index_sparse__iterating_expands_only_what_it_reaches(void)
+{
+	git_iterator_options opts = GIT_ITERATOR_OPTIONS_INIT;
+	git_iterator *iter;
+	char *paths[] = { "current_file", "subdir.txt" };
+	size_t count;
+
+	skip_worktree("subdir/");
+	cl_git_pass(git_index_sparse_collapse(g_index, "subdir"));
+	break_sparse_subdir();
+
+	/* a range that ends before the sparse directory */
+	opts.end = "staged";
+	cl_git_pass(git_iterator_for_index(&iter, g_repo, g_index, &opts));
+	cl_git_pass(count_iterator(iter, &count));
+	cl_assert(count > 0);
+
+	/* moving the range over the sparse directory expands it */
+	cl_git_fail(git_iterator_reset_range(iter, "subdir/", "subdir/zzz"));
+	git_iterator_free(iter);
+
+	/* a pathlist that does not reach into the sparse directory */
+	opts.end = NULL;
+	opts.pathlist.strings = paths;
+	opts.pathlist.count = 2;
+	cl_git_pass(git_iterator_for_index(&iter, g_repo, g_index, &opts));
+	cl_git_pass(count_iterator(iter, &count));
+	cl_assert_equal_sz(2, count);
+	git_iterator_free(iter);
+
+	/* a pathlist that does */
+	paths[1] = "subdir/current_file";
+	cl_git_fail(git_iterator_for_index(&iter, g_repo, g_index, &opts));
+
+	opts.pathlist.count = 0;
+	cl_git_fail(git_iterator_for_index(&iter, g_repo, g_index, &opts));
+}
+
+void test_index_sparse__resetting_the_range_expands(void)
+{
+	git_iterator_options opts = GIT_ITERATOR_OPTIONS_INIT;
+	git_iterator *iter;
+	size_t count;
+
+	skip_worktree("subdir/");
+	cl_git_pass(git_index_sparse_collapse(g_index, "subdir"));
+
+	opts.end = "staged";
+	cl_git_pass(git_iterator_for_index(&iter, g_repo, g_index, &opts));
+
+	cl_git_pass(git_iterator_reset_range(iter, "subdir/", "subdir/zzz"));
+	cl_git_pass(count_iterator(iter, &count));
+	cl_assert_equal_sz(3, count);
+
+	git_iterator_free(iter);
+	assert_sparse_subdir();
+}
+
+void test_index_sparse__failed_expansion_leaves_index_unchanged(void)
+{
+	size_t count;
+
+	skip_worktree("subdir/");
+	cl_git_pass(git_index_sparse_collapse(g_index, "subdir"));
+	count = git_index_entrycount(g_index);
+
+	break_sparse_subdir();
+
+	cl_assert(git_index_get_bypath(g_index, "subdir/current_file", 0) == NULL);
+	cl_git_fail(git_index_sparse_expand(g_index));
+
+	cl_assert_equal_sz(count, git_index_entrycount(g_index));
+	cl_assert(g_index->sparse);
+	cl_assert(git_index_get_bypath(g_index, "subdir/", 0) != NULL);
+	cl_assert(git_index_get_bypath(g_index, "subdir.txt", 0) != NULL);
+}
+
+void test_index_sparse__expand(void)
+{
+	size_t count = git_index_entrycount(g_index);
+
+	skip_worktree("subdir/");
+	cl_git_pass(git_index_sparse_collapse(g_index, "subdir"));
+	cl_git_pass(git_index_sparse_expand(g_index));
+
+	cl_assert_equal_sz(count, git_index_entrycount(g_index));
+	cl_assert(git_index_get_bypath(g_index, "subdir/deleted_file", 0) != NULL);
+}
@@ -1,6 +1,7 @@
 #include "clar_libgit2.h"
 #include "git2/repository.h"
 #include "git2/merge.h"
+#include "git2/sys/index.h"
 #include "buffer.h"
 #include "merge.h"
 #include "futils.h"
@@ -194,3 +195,93 @@ void test_merge_trees_automerge__unrelated(void)
 
 	git_index_free(index);
 }
+
+#define MANY_FILES 600
+
+typedef struct {
+	int changed_first;
+	int changed_last;
+} many_files_changes;
+
+static void many_files_file(
+	git_buf *path, git_buf *content, size_t i, void *payload)
+{
+	many_files_changes *changes = payload;
+	int line;
+
+	cl_git_pass(git_buf_printf(path, "file%03d.txt", (int)i));
+
+	for (line = 1; line <= 20; line++) {
+		if (line == 1 && changes->changed_first &&
+		    (changes->changed_first == 1 || i % 10 == 0))
+			cl_git_pass(git_buf_printf(content,
+				"first line of %d from side %d\n",
+				(int)i, changes->changed_first));
+		else if (line == 20 && changes->changed_last && i % 10 != 0)
+			cl_git_pass(git_buf_printf(content,
+				"last line of %d changed\n", (int)i));
+		else
+			cl_git_pass(git_buf_printf(content,
+				"line %d of file %d\n", line, (int)i));
+	}
+}
+
+static void build_many_files_tree(git_tree **out, int changed_first, int changed_last)
+{
+	many_files_changes changes;
+	git_oid id;
+
+	changes.changed_first = changed_first;
+	changes.changed_last = changed_last;
+
+	cl_repo_write_tree_of_files(&id, repo, MANY_FILES, many_files_file, &changes);
+	cl_git_pass(git_tree_lookup(out, repo, &id));
+}
+
+void test_merge_trees_automerge__many_files(void)
+{
+	git_tree *ancestor, *ours, *theirs, *expected;
+	git_index *index;
+	const git_index_entry *entry, *anc, *our, *their;
+	git_buf path = GIT_BUF_INIT;
+	size_t i;
+
+	/* every file is changed at the top in ours; theirs changes the bottom
+	 * of nine in ten files, which merge cleanly, and the top of the rest,
+	 * which conflict
+	 */
+	build_many_files_tree(&ancestor, 0, 0);
+	build_many_files_tree(&ours, 1, 0);
+	build_many_files_tree(&theirs, 2, 1);
+	build_many_files_tree(&expected, 1, 1);
+
+	cl_git_pass(git_merge_trees(&index, repo, ancestor, ours, theirs, NULL));
+
+	cl_assert_equal_i(MANY_FILES / 10 * 9 + MANY_FILES / 10 * 3,
+		git_index_entrycount(index));
+
+	for (i = 0; i < MANY_FILES; i++) {
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, "file%03d.txt", (int)i));
+
+		if (i % 10 == 0) {
+			cl_git_pass(git_index_conflict_get(&anc, &our, &their,
+				index, path.ptr));
+			cl_assert_equal_oid(git_tree_entry_id(git_tree_entry_byname(ancestor, path.ptr)), &anc->id);
+			cl_assert_equal_oid(git_tree_entry_id(git_tree_entry_byname(ours, path.ptr)), &our->id);
+			cl_assert_equal_oid(git_tree_entry_id(git_tree_entry_byname(theirs, path.ptr)), &their->id);
+		} else {
+			cl_assert((entry = git_index_get_bypath(index, path.ptr, 0)) != NULL);
+			cl_assert_equal_oid(git_tree_entry_id(git_tree_entry_byname(expected, path.ptr)), &entry->id);
+		}
+	}
+
+	cl_assert_equal_i(MANY_FILES / 10 * 9, git_index_reuc_entrycount(index));
+
+	git_index_free(index);
+	git_tree_free(ancestor);
+	git_tree_free(ours);
+	git_tree_free(theirs);
+	git_tree_free(expected);
+	git_buf_dispose(&path);
+}
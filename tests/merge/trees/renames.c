@@ -5,6 +5,8 @@
 #include "merge.h"
 #include "../merge_helpers.h"
 #include "futils.h"
+#include "diff_tform.h"
+#include "git2/sys/hashsig.h"
 
 static git_repository *repo;
 
@@ -351,3 +353,66 @@ void test_merge_trees_renames__cache_recomputation(void)
 	git_tree_free(our_tree);
 	git__free(data);
 }
+
+static int failing_similarity(
+	int *score, void *siga, void *sigb, void *payload)
+{
+	GIT_UNUSED(score); GIT_UNUSED(siga); GIT_UNUSED(sigb); GIT_UNUSED(payload);
+
+	git_error_set(GIT_ERROR_MERGE, "similarity failed");
+	return -1;
+}
+
+static void write_tree_with(
+	git_tree **out, const char *one, const char *one_content,
+	const char *two, const char *two_content)
+{
+	git_treebuilder *builder;
+	git_oid id;
+
+	cl_git_pass(git_treebuilder_new(&builder, repo, NULL));
+
+	cl_git_pass(git_blob_create_from_buffer(&id, repo, one_content, strlen(one_content)));
+	cl_git_pass(git_treebuilder_insert(NULL, builder, one, &id, GIT_FILEMODE_BLOB));
+	cl_git_pass(git_blob_create_from_buffer(&id, repo, two_content, strlen(two_content)));
+	cl_git_pass(git_treebuilder_insert(NULL, builder, two, &id, GIT_FILEMODE_BLOB));
+
+	cl_git_pass(git_treebuilder_write(&id, builder));
+	cl_git_pass(git_tree_lookup(out, repo, &id));
+
+	git_treebuilder_free(builder);
+}
+
+void test_merge_trees_renames__metric_errors_on_their_side(void)
+{
+	git_merge_options opts = GIT_MERGE_OPTIONS_INIT;
+	git_diff_similarity_metric metric = {
+		git_diff_find_similar__hashsig_for_file,
+		git_diff_find_similar__hashsig_for_buf,
+		git_diff_find_similar__hashsig_free,
+		failing_similarity,
+		(void *)GIT_HASHSIG_SMART_WHITESPACE
+	};
+	git_tree *ancestor_tree, *our_tree, *their_tree;
+	git_index *index;
+
+	/* only their side renames (and changes) a file */
+	write_tree_with(&ancestor_tree,
+		"file.txt", "1\n2\n3\n4\n5\n6\n7\n8\n9\n10\n",
+		"other.txt", "unchanged\n");
+	write_tree_with(&our_tree,
+		"file.txt", "1\n2\n3\n4\n5\n6\n7\n8\n9\n10\n",
+		"other.txt", "changed in ours\n");
+	write_tree_with(&their_tree,
+		"other.txt", "unchanged\n",
+		"renamed.txt", "1\n2\n3\n4\n5\n6\n7\n8\n9\nten\n");
+
+	opts.metric = &metric;
+	cl_git_fail(git_merge_trees(&index, repo,
+		ancestor_tree, our_tree, their_tree, &opts));
+	cl_assert_equal_s("similarity failed", git_error_last()->message);
+
+	git_tree_free(ancestor_tree);
+	git_tree_free(our_tree);
+	git_tree_free(their_tree);
+}
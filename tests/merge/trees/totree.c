@@ -0,0 +1,204 @@
+#include "clar_libgit2.h"
+#include "git2/repository.h"
+#include "git2/merge.h"
+#include "merge.h"
+
+static git_repository *repo;
+
+#define TEST_REPO_PATH "merge-resolve"
+
+void test_merge_trees_totree__initialize(void)
+{
+	repo = cl_git_sandbox_init(TEST_REPO_PATH);
+}
+
+void test_merge_trees_totree__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+static void lookup_trees(
+	git_tree **ancestor_tree,
+	git_tree **our_tree,
+	git_tree **their_tree,
+	const char *ours_name,
+	const char *theirs_name)
+{
+	git_reference *ours, *theirs;
+	git_commit *our_commit, *their_commit, *ancestor_commit;
+	git_oid ancestor_id;
+	int error;
+
+	cl_git_pass(git_branch_lookup(&ours, repo, ours_name, GIT_BRANCH_LOCAL));
+	cl_git_pass(git_branch_lookup(&theirs, repo, theirs_name, GIT_BRANCH_LOCAL));
+	cl_git_pass(git_commit_lookup(&our_commit, repo, git_reference_target(ours)));
+	cl_git_pass(git_commit_lookup(&their_commit, repo, git_reference_target(theirs)));
+
+	*ancestor_tree = NULL;
+
+	error = git_merge_base(&ancestor_id, repo,
+		git_commit_id(our_commit), git_commit_id(their_commit));
+
+	if (error != GIT_ENOTFOUND) {
+		cl_git_pass(error);
+		cl_git_pass(git_commit_lookup(&ancestor_commit, repo, &ancestor_id));
+		cl_git_pass(git_commit_tree(ancestor_tree, ancestor_commit));
+		git_commit_free(ancestor_commit);
+	}
+
+	cl_git_pass(git_commit_tree(our_tree, our_commit));
+	cl_git_pass(git_commit_tree(their_tree, their_commit));
+
+	git_commit_free(our_commit);
+	git_commit_free(their_commit);
+	git_reference_free(ours);
+	git_reference_free(theirs);
+}
+
+static size_t conflict_count(git_index *index)
+{
+	git_index_conflict_iterator *iter;
+	const git_index_entry *ancestor, *ours, *theirs;
+	size_t count = 0;
+	int error;
+
+	cl_git_pass(git_index_conflict_iterator_new(&iter, index));
+
+	while ((error = git_index_conflict_next(&ancestor, &ours, &theirs, iter)) == 0)
+		count++;
+
+	cl_assert_equal_i(GIT_ITEROVER, error);
+	git_index_conflict_iterator_free(iter);
+
+	return count;
+}
+
+static void assert_same_as_index_merge(
+	const char *ours_name,
+	const char *theirs_name,
+	const git_merge_options *opts)
+{
+	git_tree *ancestor_tree, *our_tree, *their_tree;
+	git_index *index, *conflicts;
+	git_oid expected, actual;
+	int error;
+
+	lookup_trees(&ancestor_tree, &our_tree, &their_tree,
+		ours_name, theirs_name);
+
+	cl_git_pass(git_merge_trees(&index, repo,
+		ancestor_tree, our_tree, their_tree, opts));
+
+	error = git_merge_trees_to_tree(&actual, &conflicts, repo,
+		ancestor_tree, our_tree, their_tree, opts);
+
+	if (git_index_has_conflicts(index)) {
+		cl_assert_equal_i(GIT_EMERGECONFLICT, error);
+		cl_assert(git_oid_is_zero(&actual));
+		cl_assert_equal_sz(conflict_count(index), conflict_count(conflicts));
+		cl_assert(git_index_entrycount(conflicts) <=
+			conflict_count(conflicts) * 3);
+	} else {
+		cl_git_pass(error);
+		cl_assert_equal_p(NULL, conflicts);
+		cl_git_pass(git_index_write_tree_to(&expected, index, repo));
+		cl_assert_equal_oid(&expected, &actual);
+	}
+
+	git_index_free(conflicts);
+	git_index_free(index);
+	git_tree_free(ancestor_tree);
+	git_tree_free(our_tree);
+	git_tree_free(their_tree);
+}
+
+static const char *branches[] = {
+	"branch", "df_side1", "df_side2", "ff_branch", "octo1", "octo2",
+	"previous", "rename_conflict_ours", "rename_conflict_theirs",
+	"renames1", "renames2", "submodules", "submodules-branch",
+	"trivial-10-branch", "trivial-11-branch", "trivial-13-branch",
+	"trivial-14-branch", "trivial-2alt-branch", "trivial-3alt-branch",
+	"trivial-4-branch", "trivial-5alt-1-branch", "trivial-5alt-2-branch",
+	"trivial-6-branch", "trivial-7-branch", "trivial-8-branch",
+	"trivial-9-branch", "unrelated",
+};
+
+void test_merge_trees_totree__matches_index_merge(void)
+{
+	git_merge_options opts = GIT_MERGE_OPTIONS_INIT;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(branches); i++) {
+		assert_same_as_index_merge("master", branches[i], &opts);
+		assert_same_as_index_merge(branches[i], "master", &opts);
+	}
+
+	assert_same_as_index_merge("renames1", "renames2", &opts);
+	assert_same_as_index_merge(
+		"rename_conflict_ours", "rename_conflict_theirs", &opts);
+	assert_same_as_index_merge("df_side1", "df_side2", &opts);
+}
+
+void test_merge_trees_totree__matches_index_merge_without_renames(void)
+{
+	git_merge_options opts = GIT_MERGE_OPTIONS_INIT;
+	size_t i;
+
+	opts.flags &= ~GIT_MERGE_FIND_RENAMES;
+
+	for (i = 0; i < ARRAY_SIZE(branches); i++) {
+		assert_same_as_index_merge("master", branches[i], &opts);
+		assert_same_as_index_merge(branches[i], "master", &opts);
+	}
+
+	assert_same_as_index_merge("renames1", "renames2", &opts);
+	assert_same_as_index_merge(
+		"rename_conflict_ours", "rename_conflict_theirs", &opts);
+	assert_same_as_index_merge("df_side1", "df_side2", &opts);
+}
+
+void test_merge_trees_totree__reports_only_conflicts(void)
+{
+	git_tree *ancestor_tree, *our_tree, *their_tree;
+	git_index *conflicts;
+	const git_index_entry *ancestor, *ours, *theirs;
+	git_oid id;
+
+	lookup_trees(&ancestor_tree, &our_tree, &their_tree,
+		"master", "branch");
+
+	cl_assert_equal_i(GIT_EMERGECONFLICT, git_merge_trees_to_tree(&id,
+		&conflicts, repo, ancestor_tree, our_tree, their_tree, NULL));
+
+	/* only the conflicting file is in the index, in stages 1 to 3 */
+	cl_assert_equal_i(3, git_index_entrycount(conflicts));
+	cl_git_pass(git_index_conflict_get(&ancestor, &ours, &theirs,
+		conflicts, "conflicting.txt"));
+	cl_assert_equal_s("conflicting.txt", ours->path);
+
+	git_index_free(conflicts);
+	git_tree_free(ancestor_tree);
+	git_tree_free(our_tree);
+	git_tree_free(their_tree);
+}
+
+void test_merge_trees_totree__fail_on_conflict(void)
+{
+	git_merge_options opts = GIT_MERGE_OPTIONS_INIT;
+	git_tree *ancestor_tree, *our_tree, *their_tree;
+	git_index *conflicts;
+	git_oid id;
+
+	opts.flags |= GIT_MERGE_FAIL_ON_CONFLICT;
+
+	lookup_trees(&ancestor_tree, &our_tree, &their_tree,
+		"master", "branch");
+
+	cl_assert_equal_i(GIT_EMERGECONFLICT, git_merge_trees_to_tree(&id,
+		&conflicts, repo, ancestor_tree, our_tree, their_tree, &opts));
+	cl_assert_equal_p(NULL, conflicts);
+
+	git_tree_free(ancestor_tree);
+	git_tree_free(our_tree);
+	git_tree_free(their_tree);
+}
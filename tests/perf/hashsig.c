@@ -0,0 +1,99 @@
+#include "clar_libgit2.h"
+#include "helper__perf__timer.h"
+#include "git2/sys/hashsig.h"
+
+/*
+ * Time the similarity signatures of a few kinds of text, with each of
+ * the whitespace options: indented source code, long lines of prose,
+ * and source code with CRLF line endings.
+ */
+#define PERF_HASHSIG_SIZE (64 * 1024 * 1024)
+#define PERF_HASHSIG_BLOB_SIZE (64 * 1024)
+
+static git_buf corpus = GIT_BUF_INIT;
+
+static const char *words[] = {
+	"return", "error", "if", "while", "for", "size_t", "git_buf", "int",
+	"the", "repository", "commit", "tree", "of", "and", "a", "to",
+	"(", ")", "{", "}", ";", "=", "->", "*", "0", "NULL", "goto", "done"
+};
+
+static void build_corpus(size_t max_words, size_t indent, const char *eol)
+{
+	uint32_t seed = 4242;
+	size_t i, count;
+
+	git_buf_clear(&corpus);
+
+	while (corpus.size < PERF_HASHSIG_SIZE) {
+		seed = seed * 1103515245 + 12345;
+
+		for (i = 0; i < ((seed >> 16) % (indent + 1)); i++)
+			cl_git_pass(git_buf_putc(&corpus, '\t'));
+
+		count = (seed >> 20) % max_words + 1;
+
+		for (i = 0; i < count; i++) {
+			seed = seed * 1103515245 + 12345;
+			cl_git_pass(git_buf_puts(&corpus,
+				words[(seed >> 16) % ARRAY_SIZE(words)]));
+			cl_git_pass(git_buf_putc(&corpus, ' '));
+		}
+
+		cl_git_pass(git_buf_puts(&corpus, eol));
+	}
+}
+
+void test_perf_hashsig__cleanup(void)
+{
+	git_buf_dispose(&corpus);
+}
+
+static void time_signatures(const char *kind)
+{
+	static const struct {
+		git_hashsig_option_t opt;
+		const char *name;
+	} options[] = {
+		{ GIT_HASHSIG_NORMAL, "normal" },
+		{ GIT_HASHSIG_IGNORE_WHITESPACE, "ignore whitespace" },
+		{ GIT_HASHSIG_SMART_WHITESPACE, "smart whitespace" },
+	};
+	git_hashsig *sig;
+	size_t i, offset;
+
+	for (i = 0; i < ARRAY_SIZE(options); i++) {
+		perf_timer timer = PERF_TIMER_INIT;
+
+		perf__timer__start(&timer);
+
+		/* sign the corpus in blob-sized pieces, like rename detection */
+		for (offset = 0; offset < corpus.size; offset += PERF_HASHSIG_BLOB_SIZE) {
+			cl_git_pass(git_hashsig_create(&sig, corpus.ptr + offset,
+				min(PERF_HASHSIG_BLOB_SIZE, corpus.size - offset),
+				options[i].opt | GIT_HASHSIG_ALLOW_SMALL_FILES));
+			git_hashsig_free(sig);
+		}
+
+		perf__timer__stop(&timer);
+		perf__timer__report(&timer, "%s, %s", kind, options[i].name);
+	}
+}
+
+void test_perf_hashsig__source_code(void)
+{
+	build_corpus(10, 4, "\n");
+	time_signatures("source code");
+}
+
+void test_perf_hashsig__prose(void)
+{
+	build_corpus(60, 0, "\n");
+	time_signatures("prose");
+}
+
+void test_perf_hashsig__crlf_source_code(void)
+{
+	build_corpus(10, 4, "\r\n");
+	time_signatures("crlf source code");
+}
@@ -0,0 +1,96 @@
+#include "clar_libgit2.h"
+#include "helper__perf__timer.h"
+#include "pqueue.h"
+#include "commit_list.h"
+
+/*
+ * Compare the generic priority queue against the commit queue for the
+ * access pattern of a date-ordered walk: pop the most recent commit and
+ * push its parents, with a frontier of a few thousand commits.
+ */
+#define PERF_QUEUE_COMMITS 4000000
+#define PERF_QUEUE_FRONTIER 4096
+
+static git_commit_list_node *nodes;
+
+void test_perf_pqueue__initialize(void)
+{
+	size_t i;
+	uint32_t seed = 12345;
+
+	nodes = git__calloc(PERF_QUEUE_COMMITS, sizeof(git_commit_list_node));
+	cl_assert(nodes);
+
+	/* commits are mostly older than their children, with some skew */
+	for (i = 0; i < PERF_QUEUE_COMMITS; i++) {
+		seed = seed * 1103515245 + 12345;
+		nodes[i].time = (int64_t)(PERF_QUEUE_COMMITS - i) * 60 + (seed >> 16) % 3600;
+		nodes[i].generation = (uint32_t)(PERF_QUEUE_COMMITS - i);
+	}
+}
+
+void test_perf_pqueue__cleanup(void)
+{
+	git__free(nodes);
+	nodes = NULL;
+}
+
+static void walk_pqueue(git_vector_cmp cmp, const char *name)
+{
+	perf_timer timer = PERF_TIMER_INIT;
+	git_pqueue queue;
+	size_t next = 0;
+
+	cl_git_pass(git_pqueue_init(&queue, 0, PERF_QUEUE_FRONTIER, cmp));
+
+	perf__timer__start(&timer);
+
+	while (next < PERF_QUEUE_FRONTIER)
+		cl_git_pass(git_pqueue_insert(&queue, &nodes[next++]));
+
+	while (git_pqueue_pop(&queue) != NULL) {
+		if (next < PERF_QUEUE_COMMITS)
+			cl_git_pass(git_pqueue_insert(&queue, &nodes[next++]));
+	}
+
+	perf__timer__stop(&timer);
+	perf__timer__report(&timer, "git_pqueue, %s", name);
+
+	git_pqueue_free(&queue);
+}
+
+static void walk_commit_queue(bool use_generations, const char *name)
+{
+	perf_timer timer = PERF_TIMER_INIT;
+	git_commit_queue queue;
+	size_t next = 0;
+
+	git_commit_queue_init(&queue, use_generations);
+
+	perf__timer__start(&timer);
+
+	while (next < PERF_QUEUE_FRONTIER)
+		cl_git_pass(git_commit_queue_insert(&queue, &nodes[next++]));
+
+	while (git_commit_queue_pop(&queue) != NULL) {
+		if (next < PERF_QUEUE_COMMITS)
+			cl_git_pass(git_commit_queue_insert(&queue, &nodes[next++]));
+	}
+
+	perf__timer__stop(&timer);
+	perf__timer__report(&timer, "git_commit_queue, %s", name);
+
+	git_commit_queue_free(&queue);
+}
+
+void test_perf_pqueue__by_time(void)
+{
+	walk_pqueue(git_commit_list_time_cmp, "by time");
+	walk_commit_queue(false, "by time");
+}
+
+void test_perf_pqueue__by_generation(void)
+{
+	walk_pqueue(git_commit_list_generation_cmp, "by generation");
+	walk_commit_queue(true, "by generation");
+}
@@ -208,3 +208,63 @@ void test_rebase_inmemory__with_directories(void)
 	git_reference_free(upstream_ref);
 	git_rebase_free(rebase);
 }
+
+void test_rebase_inmemory__index_follows_each_operation(void)
+{
+	git_rebase *rebase;
+	git_reference *branch_ref, *upstream_ref;
+	git_annotated_commit *branch_head, *upstream_head;
+	git_rebase_operation *rebase_operation;
+	git_index *rebase_index;
+	git_index_entry extra = {{0}};
+	git_oid commit_id, tree_id;
+	git_commit *commit;
+	git_tree *tree;
+	git_tree_entry *entry;
+	git_rebase_options opts = GIT_REBASE_OPTIONS_INIT;
+
+	opts.inmemory = true;
+
+	cl_git_pass(git_reference_lookup(&branch_ref, repo, "refs/heads/beef"));
+	cl_git_pass(git_reference_lookup(&upstream_ref, repo, "refs/heads/master"));
+
+	cl_git_pass(git_annotated_commit_from_ref(&branch_head, repo, branch_ref));
+	cl_git_pass(git_annotated_commit_from_ref(&upstream_head, repo, upstream_ref));
+
+	cl_git_pass(git_rebase_init(&rebase, repo, branch_head, upstream_head, NULL, &opts));
+
+	cl_git_pass(git_rebase_next(&rebase_operation, rebase));
+	cl_git_pass(git_rebase_inmemory_index(&rebase_index, rebase));
+	cl_git_pass(git_index_write_tree_to(&tree_id, rebase_index, repo));
+	cl_git_pass(git_rebase_commit(&commit_id, rebase, NULL, signature, NULL, NULL));
+
+	cl_git_pass(git_commit_lookup(&commit, repo, &commit_id));
+	cl_assert_equal_oid(&tree_id, git_commit_tree_id(commit));
+	git_commit_free(commit);
+
+	/* the index we are holding reflects the next operation, too */
+	cl_git_pass(git_rebase_next(&rebase_operation, rebase));
+	cl_assert(!git_index_has_conflicts(rebase_index));
+
+	extra.path = "extra.txt";
+	extra.mode = GIT_FILEMODE_BLOB;
+	git_oid_fromstr(&extra.id, "414dfc71ead79c07acd4ea47fecf91f289afc4b9");
+	cl_git_pass(git_index_add(rebase_index, &extra));
+
+	cl_git_pass(git_rebase_commit(&commit_id, rebase, NULL, signature, NULL, NULL));
+
+	cl_git_pass(git_commit_lookup(&commit, repo, &commit_id));
+	cl_git_pass(git_commit_tree(&tree, commit));
+	cl_git_pass(git_tree_entry_bypath(&entry, tree, "extra.txt"));
+	cl_assert_equal_oid(&extra.id, git_tree_entry_id(entry));
+
+	git_tree_entry_free(entry);
+	git_tree_free(tree);
+	git_commit_free(commit);
+	git_index_free(rebase_index);
+	git_annotated_commit_free(branch_head);
+	git_annotated_commit_free(upstream_head);
+	git_reference_free(branch_ref);
+	git_reference_free(upstream_ref);
+	git_rebase_free(rebase);
+}
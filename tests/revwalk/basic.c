@@ -1,4 +1,5 @@
 #include "clar_libgit2.h"
+#include "revwalk.h"
 
 /*
 	*   a4a7dce [0] Merge branch 'master' into br2
@@ -456,6 +457,69 @@ void test_revwalk_basic__push_all(void)
 	cl_assert_equal_i(15, i);
 }
 
+void test_revwalk_basic__topological_order_of_everything(void)
+{
+	git_oid oid, shown[32];
+	git_commit *commit;
+	size_t i, j, count = 0;
+	unsigned int p;
+
+	revwalk_basic_setup_walk(NULL);
+
+	git_revwalk_sorting(_walk, GIT_SORT_TOPOLOGICAL);
+	cl_git_pass(git_revwalk_push_glob(_walk, "*"));
+
+	while (git_revwalk_next(&oid, _walk) == 0) {
+		cl_assert(count < ARRAY_SIZE(shown));
+		git_oid_cpy(&shown[count++], &oid);
+	}
+
+	cl_assert_equal_i(15, count);
+
+	/* no commit is shown before any of its children */
+	for (i = 0; i < count; i++) {
+		cl_git_pass(git_commit_lookup(&commit, _repo, &shown[i]));
+
+		for (p = 0; p < git_commit_parentcount(commit); p++) {
+			for (j = 0; j < i; j++)
+				cl_assert(!git_oid_equal(&shown[j], git_commit_parent_id(commit, p)));
+		}
+
+		git_commit_free(commit);
+	}
+}
+
+void test_revwalk_basic__topological_walk_is_incremental(void)
+{
+	git_oid oid;
+	int i = 0;
+
+	revwalk_basic_setup_walk("testrepo.git");
+
+	/* without generation numbers, the whole history is walked */
+	git_revwalk_sorting(_walk, GIT_SORT_TOPOLOGICAL);
+	cl_git_pass(git_revwalk_push_head(_walk));
+
+	while (git_revwalk_next(&oid, _walk) == 0)
+		i++;
+
+	cl_assert_equal_i(7, i);
+	cl_assert_equal_i(7, git_oidmap_size(_walk->commits));
+	git_revwalk_free(_walk);
+	_walk = NULL;
+
+	cl_git_pass(git_reference_name_to_id(&oid, _repo, "HEAD"));
+	cl_git_pass(git_graph_generations_update(_repo, &oid, 1));
+
+	/* with them, a walk only looks at the history that it needs to */
+	cl_git_pass(git_revwalk_new(&_walk, _repo));
+	git_revwalk_sorting(_walk, GIT_SORT_TOPOLOGICAL);
+	cl_git_pass(git_revwalk_push_head(_walk));
+
+	cl_git_pass(git_revwalk_next(&oid, _walk));
+	cl_assert(git_oidmap_size(_walk->commits) < 7);
+}
+
 /*
 * $ git rev-list br2 master e908
 * a65fedf39aefe402d3bb6e24df4d4f5fe4547750
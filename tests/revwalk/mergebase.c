@@ -1,5 +1,7 @@
 #include "clar_libgit2.h"
 #include "vector.h"
+#include "revwalk.h"
+#include "repository.h"
 #include <stdarg.h>
 
 static git_repository *_repo;
@@ -512,3 +514,79 @@ void test_revwalk_mergebase__remove_redundant(void)
 	git_oidarray_free(&result);
 	git_repository_free(repo);
 }
+
+static void assert_generation(git_revwalk *walk, const char *sha, uint32_t expected)
+{
+	git_commit_list_node *node;
+	uint32_t generation;
+	git_oid oid;
+
+	cl_git_pass(git_oid_fromstr(&oid, sha));
+	cl_assert((node = git_revwalk__commit_lookup(walk, &oid)) != NULL);
+	cl_git_pass(git_commit_list_generation(&generation, walk, node));
+	cl_assert_equal_i(expected, generation);
+}
+
+void test_revwalk_mergebase__generation_numbers(void)
+{
+	git_repository *repo;
+	git_revwalk *walk;
+	git_oid tip;
+
+	repo = cl_git_sandbox_init("testrepo.git");
+
+	/* nothing is computed until the generations are stored */
+	cl_git_pass(git_revwalk_new(&walk, repo));
+	assert_generation(walk, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750", 0);
+	git_revwalk_free(walk);
+
+	cl_git_pass(git_oid_fromstr(&tip, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750"));
+	cl_git_pass(git_graph_generations_update(repo, &tip, 1));
+	cl_assert(git_path_exists("testrepo.git/objects/info/commit-generations"));
+
+	cl_git_pass(git_revwalk_new(&walk, repo));
+	assert_generation(walk, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750", 6);
+	assert_generation(walk, "be3563ae3f795b2b4353bcce3a527ad0a4f7f644", 5);
+	assert_generation(walk, "9fd738e8f7967c078dceed8190330fc8648ee56a", 4);
+	assert_generation(walk, "c47800c7266a2be04c571c04d5a6614691ea99bd", 3);
+	assert_generation(walk, "4a202b346bb0fb0db7eff3cffeb3c70babbd2045", 3);
+	assert_generation(walk, "8496071c1b46c854b31185ea97743be6a8774479", 1);
+
+	/* commits outside of the stored history have no generation */
+	assert_generation(walk, "e90810b8df3e80c413d903f631643c716887138d", 0);
+	git_revwalk_free(walk);
+
+	cl_git_sandbox_cleanup();
+}
+
+void test_revwalk_mergebase__does_not_store_generations(void)
+{
+	git_oid result, one, two;
+
+	cl_git_pass(git_oid_fromstr(&one, "a4a7dce85cf63874e984719f4fdd239f5145052f"));
+	cl_git_pass(git_oid_fromstr(&two, "be3563ae3f795b2b4353bcce3a527ad0a4f7f644"));
+
+	cl_git_pass(git_merge_base(&result, _repo, &one, &two));
+	cl_assert(!git_path_exists(cl_fixture("testrepo.git/objects/info/commit-generations")));
+}
+
+void test_revwalk_mergebase__with_stored_generations(void)
+{
+	git_repository *repo;
+	git_oid result, expected, one, two, tips[2];
+
+	repo = cl_git_sandbox_init("testrepo.git");
+
+	cl_git_pass(git_oid_fromstr(&one, "a4a7dce85cf63874e984719f4fdd239f5145052f"));
+	cl_git_pass(git_oid_fromstr(&two, "be3563ae3f795b2b4353bcce3a527ad0a4f7f644"));
+	cl_git_pass(git_merge_base(&expected, repo, &one, &two));
+
+	git_oid_cpy(&tips[0], &one);
+	git_oid_cpy(&tips[1], &two);
+	cl_git_pass(git_graph_generations_update(repo, tips, 2));
+
+	cl_git_pass(git_merge_base(&result, repo, &one, &two));
+	cl_assert_equal_oid(&expected, &result);
+
+	cl_git_sandbox_cleanup();
+}
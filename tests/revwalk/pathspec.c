@@ -0,0 +1,138 @@
+#include "clar_libgit2.h"
+
+static git_repository *_repo;
+static git_revwalk *_walk;
+
+void test_revwalk_pathspec__initialize(void)
+{
+	cl_git_pass(git_repository_open(&_repo, cl_fixture("testrepo.git")));
+	cl_git_pass(git_revwalk_new(&_walk, _repo));
+}
+
+void test_revwalk_pathspec__cleanup(void)
+{
+	git_revwalk_free(_walk);
+	_walk = NULL;
+
+	git_repository_free(_repo);
+	_repo = NULL;
+}
+
+static void assert_walk(
+	const char *ref,
+	unsigned int sorting,
+	const char *path1,
+	const char *path2,
+	const char **expected,
+	size_t expected_len)
+{
+	char *paths[2];
+	git_strarray pathspec = { paths, 0 };
+	git_oid oid, expected_oid;
+	size_t i = 0;
+
+	paths[pathspec.count++] = (char *)path1;
+	if (path2)
+		paths[pathspec.count++] = (char *)path2;
+
+	git_revwalk_sorting(_walk, sorting);
+	cl_git_pass(git_revwalk_pathspec(_walk, &pathspec));
+	cl_git_pass(git_revwalk_push_ref(_walk, ref));
+
+	while (git_revwalk_next(&oid, _walk) == 0) {
+		cl_assert(i < expected_len);
+		cl_git_pass(git_oid_fromstr(&expected_oid, expected[i++]));
+		cl_assert_equal_oid(&expected_oid, &oid);
+	}
+
+	cl_assert_equal_sz(expected_len, i);
+}
+
+void test_revwalk_pathspec__follows_the_treesame_parent_of_a_merge(void)
+{
+	/* git log master -- README */
+	const char *expected[] = {
+		"4a202b346bb0fb0db7eff3cffeb3c70babbd2045",
+		"8496071c1b46c854b31185ea97743be6a8774479",
+	};
+
+	assert_walk("refs/heads/master", GIT_SORT_TIME,
+		"README", NULL, expected, ARRAY_SIZE(expected));
+}
+
+void test_revwalk_pathspec__multiple_paths(void)
+{
+	/* git log master -- README new.txt */
+	const char *expected[] = {
+		"9fd738e8f7967c078dceed8190330fc8648ee56a",
+		"4a202b346bb0fb0db7eff3cffeb3c70babbd2045",
+		"5b5b025afb0b4c913b4c338a42934a3863bf3644",
+		"8496071c1b46c854b31185ea97743be6a8774479",
+	};
+
+	assert_walk("refs/heads/master", GIT_SORT_TIME,
+		"README", "new.txt", expected, ARRAY_SIZE(expected));
+}
+
+void test_revwalk_pathspec__shows_merges_that_change_the_paths(void)
+{
+	/* git log --topo-order master -- new.txt branch_file.txt */
+	const char *expected[] = {
+		"a65fedf39aefe402d3bb6e24df4d4f5fe4547750",
+		"be3563ae3f795b2b4353bcce3a527ad0a4f7f644",
+		"c47800c7266a2be04c571c04d5a6614691ea99bd",
+		"9fd738e8f7967c078dceed8190330fc8648ee56a",
+		"5b5b025afb0b4c913b4c338a42934a3863bf3644",
+	};
+
+	assert_walk("refs/heads/master", GIT_SORT_TOPOLOGICAL | GIT_SORT_TIME,
+		"new.txt", "branch_file.txt", expected, ARRAY_SIZE(expected));
+}
+
+void test_revwalk_pathspec__first_parent(void)
+{
+	/* git log --first-parent master -- new.txt */
+	const char *expected[] = {
+		"9fd738e8f7967c078dceed8190330fc8648ee56a",
+		"5b5b025afb0b4c913b4c338a42934a3863bf3644",
+	};
+
+	cl_git_pass(git_revwalk_simplify_first_parent(_walk));
+	assert_walk("refs/heads/master", GIT_SORT_TIME,
+		"new.txt", NULL, expected, ARRAY_SIZE(expected));
+}
+
+void test_revwalk_pathspec__directories(void)
+{
+	/* git log subtrees -- ab/de/ */
+	const char *expected[] = {
+		"763d71aadf09a7951596c9746c024e7eece7c7af",
+	};
+
+	assert_walk("refs/heads/subtrees", GIT_SORT_NONE,
+		"ab/de/", NULL, expected, ARRAY_SIZE(expected));
+}
+
+void test_revwalk_pathspec__nonexistent_path(void)
+{
+	assert_walk("refs/heads/master", GIT_SORT_TIME,
+		"nonexistent", NULL, NULL, 0);
+}
+
+void test_revwalk_pathspec__is_undone_by_reset(void)
+{
+	const char *path = "README";
+	git_strarray pathspec = { (char **)&path, 1 };
+	git_oid oid;
+	int i = 0;
+
+	cl_git_pass(git_revwalk_pathspec(_walk, &pathspec));
+	git_revwalk_reset(_walk);
+
+	cl_git_pass(git_revwalk_push_ref(_walk, "refs/heads/master"));
+
+	while (git_revwalk_next(&oid, _walk) == 0)
+		i++;
+
+	cl_assert_equal_i(7, i);
+}
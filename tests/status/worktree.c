@@ -1006,7 +1006,7 @@ void test_status_worktree__update_stat_cache_0(void)
 	cl_git_pass(git_status_list_new(&status, repo, &opts));
 	check_status0(status);
 	cl_git_pass(git_status_list_get_perfdata(&perf, status));
-	cl_assert_equal_sz(13 + 3, perf.stat_calls);
+	cl_assert_equal_sz(11 + 3 + cl_dir_stat_calls(2), perf.stat_calls);
 	cl_assert_equal_sz(5, perf.oid_calculations);
 
 	git_status_list_free(status);
@@ -1020,7 +1020,7 @@ void test_status_worktree__update_stat_cache_0(void)
 	cl_git_pass(git_status_list_new(&status, repo, &opts));
 	check_status0(status);
 	cl_git_pass(git_status_list_get_perfdata(&perf, status));
-	cl_assert_equal_sz(13 + 3, perf.stat_calls);
+	cl_assert_equal_sz(11 + 3 + cl_dir_stat_calls(2), perf.stat_calls);
 	cl_assert_equal_sz(5, perf.oid_calculations);
 
 	git_status_list_free(status);
@@ -1032,7 +1032,7 @@ void test_status_worktree__update_stat_cache_0(void)
 	cl_git_pass(git_status_list_new(&status, repo, &opts));
 	check_status0(status);
 	cl_git_pass(git_status_list_get_perfdata(&perf, status));
-	cl_assert_equal_sz(13 + 3, perf.stat_calls);
+	cl_assert_equal_sz(11 + 3 + cl_dir_stat_calls(2), perf.stat_calls);
 	cl_assert_equal_sz(0, perf.oid_calculations);
 
 	git_status_list_free(status);
@@ -1315,3 +1315,26 @@ void test_status_worktree__at_head_parent(void)
 	git_tree_free(parent_tree);
 	git_status_list_free(statuslist);
 }
+
+void test_status_worktree__preload_index(void)
+{
+	git_repository *repo = cl_git_sandbox_init("status");
+	git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+	git_status_list *status;
+	git_diff_perfdata perf = GIT_DIFF_PERFDATA_INIT;
+
+	cl_repo_set_bool(repo, "core.preloadIndex", true);
+
+	opts.flags = GIT_STATUS_OPT_DEFAULTS;
+
+	cl_git_pass(git_status_list_new(&status, repo, &opts));
+	check_status0(status);
+	cl_git_pass(git_status_list_get_perfdata(&perf, status));
+
+	/* all 13 index entries are preloaded; the 5 files that the index
+	 * doesn't know about (and the 2 directories) are stat'ed as read */
+	cl_assert_equal_sz(13 + 5 + cl_dir_stat_calls(2), perf.stat_calls);
+	cl_assert_equal_sz(5, perf.oid_calculations);
+
+	git_status_list_free(status);
+}